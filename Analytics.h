@@ -0,0 +1,405 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Audience Engagement Analytics                *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The analytics keep track of how the audience uses the sculpture, so shows can be tuned for
+// each venue.  Every filtered ultrasonic distance is counted in a histogram, visitors are
+// counted along with how long they stay, and the time someone is in front of the sculpture is
+// totalled for each hour of the day using the real time clock.
+//
+// The statistics are checkpointed to EEPROM every 15 minutes so they survive power cycles.  To
+// spread the wear they are written to a ring of slots, each with a sequence number, and on
+// power up the slot with the highest sequence number is used.  Only the bytes that have changed
+// are written.
+//
+// Each EEPROM byte written takes about 3.3ms, and the slot being written last held the
+// statistics of 2 hours ago so many bytes differ.  Writing the record all at once would hold up
+// the main loop for 100ms or more, so a copy is taken when the checkpoint starts and it is
+// written a byte at a time as the analytics task runs, starting each write only once the last
+// has finished so the task never waits for the EEPROM.  The sequence number and checksum are
+// written last, so a slot cut short by the power going off is never taken as the newest.
+//
+
+//
+// analytics constants
+//
+const byte ANALYTICS_HISTOGRAM_BINS = 12;                // bins 0 - 9 are 25cm each, 10 is farther, 11 is nothing seen
+const int ANALYTICS_HISTOGRAM_BIN_CM = 25;
+const byte ANALYTICS_HISTOGRAM_FAR_BIN = 10;
+const byte ANALYTICS_HISTOGRAM_NOTHING_BIN = 11;
+const unsigned int ANALYTICS_VISITOR_MM = 2500;          // someone closer than this is a visitor
+const unsigned int ANALYTICS_MIN_VISIT_MS = 2000;        // a visitor must stay this long to be counted
+const unsigned int ANALYTICS_LEAVE_MS = 3000;            // a visitor has left after being gone this long
+const unsigned long ANALYTICS_CHECKPOINT_MS = 15UL * 60UL * 1000UL;
+const unsigned long ANALYTICS_HOUR_CHECK_MS = 60000;     // how often the RTC is read for the hour
+
+//
+// the statistics, this is also the record saved in each EEPROM slot
+//
+typedef struct {
+  unsigned int sequence;                        // higher for each checkpoint
+  unsigned int distanceHistogram[ANALYTICS_HISTOGRAM_BINS];
+  unsigned int visitorCount;
+  unsigned long dwellTimeSeconds;               // total time of all visits
+  unsigned long hourlyEngagementSeconds[24];    // time someone was in front of the sculpture, by hour
+  byte checksum;
+} ANALYTICS_RECORD;
+
+//
+// function prototypes
+//
+void analyticsInitialize();
+void analyticsUpdate();
+void analyticsCountDistance(int distanceInMM);
+void analyticsTrackVisitor(int distanceInMM, unsigned long sampleTimeMS);
+void analyticsCheckpoint();
+void analyticsSaveNextByte();
+void analyticsClear();
+byte analyticsChecksum(ANALYTICS_RECORD *record);
+int analyticsSlotAddress(byte slot);
+void analyticsSerialDump();
+
+
+// ---------------------------------------------------------------------------------
+//                                Analytics Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the analytics
+//
+ANALYTICS_RECORD analytics;
+byte analyticsSlot;                             // slot the statistics were last saved in
+ANALYTICS_RECORD analyticsSaveRecord;           // the statistics being saved, as they were when the checkpoint started
+unsigned int analyticsSaveCount;                // bytes of the record saved, sizeof(ANALYTICS_RECORD) when done
+unsigned long analyticsLastDistanceTimeMS;
+unsigned long analyticsLastCheckpointTimeMS;
+unsigned long analyticsLastHourCheckTimeMS;
+byte analyticsHour;
+bool analyticsVisitorPresentFlg;
+bool analyticsVisitorCountedFlg;
+unsigned long analyticsVisitStartTimeMS;
+unsigned long analyticsVisitLastSeenTimeMS;
+unsigned int analyticsEngagedMS;                // engaged time not yet added to the hourly total
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the analytics, restoring the statistics from the newest EEPROM slot
+//
+void analyticsInitialize()
+{
+  ANALYTICS_RECORD record;
+  bool foundFlg;
+  byte minute;
+  byte second;
+
+  //
+  // find the valid slot with the highest sequence number
+  //
+  foundFlg = false;
+  for (byte slot = 0; slot < EEPROM_ANALYTICS_SLOT_COUNT; slot++)
+  {
+    EEPROM.get(analyticsSlotAddress(slot), record);
+    if (record.checksum != analyticsChecksum(&record))
+      continue;
+
+    if (!foundFlg || ((int) (record.sequence - analytics.sequence) > 0))
+    {
+      analytics = record;
+      analyticsSlot = slot;
+      foundFlg = true;
+    }
+  }
+
+  if (!foundFlg)
+  {
+    analyticsClear();
+    analyticsSlot = EEPROM_ANALYTICS_SLOT_COUNT - 1;
+  }
+  analyticsSaveCount = sizeof(ANALYTICS_RECORD);
+
+  //
+  // start tracking with nobody in front of the sculpture
+  //
+  analyticsVisitorPresentFlg = false;
+  analyticsEngagedMS = 0;
+  analyticsLastDistanceTimeMS = ultrasonicGetFilteredDistanceTimeMS();
+  analyticsLastCheckpointTimeMS = millis();
+  analyticsLastHourCheckTimeMS = millis();
+  RTCGetTime(&analyticsHour, &minute, &second);
+  if (analyticsHour >= 24)
+    analyticsHour = 0;
+}
+
+
+
+//
+// update the analytics with each new filtered distance, call this often from the main loop
+//
+void analyticsUpdate()
+{
+  unsigned long distanceTime;
+  int distanceInMM;
+  byte minute;
+  byte second;
+
+  //
+  // check for a new distance
+  //
+  distanceTime = ultrasonicGetFilteredDistanceTimeMS();
+  if (distanceTime != analyticsLastDistanceTimeMS)
+  {
+    distanceInMM = ultrasonicGetFilteredDistanceInMM();
+    analyticsCountDistance(distanceInMM);
+    analyticsTrackVisitor(distanceInMM, distanceTime);
+    analyticsLastDistanceTimeMS = distanceTime;
+  }
+
+  //
+  // periodically read the hour from the RTC, rather than reading it for every distance
+  //
+  if ((millis() - analyticsLastHourCheckTimeMS) >= ANALYTICS_HOUR_CHECK_MS)
+  {
+    RTCGetTime(&analyticsHour, &minute, &second);
+    if (analyticsHour >= 24)
+      analyticsHour = 0;
+    analyticsLastHourCheckTimeMS = millis();
+  }
+
+  //
+  // periodically save the statistics, carrying on with the checkpoint each time this runs
+  //
+  if ((millis() - analyticsLastCheckpointTimeMS) >= ANALYTICS_CHECKPOINT_MS)
+  {
+    analyticsCheckpoint();
+    analyticsLastCheckpointTimeMS = millis();
+  }
+
+  if (analyticsSaveCount < sizeof(ANALYTICS_RECORD))
+    analyticsSaveNextByte();
+}
+
+
+
+//
+// count a distance in the histogram, if a bin fills up all of them are halved so the shape of
+// the histogram is kept
+//  Enter: distanceInMM = filtered distance, 0 if nothing seen
+//
+void analyticsCountDistance(int distanceInMM)
+{
+  byte bin;
+
+  if (distanceInMM == 0)
+    bin = ANALYTICS_HISTOGRAM_NOTHING_BIN;
+  else
+    bin = min(distanceInMM / (ANALYTICS_HISTOGRAM_BIN_CM * 10), (int) ANALYTICS_HISTOGRAM_FAR_BIN);
+
+  if (analytics.distanceHistogram[bin] == 0xffff)
+  {
+    for (byte i = 0; i < ANALYTICS_HISTOGRAM_BINS; i++)
+      analytics.distanceHistogram[i] >>= 1;
+  }
+
+  analytics.distanceHistogram[bin]++;
+}
+
+
+
+//
+// follow visitors coming and going, counting each visit and how long it lasts
+//  Enter: distanceInMM = filtered distance, 0 if nothing seen
+//         sampleTimeMS = time the distance was measured
+//
+void analyticsTrackVisitor(int distanceInMM, unsigned long sampleTimeMS)
+{
+  unsigned long elapsedMS;
+
+  elapsedMS = sampleTimeMS - analyticsLastDistanceTimeMS;
+
+  if ((distanceInMM != 0) && ((unsigned int) distanceInMM < ANALYTICS_VISITOR_MM))
+  {
+    //
+    // someone is in front of the sculpture, add the time since the last distance to this hour
+    //
+    if (analyticsVisitorPresentFlg)
+    {
+      analyticsEngagedMS += min(elapsedMS, (unsigned long) ANALYTICS_LEAVE_MS);
+      if (analyticsEngagedMS >= 1000)
+      {
+        analytics.hourlyEngagementSeconds[analyticsHour] += analyticsEngagedMS / 1000;
+        analyticsEngagedMS %= 1000;
+      }
+    }
+    else
+    {
+      analyticsVisitorPresentFlg = true;
+      analyticsVisitorCountedFlg = false;
+      analyticsVisitStartTimeMS = sampleTimeMS;
+    }
+
+    analyticsVisitLastSeenTimeMS = sampleTimeMS;
+
+    //
+    // count the visitor once they have stayed long enough
+    //
+    if (!analyticsVisitorCountedFlg && ((sampleTimeMS - analyticsVisitStartTimeMS) >= ANALYTICS_MIN_VISIT_MS))
+    {
+      analytics.visitorCount++;
+      analyticsVisitorCountedFlg = true;
+    }
+    return;
+  }
+
+  //
+  // nobody in front, the visit is over once they have been gone for a while
+  //
+  if (analyticsVisitorPresentFlg && ((sampleTimeMS - analyticsVisitLastSeenTimeMS) >= ANALYTICS_LEAVE_MS))
+  {
+    if (analyticsVisitorCountedFlg)
+      analytics.dwellTimeSeconds += (analyticsVisitLastSeenTimeMS - analyticsVisitStartTimeMS) / 1000;
+    analyticsVisitorPresentFlg = false;
+  }
+}
+
+
+
+//
+// start saving the statistics in the next EEPROM slot, analyticsSaveNextByte() writes them
+//
+void analyticsCheckpoint()
+{
+  analyticsSlot++;
+  if (analyticsSlot >= EEPROM_ANALYTICS_SLOT_COUNT)
+    analyticsSlot = 0;
+
+  analytics.sequence++;
+  analyticsSaveRecord = analytics;
+  analyticsSaveRecord.checksum = analyticsChecksum(&analyticsSaveRecord);
+  analyticsSaveCount = 0;
+}
+
+
+
+//
+// carry on saving the statistics, writing no more than one byte that is different.  Nothing is
+// written while the EEPROM is still writing the last byte.  The record is written starting after
+// the sequence number, so the checksum at its end and then the sequence number are written last.
+//
+void analyticsSaveNextByte()
+{
+  unsigned int offset;
+  int address;
+  byte value;
+
+  while (analyticsSaveCount < sizeof(ANALYTICS_RECORD))
+  {
+    if (!eeprom_is_ready())
+      return;
+
+    offset = (analyticsSaveCount + sizeof(analyticsSaveRecord.sequence)) % sizeof(ANALYTICS_RECORD);
+    address = analyticsSlotAddress(analyticsSlot) + offset;
+    value = ((byte *) &analyticsSaveRecord)[offset];
+    analyticsSaveCount++;
+
+    if (EEPROM.read(address) != value)
+    {
+      EEPROM.write(address, value);
+      return;
+    }
+  }
+}
+
+
+
+//
+// clear the statistics
+//
+void analyticsClear()
+{
+  unsigned int sequence;
+
+  sequence = analytics.sequence;
+  memset(&analytics, 0, sizeof(analytics));
+  analytics.sequence = sequence;
+}
+
+
+
+//
+// compute the checksum of a record, a blank EEPROM does not give a valid checksum
+//  Enter: record -> record to check
+//  Exit:  checksum returned
+//
+byte analyticsChecksum(ANALYTICS_RECORD *record)
+{
+  byte checksum;
+
+  checksum = 0x5a;
+  for (unsigned int i = 0; i < offsetof(ANALYTICS_RECORD, checksum); i++)
+    checksum = (checksum << 1 | checksum >> 7) ^ ((byte *) record)[i];
+
+  return(checksum);
+}
+
+
+
+//
+// get the EEPROM address of a slot
+//  Enter: slot = slot number
+//  Exit:  address returned
+//
+int analyticsSlotAddress(byte slot)
+{
+  return(EEPROM_ANALYTICS_ADDRESS + slot * sizeof(ANALYTICS_RECORD));
+}
+
+
+
+//
+// write the statistics to the serial port
+//
+void analyticsSerialDump()
+{
+  Serial.println(F("Analytics"));
+
+  Serial.print(F("Visitors: "));
+  Serial.println(analytics.visitorCount);
+
+  Serial.print(F("Dwell seconds: "));
+  Serial.println(analytics.dwellTimeSeconds);
+
+  Serial.println(F("Distance histogram (cm, samples):"));
+  for (byte i = 0; i < ANALYTICS_HISTOGRAM_BINS; i++)
+  {
+    if (i == ANALYTICS_HISTOGRAM_NOTHING_BIN)
+      Serial.print(F("none"));
+    else if (i == ANALYTICS_HISTOGRAM_FAR_BIN)
+    {
+      Serial.print(i * ANALYTICS_HISTOGRAM_BIN_CM);
+      Serial.print('+');
+    }
+    else
+    {
+      Serial.print(i * ANALYTICS_HISTOGRAM_BIN_CM);
+      Serial.print('-');
+      Serial.print((i + 1) * ANALYTICS_HISTOGRAM_BIN_CM);
+    }
+    Serial.print(F(", "));
+    Serial.println(analytics.distanceHistogram[i]);
+  }
+
+  Serial.println(F("Hourly engagement (hour, seconds):"));
+  for (byte hour = 0; hour < 24; hour++)
+  {
+    Serial.print(hour);
+    Serial.print(F(", "));
+    Serial.println(analytics.hourlyEngagementSeconds[hour]);
+  }
+}
+
+
+// -------------------------------------- End --------------------------------------
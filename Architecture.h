@@ -13,7 +13,7 @@
 // the mode of the machine
 //
 
-enum Modes {actionMode, lightMode, playMode, meterStickMode, setContrastMode, setTimeMode, stoppedMode};
+enum Modes {actionMode, lightMode, playMode, meterStickMode, setContrastMode, setTimeMode, diagnosticsMode, stoppedMode};
 
 //
 //  name displayed on the LCD when each mode is selected
@@ -25,115 +25,279 @@ enum Modes {actionMode, lightMode, playMode, meterStickMode, setContrastMode, se
 //
 // global vars
 //
-byte timeDisplayCount;
 int sculptureMode;
+int modeRunning;                                // mode started by the mode task, NO_MODE while changing
+bool modeDisplayReadyFlg;                       // true once setup() has set up the LCD and analytics
+
+const int NO_MODE = -1;
+
+//
+// a mode that uses the buttons itself sets a handler, it is given each button event first and
+// returns true if it used the event
+//
+typedef bool (*MODE_BUTTON_HANDLER)(byte buttonIdx, byte event);
+MODE_BUTTON_HANDLER modeButtonHandler;
+
+//
+// the coroutines that run the modes, each mode has up to two that take turns.  They start over
+// each time a mode is started.
+//
+COROUTINE modeTaskCoroutine;
+COROUTINE modeCoroutine;
+COROUTINE modeSecondCoroutine;
+
+//
+// the Up or Down button event waiting for CO_AWAIT_BUTTON, BUTTON_NO_EVENT if none
+//
+byte modeButtonIdx;
+byte modeButtonEvent;
+
+//
+// The background process must finish within its 10ms tick.  It enables interrupts so the
+// tachometers and ultrasonics aren't held off, which means a pass that runs long would be
+// interrupted by the next tick and run inside itself.  Instead a tick that comes while a pass
+// is still running is skipped and counted.  The time of each pass is measured with Timer3
+// itself (4us per count), a pass that ends after the next tick was due is counted as late,
+// and the longest pass is kept.
+//
+const unsigned int BACKGROUND_TICK_COUNTS = 2500;      // Timer3 counts in each 10ms tick
+
+//
+// global variables used to monitor the background process, they are only written by the ISR
+//
+volatile bool backgroundRunningFlg;
+volatile unsigned int backgroundTickCount;             // ticks, including those skipped
+volatile unsigned int backgroundSkippedTickCount;      // ticks skipped as the last pass was still running
+volatile unsigned int backgroundOverrunCount;          // passes that ended after the next tick was due
+volatile unsigned int backgroundWorstCaseCounts;       // longest pass in Timer3 counts
 
 //
 // main architecture function prototypes
 //
-void executeTasks();
+void tasksInitialize();
+void modeButtonsTask();
+void modeTask();
 void setSculptureMode(int mode);
+void displayModeName(int mode);
+void showMeterStickMode();
+void meterStickDisplayCoroutine(COROUTINE *co);
+void meterStickCalibrateCoroutine(COROUTINE *co);
 void showSetContrastMode();
+void setContrastBlinkCoroutine(COROUTINE *co);
+void setContrastButtonsCoroutine(COROUTINE *co);
+void stopSetContrastMode();
+void setContrastAdjust(byte buttonIdx);
 void showSetTimeMode();
-void showStoppedMode();
-void stopBetweenModes();
+void setTimeAdjust(byte buttonIdx, byte event);
+void showDiagnosticsMode();
+void diagnosticsPagesCoroutine(COROUTINE *co);
+void diagnosticsButtonsCoroutine(COROUTINE *co);
+void diagnosticsShowPage(byte page);
+void diagnosticsDrawBarGraph(unsigned long *values, byte count, byte barWidth);
+void showMode(int mode);
+void stopMode(int mode);
+bool modeMovesDisks(int mode);
+bool modePlaysShow(int mode);
+bool modeCoroutineButtonHandler(byte buttonIdx, byte event);
 void backgroundProcessingInitialize();
+void backgroundRecordPassTime(unsigned int startTick, unsigned int startCount);
+unsigned long backgroundCountsToMicroseconds(unsigned int counts);
+void backgroundSerialDump();
+
+//
+// the show modes, found in Extravaganza.h and Play.h
+//
+void showActionMode();
+void showLightsMode();
+void stopExtravaganzaProgram();
+void showPlayMode();
+
+//
+// the checkpoint of the mode and show, found in Checkpoint.h
+//
+void checkpointTask();
+
+//
+// the serial command console, found in Console.h
+//
+void consoleTask();
 
 
 
 // ---------------------------------------------------------------------------------
-//                             Execute Tasks and Set Mode
+//                                 Tasks and Set Mode
 // ---------------------------------------------------------------------------------
 
 //
-// execute other tasks while waiting for the current motion to complete
+// add the tasks run by the scheduler in the main loop.  The mode task runs every 10ms for the
+// modes that do something over time, and right away for a button, a new distance or the end of
+// a transition, so a mode never has to wait for the next pass.  The console looks for commands
+// every 2ms, before the serial port's receive buffer can fill.
+//
+// A button event is taken by the buttons task on the next pass, so it waits at most for the
+// rest of the pass it was queued in.  No task waits long on the hardware: the clock's RTC read
+// and each checkpoint write of no more than 8 bytes take about 1ms on the 100KHz I2C bus, the
+// analytics only start an EEPROM write once the last has finished, and the telemetry only sends
+// what fits in the serial port's buffer.  With the LCD drawing done by the mode task, a pass in
+// which every task runs takes about 5ms.  A console reply longer than the serial port's 64 byte
+// transmit buffer is the exception, it waits for the buffer to drain.  The BUTTON DELAY region
+// of the profiler measures the wait on the sculpture.
+//
+void tasksInitialize()
+{
+  schedulerInitialize();
+  modeRunning = NO_MODE;
+  modeDisplayReadyFlg = false;
+  CO_RESTART(&modeTaskCoroutine);
+  modeButtonEvent = BUTTON_NO_EVENT;
+
+  schedulerAddTask(modeButtonsTask, 0, SCHEDULER_EVENT_BUTTON);
+  schedulerAddTask(modeTask, 10, SCHEDULER_EVENT_BUTTON | SCHEDULER_EVENT_DISTANCE | SCHEDULER_EVENT_MOTION);
+  schedulerAddTask(analyticsUpdate, 1000, SCHEDULER_EVENT_DISTANCE);
+  schedulerAddTask(displayTimeOnLCD, 400, 0);
+  schedulerAddTask(checkpointTask, 250, SCHEDULER_EVENT_MOTION);
+  schedulerAddTask(telemetryTask, 2, SCHEDULER_EVENT_TELEMETRY);
+  schedulerAddTask(consoleTask, 2, 0);
+}
+
+
+
+//
+// handle the button events queued by the background interrupt, each is first offered to the
+// current mode, if the mode doesn't use it the button selects a new mode
 //
-void executeTasks()
+void modeButtonsTask()
 {
+  byte buttonIdx;
   byte event;
+  int startingSculptureMode;
   int newSculptureMode;
   
-  //
-  // check if the Mode button has been press indicating the mode has changed
-  //
-  event = checkButton(PUSH_BUTTON_MODE);
-  if (event == BUTTON_PUSHED)
-  { 
-    if (sculptureMode == actionMode) sculptureMode = lightMode; // don't transition into lightsMode
+#if PROFILER_ENABLED
+  if (buttonsEventWaiting())
+    PROFILE_END(profileButtonDelay);
+#endif
+
+  startingSculptureMode = sculptureMode;
+  while (buttonsGetEvent(&buttonIdx, &event))
+  {
+    if ((modeButtonHandler != NULL) && modeButtonHandler(buttonIdx, event))
+      continue;
+
+    if (event != BUTTON_PUSHED)
+      continue;
+
+    switch(buttonIdx)
+    {
+      //
+      // the Mode button steps to the next mode
+      //
+      case PUSH_BUTTON_MODE:
+        if (sculptureMode == actionMode) sculptureMode = lightMode; // don't transition into lightsMode
     
-    newSculptureMode = sculptureMode + 1;
-    if (newSculptureMode >= stoppedMode)
-      newSculptureMode = playMode;
+        newSculptureMode = sculptureMode + 1;
+        if (newSculptureMode >= stoppedMode)
+          newSculptureMode = playMode;
       
-    setSculptureMode(newSculptureMode);
-  }
+        setSculptureMode(newSculptureMode);
+        break;
 
-  //
-  // check if the Mode button has been press indicating the mode has changed
-  //
-  event = checkButton(PUSH_BUTTON_UP);
-  if (event == BUTTON_PUSHED)
-  { 
-    newSculptureMode = actionMode;
-      
-    setSculptureMode(newSculptureMode);
-  }
+      //
+      // the Up button and remote A button select the Action mode
+      //
+      case PUSH_BUTTON_UP:
+      case REMOTE_BUTTON_A:
+        setSculptureMode(actionMode);
+        break;
 
-  //
-  // check if the Mode button has been press indicating the mode has changed
-  //
-  event = checkButton(PUSH_BUTTON_DOWN);
-  if (event == BUTTON_PUSHED)
-  { 
-    newSculptureMode = lightMode;
-      
-    setSculptureMode(newSculptureMode);
+      //
+      // the Down button and remote B button select the Light Show mode
+      //
+      case PUSH_BUTTON_DOWN:
+      case REMOTE_BUTTON_B:
+        setSculptureMode(lightMode);
+        break;
+
+      //
+      // the remote C button selects the Play mode
+      //
+      case REMOTE_BUTTON_C:
+        setSculptureMode(playMode);
+        break;
+
+      case REMOTE_BUTTON_D:
+        setSculptureMode(stoppedMode);
+        break;
+    }
+
+    //
+    // leave the remaining events for the new mode's button handler, they were queued before
+    // this pass so wake this task again on the next pass to hand them over
+    //
+    if (sculptureMode != startingSculptureMode)
+    {
+      if (buttonsEventWaiting())
+        schedulerRaiseEvent(SCHEDULER_EVENT_BUTTON);
+      break;
+    }
   }
-  
-  //
-  // check if the remote A button has been pressed: Action mode
-  //
-  event = checkButton(REMOTE_BUTTON_A);
-  if (event == BUTTON_PUSHED)
-     setSculptureMode(actionMode);
-  
-  
-  //
-  // check if the remote B button has been pressed: Light Show mode
-  //
-  event = checkButton(REMOTE_BUTTON_B);
-  if (event == BUTTON_PUSHED)
-     setSculptureMode(lightMode);
-  
-  
-  //
-  // check if the remote C button has been pressed: Play mode
-  //
-  event = checkButton(REMOTE_BUTTON_C);
-  if (event == BUTTON_PUSHED)
-    setSculptureMode(playMode);
+}
 
-  //
-  //
-  event = checkButton(REMOTE_BUTTON_D);
-  if (event == BUTTON_PUSHED)
-    setSculptureMode(stoppedMode);
-    
-  //
-  // periodically update the time shown on the LCD
-  //
-  if(timeDisplayCount == 0)
+
+
+//
+// run the current mode, starting it from the top of its coroutines.  When the mode is changed
+// the old mode is stopped.  Changing from one show mode to another hands the disk velocities and
+// backlight color straight to the new mode, its first transition starts from them.  Only a
+// mode that doesn't move the disks waits for them to stop first.  This returns at each step, it
+// is run again for the next.
+//
+void modeTask()
+{
+  CO_BEGIN(&modeTaskCoroutine);
+  while (true)
   {
-    displayTimeOnLCD(); 
-    timeDisplayCount = 20;
-  } 
-  timeDisplayCount--;  
-  
-  
-  //
-  // delay a bit before checking for next event
-  //
-  delay(20);
+    //
+    // at power up the show modes are started before the LCD is set up, so their first steps are
+    // queued straight away, the other modes draw on the LCD or read the analytics from the start
+    //
+    CO_AWAIT(&modeTaskCoroutine, modeDisplayReadyFlg || modePlaysShow(sculptureMode));
+
+    modeRunning = sculptureMode;
+    TRACE(traceModeChange, modeRunning, 0, 0);
+    CO_RESTART(&modeCoroutine);
+    CO_RESTART(&modeSecondCoroutine);
+
+    //
+    // run the mode until it is changed
+    //
+    while (sculptureMode == modeRunning)
+    {
+      showMode(modeRunning);
+      CO_YIELD(&modeTaskCoroutine);
+    }
+
+    //
+    // stop the mode
+    //
+    stopMode(modeRunning);
+    if (modeMovesDisks(modeRunning) && !modeMovesDisks(sculptureMode))
+    {
+      modeRunning = NO_MODE;
+      diskVelocitiesStartTransition(0, 0, 500);
+      backlightRetargetTransition(0, 0, 0, 500);
+
+      //
+      // a show mode picked while stopping carries on from where the stop has got to
+      //
+      CO_AWAIT(&modeTaskCoroutine, (diskVelocitiesTransitionIsFinished() && backlightTransitionIsFinished()) ||
+        modeMovesDisks(sculptureMode));
+
+      if (!modeMovesDisks(sculptureMode))
+        motorZeroIntegralTerms();
+    }
+  }
+  CO_END(&modeTaskCoroutine);
 }
 
 
@@ -144,8 +308,6 @@ void executeTasks()
 //
 void setSculptureMode(int mode)
 {
-  char *s;
-
   //
   // check if already in the desired mode
   //
@@ -153,13 +315,25 @@ void setSculptureMode(int mode)
     return;
     
   //
-  // set the new mode
+  // set the new mode, the mode task starts it and it installs its own button handler
   //
   sculptureMode = mode;
-  
-  //
-  // display the mode name on the LCD
-  //
+  modeButtonHandler = NULL;
+  modeButtonEvent = BUTTON_NO_EVENT;
+  displayModeName(mode);
+}
+
+
+
+//
+// display the sculpture's name and the mode name on the LCD, blanking the lines used by the
+// modes
+//  Enter: mode = mode to display
+//
+void displayModeName(int mode)
+{
+  char *s;
+
   switch(mode)
   {
     case actionMode:
@@ -187,6 +361,10 @@ void setSculptureMode(int mode)
     case setTimeMode:
       s = "SET TIME";
       break;
+
+    case diagnosticsMode:
+      s = "DIAGNOSTICS";
+      break;
             
     default:
       s = "??????";
@@ -206,6 +384,7 @@ void setSculptureMode(int mode)
   //
   // blank the LCD lines used by the modes
   //
+  LCDPrintCenteredString(" ", 1);
   LCDPrintCenteredString(" ", 3);
   LCDPrintCenteredString(" ", 4);
 }
@@ -216,84 +395,112 @@ void setSculptureMode(int mode)
 // ---------------------------------------------------------------------------------
 
 //
-// run the Meter Stick mode, return when no longer in this mode
+// echo counts measured with the near calibration target, 0 if not measured yet
+//
+unsigned long meterStickNearEchoCounts;
+
+
+
+//
+// run the Meter Stick mode, showing each distance as it is measured while waiting for the
+// buttons that calibrate the sensor
 //
 void showMeterStickMode()
+{
+  meterStickDisplayCoroutine(&modeCoroutine);
+  meterStickCalibrateCoroutine(&modeSecondCoroutine);
+}
+
+
+
+//
+// show the distance, the distance is measured in the background, display each new one as it
+// arrives
+//  Enter: co -> coroutine state
+//
+void meterStickDisplayCoroutine(COROUTINE *co)
 {
   int distance;
-  unsigned long nextEventTime;
-  bool waitingForEcho;
   int barGraphLength;
   const int BAR_GRAPH_WIDTH = 84;
-  const int MAX_BAR_GRAPH_CM = 300;
+  const int MAX_BAR_GRAPH_MM = 3000;
 
-  //
-  // initialize timer
-  //
-  nextEventTime =  millis() + 120;
-  waitingForEcho = false;
+  CO_BEGIN(co);
+  while (true)
+  {
+    CO_AWAIT_DISTANCE(co);
 
-  //
-  // loop to run this mode until the mode is changed with a button press
-  //
-  while(true)
-  { 
     //
-    // check if time to start an ultrasonic measurement
+    // measurement complete, display results
     //
-    if (millis() >= nextEventTime)
-    {  
-      ultrasonicStartMeasurement();
-      nextEventTime =  millis() + 100;
-      waitingForEcho = true;
-    }
+    distance = ultrasonicGetFilteredDistanceInMM();
+    LCDSetCursorXY(20, 4);
+    LCDPrintUnsignedIntWithPadding(distance, 4, ' ');
+    LCDPrintString("MM");
+      
+    //
+    // draw a bar graph showing the distance
+    //
+    barGraphLength = ((long) distance * BAR_GRAPH_WIDTH) / MAX_BAR_GRAPH_MM;
+
+    if (barGraphLength > BAR_GRAPH_WIDTH) 
+      barGraphLength = 84;
+
+    if (barGraphLength < 1) 
+      barGraphLength = 1;
+      
+    LCDDrawRowOfPixels(0, barGraphLength-1, 3, 0x3c);
+      
+    if (barGraphLength < BAR_GRAPH_WIDTH)
+      LCDDrawRowOfPixels(barGraphLength, BAR_GRAPH_WIDTH-1, 3, 0x0);
+  }
+  CO_END(co);
+}
+
+
+
+//
+// calibrate the sensor: with a target ULTRASONIC_CALIBRATION_NEAR_MM away press Up, then with a
+// target ULTRASONIC_CALIBRATION_FAR_MM away press Down
+//  Enter: co -> coroutine state
+//
+void meterStickCalibrateCoroutine(COROUTINE *co)
+{
+  byte buttonIdx;
+  byte event;
+
+  CO_BEGIN(co);
+  meterStickNearEchoCounts = 0;
+  modeButtonHandler = modeCoroutineButtonHandler;
+
+  while (true)
+  {
+    CO_AWAIT_BUTTON(co, buttonIdx, event);
+    if (event != BUTTON_PUSHED)
+      continue;
 
     //
-    // check if a new measurement is complete
+    // the UP button measures the near calibration target
     //
-    if (waitingForEcho)
+    if (buttonIdx == PUSH_BUTTON_UP)
     {
-      if (ultrasonicIsFinished())
-      {
-        //
-        // measurement complete, display results
-        //
-        distance = ultrasonicGetDistanceInCM();
-        LCDSetCursorXY(26, 4);
-        LCDPrintUnsignedIntWithPadding(distance, 3, ' ');
-        LCDPrintString("CM");
-        
-        //
-        // draw a bar graph showing the distance
-        //
-        barGraphLength = (distance * BAR_GRAPH_WIDTH) / MAX_BAR_GRAPH_CM;
-
-        if (barGraphLength > BAR_GRAPH_WIDTH) 
-          barGraphLength = 84;
-
-        if (barGraphLength < 1) 
-          barGraphLength = 1;
-        
-        LCDDrawRowOfPixels(0, barGraphLength-1, 3, 0x3c);
-        
-        if (barGraphLength < BAR_GRAPH_WIDTH)
-        LCDDrawRowOfPixels(barGraphLength, BAR_GRAPH_WIDTH-1, 3, 0x0);
-
-        waitingForEcho = false;
-      }
+      meterStickNearEchoCounts = ultrasonicGetFilteredEchoCounts();
+      LCDPrintCenteredString("NEAR SET", 1);
     }
-    
-    //
-    // check for button presses and update the clock
-    // 
-    executeTasks();
 
     //
-    // return if no longer in this mode
+    // the DOWN button measures the far calibration target and calibrates
     //
-    if (sculptureMode != meterStickMode)
-      return;
+    else
+    {
+      if (ultrasonicCalibrate(meterStickNearEchoCounts, ultrasonicGetFilteredEchoCounts()))
+        LCDPrintCenteredString("CALIBRATED", 1);
+      else
+        LCDPrintCenteredString("CAL FAILED", 1);
+      meterStickNearEchoCounts = 0;
+    }
   }
+  CO_END(co);
 }
 
 
@@ -302,105 +509,102 @@ void showMeterStickMode()
 // ---------------------------------------------------------------------------------
 
 //
-// run the Set LCD Contrast mode, return when no longer in this mode
+// run the Set LCD Contrast mode, blinking the LED while waiting for the buttons
 //
 void showSetContrastMode()
 {
+  setContrastBlinkCoroutine(&modeCoroutine);
+  setContrastButtonsCoroutine(&modeSecondCoroutine);
+}
+
+
+
+//
+// blink the LED showing that in the "set contrast" mode, in the case where the LCD can not be
+// seen
+//  Enter: co -> coroutine state
+//
+void setContrastBlinkCoroutine(COROUTINE *co)
+{
+  CO_BEGIN(co);
+  while (true)
+  {
+    digitalWrite(LED_PIN, HIGH);
+    CO_AWAIT_MS(co, 1500);
+    digitalWrite(LED_PIN, LOW);
+    CO_AWAIT_MS(co, 1500);
+  }
+  CO_END(co);
+}
+
+
+
+//
+// adjust the contrast value with each press of the Up and Down buttons
+//  Enter: co -> coroutine state
+//
+void setContrastButtonsCoroutine(COROUTINE *co)
+{
+  byte buttonIdx;
   byte event;
-  int contrastValue;
-  unsigned long startTime;
+
+  CO_BEGIN(co);
 
   //
   // initially draw the contrast display
   //
   updateContrastModeDisplay();
+  modeButtonHandler = modeCoroutineButtonHandler;
 
-  //
-  // turn on the LED so we know we're in the contrast setting mode
-  //   in the case where the LCD can not been seen
-  //
-  digitalWrite(LED_PIN, HIGH);
-  startTime =  millis();
-
-  //
-  // loop to run this mode until the mode is changed with a button press
-  //
-  while(true)
-  { 
-    //
-    // check for the UP button and adjust the contract value with each press
-    //
-    event = checkButton(PUSH_BUTTON_UP);
+  while (true)
+  {
+    CO_AWAIT_BUTTON(co, buttonIdx, event);
     if ((event == BUTTON_PUSHED) || (event == BUTTON_REPEAT))
-    {
-      //
-      // up button pressed, read the current value from EEPROM and add 1 to it
-      //
-      contrastValue = getContrastByteFromEEPROM();
-      contrastValue++;
-      
-      if (contrastValue >= 127)
-        contrastValue = 127;
+      setContrastAdjust(buttonIdx);
+  }
+  CO_END(co);
+}
 
-      //
-      // save the value in EEPROM, update the LCD contrast value and update the bar graph
-      //
-      EEPROM.write(EEPROM_CONTRAST_BYTE_ADDRESS, contrastValue);
-      LCDSetContrast(contrastValue);
-      updateContrastModeDisplay();
-    }
-    
-    
-    //
-    // check for the DOWN button and adjust the contract value with each press
-    //
-    event = checkButton(PUSH_BUTTON_DOWN);
-    if ((event == BUTTON_PUSHED) || (event == BUTTON_REPEAT))
-    {
-      //
-      // down button pressed, read the current value from EEPROM and subtract 1 from it
-      //
-      contrastValue = getContrastByteFromEEPROM();
-      contrastValue--;
-      
-      if (contrastValue < 0)
-        contrastValue = 0;
 
-      //
-      // save the value in EEPROM, update the LCD contrast value and update the bar graph
-      //
-      EEPROM.write(EEPROM_CONTRAST_BYTE_ADDRESS, contrastValue);
-      LCDSetContrast(contrastValue);
-      updateContrastModeDisplay();
-    }   
-    
-    
-    //
-    // blink the LED showing that in the "set contrast" mode
-    //
-    if ((millis() - startTime) < 1500)
-      digitalWrite(LED_PIN, HIGH);
-    else
-      digitalWrite(LED_PIN, LOW);
+
+//
+// stop the Set LCD Contrast mode
+//
+void stopSetContrastMode()
+{
+  digitalWrite(LED_PIN, LOW);        // turn off LED
+}
+
+
+
+//
+// adjust the contrast value
+//  Enter: buttonIdx = PUSH_BUTTON_UP to add 1 to it, PUSH_BUTTON_DOWN to subtract 1
+//
+void setContrastAdjust(byte buttonIdx)
+{
+  int contrastValue;
+
+  //
+  // read the current value from EEPROM, up adds 1 to it and down subtracts 1
+  //
+  contrastValue = getContrastByteFromEEPROM();
+  if (buttonIdx == PUSH_BUTTON_UP)
+    contrastValue++;
+  else
+    contrastValue--;
       
-    if ((millis() - startTime) > 3000)
-      startTime = millis();
-    
-    
-    //
-    // check for button presses and update the clock
-    // 
-    executeTasks();
+  if (contrastValue >= 127)
+    contrastValue = 127;
+  if (contrastValue < 0)
+    contrastValue = 0;
 
-    //
-    // return if no longer in this mode
-    //
-    if (sculptureMode != setContrastMode)
-    {
-      digitalWrite(LED_PIN, LOW);        // turn off LED and return
-      return;
-    }
-  }
+  //
+  // save the value in EEPROM, update the LCD contrast value and update the bar graph
+  //
+  EEPROM.write(EEPROM_CONTRAST_BYTE_ADDRESS, contrastValue);
+  LCDSetContrast(contrastValue);
+  updateContrastModeDisplay();
 }
 
 
@@ -409,113 +613,315 @@ void showSetContrastMode()
 // ---------------------------------------------------------------------------------
 
 //
-// run the Set Time mode, return when no longer in this mode
+// amount the time changes with each Up or Down repeat, it grows as a button is held
+//
+int setTimeIncrement;
+int setTimeRepeatCount;
+
+
+
+//
+// run the Set Time mode, the buttons do all the work
 //
 void showSetTimeMode()
 {
+  COROUTINE *co = &modeCoroutine;
+  byte buttonIdx;
   byte event;
-  int timeIncrement;
-  int repeatCount;
-  
+
+  CO_BEGIN(co);
+
   //
   // display help info on the LCD
   //
   LCDPrintCenteredString("Use Up & Down", 3);
   LCDPrintCenteredString("buttons.", 4);
+  modeButtonHandler = modeCoroutineButtonHandler;
 
+  while (true)
+  {
+    CO_AWAIT_BUTTON(co, buttonIdx, event);
+    setTimeAdjust(buttonIdx, event);
+  }
+  CO_END(co);
+}
 
+
+
+//
+// change the time with the Up and Down buttons, holding a button down changes the time faster
+// the longer it is held
+//  Enter: buttonIdx = PUSH_BUTTON_UP to advance the time, PUSH_BUTTON_DOWN to reverse it
+//         event = button event
+//
+void setTimeAdjust(byte buttonIdx, byte event)
+{
   //
-  // loop to run this mode until the mode is changed with a button press
+  // check for a Pressed event
   //
-  while(true)
-  { 
-    //
-    // check for a UP button Pressed event
-    //
-    event = checkButton(PUSH_BUTTON_UP);
-    if (event == BUTTON_PUSHED)
-    {
-      timeIncrement = 1;
-      repeatCount = 0;
-      advanceRTCTime(timeIncrement);
-    }
+  if (event == BUTTON_PUSHED)
+  {
+    setTimeIncrement = 1;
+    setTimeRepeatCount = 0;
+  }
 
-    //
-    // check for a UP button Repeat event
-    //
-    if (event == BUTTON_REPEAT)
+  //
+  // check for a Repeat event
+  //
+  else if (event == BUTTON_REPEAT)
+  {
+    setTimeRepeatCount++;
+    if (setTimeRepeatCount == 15)
+      setTimeIncrement = 5;
+    if (setTimeRepeatCount == 30)
+      setTimeIncrement = 10;
+  }
+
+  else
+    return;
+
+  if (buttonIdx == PUSH_BUTTON_UP)
+    advanceRTCTime(setTimeIncrement);
+  else
+    reverseRTCTime(setTimeIncrement);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                The Diagnostics Mode
+// ---------------------------------------------------------------------------------
+
+//
+// diagnostics pages, Up and Down step through them.  Set DIAGNOSTICS_AUTO_PAGE to true to have
+// them also step on their own after a while, such as for a sculpture left in the Diagnostics
+// mode on a bench.
+//
+#define DIAGNOSTICS_AUTO_PAGE false
+
+enum DiagnosticsPages {diagnosticsVisitorsPage, diagnosticsDistancePage, diagnosticsHourlyPage, diagnosticsTimingPage,
+#if PROFILER_ENABLED
+                       diagnosticsProfilePage,
+#endif
+#if TRACE_ENABLED
+                       diagnosticsTracePage,
+#endif
+                       diagnosticsPageCount};
+
+const unsigned int DIAGNOSTICS_PAGE_MS = 5000;          // time each page is shown with DIAGNOSTICS_AUTO_PAGE
+const byte DIAGNOSTICS_WIPE_STEP = 12;                   // columns cleared with each step of the wipe
+const byte DIAGNOSTICS_WIPE_STEP_MS = 30;
+
+//
+// page being shown, and where the wipe to the next page is
+//
+byte diagnosticsPage;
+byte diagnosticsWipeColumn;
+
+//
+// the profile page shows the next region each time it is shown
+//
+byte diagnosticsProfileRegion;
+
+#if TRACE_ENABLED
+//
+// names of the faults that freeze the trace, by TraceFaults
+//
+const char *DiagnosticsFaultNames[] = {"NO FAULT", "STALL", "JERK", "LATE PASS"};
+#endif
+
+
+
+//
+// run the Diagnostics mode.  The audience statistics are shown on the LCD and written to the
+// serial port when the mode is entered.
+//
+void showDiagnosticsMode()
+{
+  diagnosticsButtonsCoroutine(&modeSecondCoroutine);
+  diagnosticsPagesCoroutine(&modeCoroutine);
+}
+
+
+
+//
+// show the page selected with the buttons, which restart this coroutine when they change it.
+// With DIAGNOSTICS_AUTO_PAGE the pages are also shown in turn, each wiped away before the next.
+//  Enter: co -> coroutine state
+//
+void diagnosticsPagesCoroutine(COROUTINE *co)
+{
+  CO_BEGIN(co);
+  while (true)
+  {
+    diagnosticsShowPage(diagnosticsPage);
+#if DIAGNOSTICS_AUTO_PAGE
+    CO_AWAIT_MS(co, DIAGNOSTICS_PAGE_MS);
+
+    for (diagnosticsWipeColumn = 0; diagnosticsWipeColumn < 84; diagnosticsWipeColumn += DIAGNOSTICS_WIPE_STEP)
     {
-      repeatCount++;
-      if (repeatCount == 15)
-        timeIncrement = 5;
-      if (repeatCount == 30)
-        timeIncrement = 10;
-      advanceRTCTime(timeIncrement);     
+      LCDDrawRowOfPixels(diagnosticsWipeColumn, diagnosticsWipeColumn + DIAGNOSTICS_WIPE_STEP - 1, 3, 0);
+      LCDDrawRowOfPixels(diagnosticsWipeColumn, diagnosticsWipeColumn + DIAGNOSTICS_WIPE_STEP - 1, 4, 0);
+      CO_AWAIT_MS(co, DIAGNOSTICS_WIPE_STEP_MS);
     }
-        
-    //
-    // check for a DOWN button Pressed event
-    //
-    event = checkButton(PUSH_BUTTON_DOWN);
-    if (event == BUTTON_PUSHED)
-    {
-      timeIncrement = 1;
-      repeatCount = 0;
-      reverseRTCTime(timeIncrement);
-    }  
-    
-    //
-    // check for a DOWN button Repeat event
-    //
-    if (event == BUTTON_REPEAT)
-    {
-      repeatCount++;
-      if (repeatCount == 15)
-        timeIncrement = 5;
-      if (repeatCount == 30)
-        timeIncrement = 10;
-      reverseRTCTime(timeIncrement);
-    }   
-    
-    
-    //
-    // check for other buttons presses and update the clock display
-    // 
-    executeTasks();
 
-    //
-    // return if no longer in this mode
-    //
-    if (sculptureMode != setTimeMode)
-      return;
+    diagnosticsPage = (diagnosticsPage + 1) % diagnosticsPageCount;
+#else
+    CO_AWAIT(co, false);
+#endif
   }
+  CO_END(co);
 }
 
 
-// ---------------------------------------------------------------------------------
-//                                  The Stopped Mode
-// ---------------------------------------------------------------------------------
 
 //
-// run the Stopped mode, return when no longer in this mode
+// step through the pages with the Up and Down buttons, the new page is shown right away
+//  Enter: co -> coroutine state
 //
-void showStoppedMode()
+void diagnosticsButtonsCoroutine(COROUTINE *co)
 {
-  //
-  // loop to run this mode until the mode is changed with a button press
-  //
-  while(true)
-  { 
-    //
-    // check for button presses and update the clock
-    // 
-    executeTasks();
+  byte buttonIdx;
+  byte event;
+
+  CO_BEGIN(co);
+  diagnosticsPage = diagnosticsVisitorsPage;
+  analyticsSerialDump();
+  backgroundSerialDump();
+#if PROFILER_ENABLED
+  profileSerialDump();
+#endif
+#if TRACE_ENABLED
+  traceSerialDump();
+#endif
+  modeButtonHandler = modeCoroutineButtonHandler;
+
+  while (true)
+  {
+    CO_AWAIT_BUTTON(co, buttonIdx, event);
+    if (event != BUTTON_PUSHED)
+      continue;
+
+    if (buttonIdx == PUSH_BUTTON_UP)
+      diagnosticsPage = (diagnosticsPage + 1) % diagnosticsPageCount;
+    else
+      diagnosticsPage = (diagnosticsPage + diagnosticsPageCount - 1) % diagnosticsPageCount;
+    CO_RESTART(&modeCoroutine);
+  }
+  CO_END(co);
+}
+
+
+
+//
+// show a page of diagnostics on LCD lines 1, 3 and 4
+//  Enter: page = page to show
+//
+void diagnosticsShowPage(byte page)
+{
+  unsigned long values[24];
+#if PROFILER_ENABLED
+  PROFILE_REGION stats;
+#endif
+
+  LCDPrintCenteredString(" ", 1);
+  LCDPrintCenteredString(" ", 3);
+  LCDPrintCenteredString(" ", 4);
+
+  switch(page)
+  {
+    case diagnosticsVisitorsPage:
+      LCDPrintCenteredString("VISITORS", 1);
+      LCDSetCursorXY(0, 3);
+      LCDPrintString("COUNT ");
+      LCDPrintUnsignedInt(analytics.visitorCount);
+      LCDSetCursorXY(0, 4);
+      LCDPrintString("AVG S ");
+      if (analytics.visitorCount != 0)
+        LCDPrintUnsignedInt(analytics.dwellTimeSeconds / analytics.visitorCount);
+      else
+        LCDPrintUnsignedInt(0);
+      break;
+
+    case diagnosticsDistancePage:
+      LCDPrintCenteredString("DISTANCES", 1);
+      for (byte i = 0; i < ANALYTICS_HISTOGRAM_BINS; i++)
+        values[i] = analytics.distanceHistogram[i];
+      diagnosticsDrawBarGraph(values, ANALYTICS_HISTOGRAM_BINS, 7);
+      break;
+
+    case diagnosticsHourlyPage:
+      LCDPrintCenteredString("BY HOUR", 1);
+      for (byte i = 0; i < 24; i++)
+        values[i] = analytics.hourlyEngagementSeconds[i];
+      diagnosticsDrawBarGraph(values, 24, 3);
+      break;
+
+    case diagnosticsTimingPage:
+      LCDPrintCenteredString("ISR TIMING", 1);
+      LCDSetCursorXY(0, 3);
+      LCDPrintString("WORST US ");
+      LCDPrintUnsignedInt(min(backgroundCountsToMicroseconds(backgroundWorstCaseCounts), 65535UL));
+      LCDSetCursorXY(0, 4);
+      LCDPrintString("LATE ");
+      LCDPrintUnsignedInt(backgroundOverrunCount);
+      LCDPrintString(" SKIP ");
+      LCDPrintUnsignedInt(backgroundSkippedTickCount);
+      break;
+
+#if PROFILER_ENABLED
+    case diagnosticsProfilePage:
+      profileGetRegion(diagnosticsProfileRegion, &stats);
+      LCDPrintCenteredString((char *) ProfileRegionNames[diagnosticsProfileRegion], 1);
+      LCDSetCursorXY(0, 3);
+      LCDPrintString("AVG US ");
+      if (stats.sampleCount != 0)
+        LCDPrintUnsignedInt(profileCountsToMicroseconds(stats.totalCounts / stats.sampleCount));
+      else
+        LCDPrintUnsignedInt(0);
+      LCDSetCursorXY(0, 4);
+      LCDPrintString("MAX US ");
+      LCDPrintUnsignedInt(profileCountsToMicroseconds(stats.maxCounts));
+      diagnosticsProfileRegion = (diagnosticsProfileRegion + 1) % profileRegionCount;
+      break;
+#endif
+
+#if TRACE_ENABLED
+    case diagnosticsTracePage:
+      LCDPrintCenteredString("TRACE", 1);
+      LCDPrintCenteredString((char *) (traceIsFrozen() ? "FROZEN" : "RUNNING"), 3);
+      LCDPrintCenteredString((char *) DiagnosticsFaultNames[traceGetFault()], 4);
+      break;
+#endif
+  }
+}
+
+
+
+//
+// draw a bar graph on LCD lines 3 and 4, scaled so the largest value fills the 16 pixel height
+//  Enter: values -> values to graph
+//         count = number of values
+//         barWidth = width of each bar in pixels, including a 1 pixel gap
+//
+void diagnosticsDrawBarGraph(unsigned long *values, byte count, byte barWidth)
+{
+  unsigned long largest;
+  byte height;
+  int x;
 
+  largest = 1;
+  for (byte i = 0; i < count; i++)
+    largest = max(largest, values[i]);
+
+  for (byte i = 0; i < count; i++)
+  {
     //
-    // return if no longer in this mode
+    // bars grow up from the bottom of line 4, the top pixel of a line is bit 0
     //
-    if (sculptureMode != stoppedMode)
-      return;
+    height = (values[i] * 16 + largest - 1) / largest;
+    x = i * barWidth;
+    LCDDrawRowOfPixels(x, x + barWidth - 2, 3, height > 8 ? (0xff << (16 - height)) & 0xff : 0);
+    LCDDrawRowOfPixels(x, x + barWidth - 2, 4, height >= 8 ? 0xff : (0xff << (8 - height)) & 0xff);
   }
 }
 
@@ -525,17 +931,113 @@ void showStoppedMode()
 // ---------------------------------------------------------------------------------
 
 //
-// transition the disks to a stopped discVelocities and the backlight to off
+// run a mode's coroutines until they wait, the Stopped mode does nothing
+//  Enter: mode = mode to run
 //
-void stopBetweenModes()
+void showMode(int mode)
 {
-  diskVelocitiesStartTransition(0, 0, 500);
-  backlightStartTransition(0, 0, 0, 500);
-  
-  while(diskVelocitiesTransitionIsFinished() == false)
-    executeTasks();
-    
-  motorZeroIntegralTerms();
+  switch(mode)
+  {
+    case actionMode:
+      showActionMode();
+      break;
+
+    case lightMode:
+      showLightsMode();
+      break;
+
+    case playMode:
+      showPlayMode();
+      break;
+
+    case meterStickMode:
+      showMeterStickMode();
+      break;
+
+    case setContrastMode:
+      showSetContrastMode();
+      break;
+
+    case setTimeMode:
+      showSetTimeMode();
+      break;
+
+    case diagnosticsMode:
+      showDiagnosticsMode();
+      break;
+  }
+}
+
+
+
+//
+// stop a mode
+//  Enter: mode = mode to stop
+//
+void stopMode(int mode)
+{
+  switch(mode)
+  {
+    case actionMode:
+    case lightMode:
+      stopExtravaganzaProgram();
+      break;
+
+    case setContrastMode:
+      stopSetContrastMode();
+      break;
+
+#if TRACE_ENABLED
+    case diagnosticsMode:
+      traceRearm();                             // the trace has been written out
+      break;
+#endif
+  }
+}
+
+
+
+//
+// check if a mode moves the disks or lights the backlight, they are stopped when changing from
+// it to a mode that doesn't
+//  Enter: mode = mode to check
+//  Exit:  true returned if the mode moves the disks
+//
+bool modeMovesDisks(int mode)
+{
+  return((mode == actionMode) || (mode == lightMode) || (mode == playMode));
+}
+
+
+
+//
+// check if a mode plays the show program, it only draws on the LCD once its steps are queued
+//  Enter: mode = mode to check
+//  Exit:  true returned if the mode plays the show
+//
+bool modePlaysShow(int mode)
+{
+  return((mode == actionMode) || (mode == lightMode));
+}
+
+
+
+//
+// button handler for modes that wait for the Up and Down buttons with CO_AWAIT_BUTTON, the
+// event is handed to the mode and the mode is run right away
+//  Enter: buttonIdx = button the event is from
+//         event = button event
+//  Exit:  true returned if the event was used
+//
+bool modeCoroutineButtonHandler(byte buttonIdx, byte event)
+{
+  if ((buttonIdx != PUSH_BUTTON_UP) && (buttonIdx != PUSH_BUTTON_DOWN))
+    return(false);
+
+  modeButtonIdx = buttonIdx;
+  modeButtonEvent = event;
+  showMode(modeRunning);
+  return(true);
 }
 
 
@@ -570,13 +1072,39 @@ void backgroundProcessingInitialize()
 //
 ISR(TIMER3_COMPA_vect)
 {
+  unsigned int startTick;
+  unsigned int startCount;
+
+  //
+  // skip this tick if the last pass is still running, rather than running inside it
+  //
+  backgroundTickCount++;
+  if (backgroundRunningFlg)
+  {
+    backgroundSkippedTickCount++;
+    return;
+  }
+
+  backgroundRunningFlg = true;
+  startTick = backgroundTickCount;
+  startCount = TCNT3;
+  PROFILE_BEGIN(profileTimer3ISR);
+
   //
   // enable global interrupts so faster interrupts can happen while processing background tasks
   //
   sei(); 
 
-//digitalWrite(TEST_D9_PIN, HIGH);
 
+  //
+  // start the next queued motion segment as soon as the current one finishes
+  //
+  motionQueueExecute();
+
+  //
+  // scan the buttons, queuing their events for the main loop
+  //
+  buttonsScan();
 
   //
   // update the backlight LEDs as they transition from one color to the next
@@ -591,11 +1119,113 @@ ISR(TIMER3_COMPA_vect)
   //
   // undate the motor servos 
   //
+  PROFILE_BEGIN(profileMotorControl);
   motorProportionalIntegralControl1();
   motorProportionalIntegralControl2();
- 
-  
-//digitalWrite(TEST_D9_PIN, LOW);
+  PROFILE_END(profileMotorControl);
+#if TRACE_ENABLED
+  motorCheckForFaults();
+#endif
+
+  //
+  // make distance measurements in the background
+  //
+  ultrasonicBackgroundRanging();
+
+  //
+  // capture what the motors and backlight are doing for the telemetry
+  //
+  telemetryCapture();
+
+  PROFILE_END(profileTimer3ISR);
+
+  //
+  // interrupts stay off from here until the ISR returns, so the next tick can't start until
+  // this pass is finished
+  //
+  cli();
+  backgroundRecordPassTime(startTick, startCount);
+  backgroundRunningFlg = false;
+}
+
+
+
+//
+// record the time of a pass of the background process, called by the ISR with interrupts off
+//  Enter: startTick = backgroundTickCount when the pass started
+//         startCount = Timer3 count when the pass started
+//
+void backgroundRecordPassTime(unsigned int startTick, unsigned int startCount)
+{
+  unsigned int ticks;
+  unsigned int endCount;
+  unsigned long passCounts;
+
+  //
+  // count the ticks that have passed, including one that is due but not yet taken
+  //
+  endCount = TCNT3;
+  ticks = backgroundTickCount - startTick;
+  if (TIFR3 & (1 << OCF3A))
+  {
+    ticks++;
+    endCount = TCNT3;
+  }
+
+  passCounts = (unsigned long) ticks * BACKGROUND_TICK_COUNTS + endCount - startCount;
+  if (passCounts > 0xffff)
+    passCounts = 0xffff;
+
+  if (ticks != 0)
+  {
+    backgroundOverrunCount++;
+    TRACE_FAULT(traceFaultOverrun, ticks, passCounts);
+  }
+
+  if (passCounts > backgroundWorstCaseCounts)
+    backgroundWorstCaseCounts = passCounts;
+}
+
+
+
+//
+// convert Timer3 counts to microseconds
+//  Enter: counts = number of 4us counts
+//  Exit:  microseconds returned
+//
+unsigned long backgroundCountsToMicroseconds(unsigned int counts)
+{
+  return((unsigned long) counts * 4);
+}
+
+
+
+//
+// write the background process timing to the serial port
+//
+void backgroundSerialDump()
+{
+  unsigned int tickCount;
+  unsigned int skippedTickCount;
+  unsigned int overrunCount;
+  unsigned int worstCaseCounts;
+
+  cli();
+  tickCount = backgroundTickCount;
+  skippedTickCount = backgroundSkippedTickCount;
+  overrunCount = backgroundOverrunCount;
+  worstCaseCounts = backgroundWorstCaseCounts;
+  sei();
+
+  Serial.println(F("Background process (10ms budget):"));
+  Serial.print(F("Ticks: "));
+  Serial.println(tickCount);
+  Serial.print(F("Skipped ticks: "));
+  Serial.println(skippedTickCount);
+  Serial.print(F("Late passes: "));
+  Serial.println(overrunCount);
+  Serial.print(F("Worst case us: "));
+  Serial.println(backgroundCountsToMicroseconds(worstCaseCounts));
 }
 
 
@@ -17,6 +17,9 @@ typedef struct {
 void backlightInitialize(void);
 void backlightStartTransitionRGBColor(COLOR_ENTRY color, unsigned long transitionDurationMS);
 void backlightStartTransition(byte red, byte green, byte blue, unsigned long transitionDurationMS);
+void backlightStartTransitionAt(byte red, byte green, byte blue, unsigned long transitionDurationMS, unsigned long startTimeMS);
+void backlightRetargetTransition(byte red, byte green, byte blue, unsigned long transitionDurationMS);
+void backlightStartFromCurrentColor();
 bool backlightTransitionIsFinished();
 void backlightTransition();
 void backlightSetColor(byte red, byte green, byte blue);
@@ -46,6 +49,10 @@ unsigned long backlightTransitionStartTimeMS;
 unsigned long backlightTransitionFinishTimeMS;
 bool backlightTransitionCompleteFlg;
 
+byte backlightCurrentRed;                       // color last written to the LEDs
+byte backlightCurrentGreen;
+byte backlightCurrentBlue;
+
 
 // ---------------------------------------------------------------------------------
 
@@ -92,12 +99,60 @@ void backlightStartTransitionRGBColor(COLOR_ENTRY color, unsigned long transitio
 //
 void backlightStartTransition(byte red, byte green, byte blue, unsigned long transitionDurationMS)
 {
-  unsigned long startTimeMS;
-  unsigned long finishTimeMS;
+  backlightStartTransitionAt(red, green, blue, transitionDurationMS, millis());
+}
+
+
+
+//
+// start a transition of the backlight from the color showing now, rather than from where the
+// last transition was heading, so that a transition in progress can be changed smoothly
+//  Enter:  red = new value for red LED brightness (0 - 255)
+//          green = new value for green LED brightness (0 - 255)
+//          blue = new value for blue LED brightness (0 - 255)
+//          transitionDurationMS = number of milliseconds for the transition (1 - 60000)
+//
+void backlightRetargetTransition(byte red, byte green, byte blue, unsigned long transitionDurationMS)
+{
+  backlightStartFromCurrentColor();
+  backlightStartTransition(red, green, blue, transitionDurationMS);
+}
 
+
+
+//
+// stop the transition in progress, holding the color showing now, the next transition then
+// starts from this color
+//
+void backlightStartFromCurrentColor()
+{
+  //
+  // stop the transition in progress so the ISR leaves the current color alone
+  //
   backlightTransitionCompleteFlg = true;
 
-  startTimeMS = millis();
+  backlightNextRed = backlightCurrentRed;
+  backlightNextGreen = backlightCurrentGreen;
+  backlightNextBlue = backlightCurrentBlue;
+}
+
+
+
+//
+// start a transition of the backlight to a new color, timed from a given start time rather than
+// from now, so that back to back transitions can be chained without any gaps
+//  Enter:  red = new value for red LED brightness (0 - 255)
+//          green = new value for green LED brightness (0 - 255)
+//          blue = new value for blue LED brightness (0 - 255)
+//          transitionDurationMS = number of milliseconds for the transition (1 - 60000)
+//          startTimeMS = time in milliseconds (from millis()) that the transition is considered to have started
+//
+void backlightStartTransitionAt(byte red, byte green, byte blue, unsigned long transitionDurationMS, unsigned long startTimeMS)
+{
+  unsigned long finishTimeMS;
+
+  TRACE(traceBacklightTransition, red, (green << 8) | blue, min(transitionDurationMS, 32767UL));
+  backlightTransitionCompleteFlg = true;
 
   finishTimeMS = startTimeMS + transitionDurationMS;
   if (finishTimeMS < startTimeMS)
@@ -198,6 +253,10 @@ void backlightTransition()
 //
 void backlightSetColor(byte red, byte green, byte blue)
 {
+  backlightCurrentRed = red;
+  backlightCurrentGreen = green;
+  backlightCurrentBlue = blue;
+
   analogWrite(BACKLIGHT_RED_PIN, pgm_read_word(&LEDTable[red]));
 
   analogWrite(BACKLIGHT_GREEN_PIN, pgm_read_word(&LEDTable[green]));
@@ -10,7 +10,10 @@
 // function prototypes
 //
 void buttonsInitialize(void);
-byte checkButton(byte buttonIdx);
+void buttonsScan(void);
+bool buttonsGetEvent(byte *buttonIdx, byte *event);
+bool buttonsEventWaiting(void);
+void buttonsQueueEvent(byte buttonIdx, byte event);
 
 // ---------------------------------------------------------------------------------
 //                                Push Button Functions
@@ -26,51 +29,54 @@ const int BUTTON_REPEAT = 3;
 
 
 //
-// values for the button numbers (also indexes into ButtonsTable)
+// values for the button numbers, each is the button's bit in the sample of the input ports:
+// the remote buttons are on PK0 - PK3 and the push buttons on PF5 - PF7
 //
-const byte PUSH_BUTTON_UP = 0;
-const byte PUSH_BUTTON_MODE = 1;
-const byte PUSH_BUTTON_DOWN = 2;
+const byte PUSH_BUTTON_UP = 7;
+const byte PUSH_BUTTON_MODE = 6;
+const byte PUSH_BUTTON_DOWN = 5;
 
-const byte REMOTE_BUTTON_A = 3;
-const byte REMOTE_BUTTON_B = 4;
-const byte REMOTE_BUTTON_C = 5;
-const byte REMOTE_BUTTON_D = 6;
-
-const byte BUTTON_TABLE_LAST_ENTRY = 6;
+const byte REMOTE_BUTTON_A = 1;
+const byte REMOTE_BUTTON_B = 3;
+const byte REMOTE_BUTTON_C = 0;
+const byte REMOTE_BUTTON_D = 2;
 
+const byte BUTTONS_REMOTE_MASK = 0x0f;                  // PK0 - PK3, active high
+const byte BUTTONS_PUSH_MASK = 0xe0;                    // PF5 - PF7, active low
 
 
 //
-// values for State in ButtonsTable
+// periods for dealing with buttons, in 10ms ticks of the background interrupt.  A change is
+// reported on the first tick that reads it, so a push is seen no more than 10ms after the
+// contacts close, and the button is then locked out for 3 ticks so that its bounce is ignored.
 //
-const int WAITING_FOR_BUTTON_DOWN = 0;
-const int DEBOUNCE_AFTER_BUTTON_DOWN = 1;
-const int WAITING_FOR_BUTTON_UP = 2;
-const int WAITING_FOR_BUTTON_UP_AFTER_AUTO_REPEAT = 3;
-const int DEBOUNCE_AFTER_BUTTON_UP = 4;
+const byte BUTTON_AUTO_REPEAT_DELAY_TICKS = 80;
+const byte BUTTON_AUTO_REPEAT_RATE_TICKS = 13;
 
 
 //
-// delay periods for dealing with buttons in milliseconds
+// the buttons are debounced all at once with vertical counters: bit n of the two counter bytes
+// together is a 2 bit counter for button n, counting down the ticks it is locked out for, 0 when
+// it isn't
 //
-const long BUTTON_DEBOUNCE_PERIOD = 30;
-const long BUTTON_AUTO_REPEAT_DELAY = 800;
-const long BUTTON_AUTO_REPEAT_RATE = 130;
+static byte buttonsDebouncedState;                       // a 1 bit for each button that is down
+static byte buttonsCounterBit0;
+static byte buttonsCounterBit1;
+static byte buttonsRepeatTicks[8];                       // ticks until each button's next repeat
 
 
 //
-// structure for storing the state of a push button
+// the buttons are scanned every 10ms by the background interrupt and their events are put in a
+// queue for the main loop.  The interrupt is the only writer of the head and the main loop the
+// only reader of the tail, each is a single byte so no locking is needed.  Each entry holds the
+// button number in the upper 4 bits and the event in the lower 4 bits.
 //
-typedef struct _BUTTON_TABLE_ENTRY
-{
-  byte ButtonPinNumber;
-  byte State;
-  byte ButtonActiveLowFlg;
-  unsigned long EventStartTime;
-} BUTTON_TABLE_ENTRY;
+const byte BUTTON_EVENT_QUEUE_SIZE = 16;                // must be a power of 2
 
-static BUTTON_TABLE_ENTRY ButtonsTable[BUTTON_TABLE_LAST_ENTRY + 1];
+static byte buttonsEventQueue[BUTTON_EVENT_QUEUE_SIZE];
+static volatile byte buttonsEventQueueHead;
+static volatile byte buttonsEventQueueTail;
+byte buttonsEventsDroppedCount;                          // events lost because the queue was full
 
 
 /* ------------------------------------------------------------------------ */
@@ -80,9 +86,6 @@ static BUTTON_TABLE_ENTRY ButtonsTable[BUTTON_TABLE_LAST_ENTRY + 1];
 //
 void buttonsInitialize(void)
 {
-  BUTTON_TABLE_ENTRY buttonTableEntry;
-  
-  
   //
   // setup the IO pins
   //
@@ -95,154 +98,153 @@ void buttonsInitialize(void)
   pinMode(REMOTE_BUTTON_C_PIN, INPUT);
   pinMode(REMOTE_BUTTON_D_PIN, INPUT);
 
-
   //
-  // initialize the button table for each push button
+  // start with all buttons up and none locked out
   //
-  buttonTableEntry.State = WAITING_FOR_BUTTON_DOWN;
-  buttonTableEntry.ButtonActiveLowFlg = true;
-
-  buttonTableEntry.ButtonPinNumber = BUTTON_UP_PIN;
-  ButtonsTable[PUSH_BUTTON_UP] = buttonTableEntry;
-
-  buttonTableEntry.ButtonPinNumber = BUTTON_MODE_PIN;
-  ButtonsTable[PUSH_BUTTON_MODE] = buttonTableEntry;
-
-  buttonTableEntry.ButtonPinNumber = BUTTON_DOWN_PIN;
-  ButtonsTable[PUSH_BUTTON_DOWN] = buttonTableEntry;
+  buttonsDebouncedState = 0;
+  buttonsCounterBit0 = 0;
+  buttonsCounterBit1 = 0;
 
   //
-  // initialize the button table for each remote button
+  // start with the event queue empty
   //
-  buttonTableEntry.ButtonActiveLowFlg = false;
-
-  buttonTableEntry.ButtonPinNumber = REMOTE_BUTTON_A_PIN;
-  ButtonsTable[REMOTE_BUTTON_A] = buttonTableEntry;
-
-  buttonTableEntry.ButtonPinNumber = REMOTE_BUTTON_B_PIN;
-  ButtonsTable[REMOTE_BUTTON_B] = buttonTableEntry;
-
-  buttonTableEntry.ButtonPinNumber = REMOTE_BUTTON_C_PIN;
-  ButtonsTable[REMOTE_BUTTON_C] = buttonTableEntry;
-
-  buttonTableEntry.ButtonPinNumber = REMOTE_BUTTON_D_PIN;
-  ButtonsTable[REMOTE_BUTTON_D] = buttonTableEntry;
+  buttonsEventQueueHead = 0;
+  buttonsEventQueueTail = 0;
+  buttonsEventsDroppedCount = 0;
 }
 
 
 
 //
-// check for an event from a push button
-//		Enter:	buttonIdx = index of which button to test
-//		Exit:	event value returned, BUTTON_NO_EVENT returned if no event
+// scan all of the buttons, queuing any events, this is called every 10ms from the background
+// interrupt
 //
-byte checkButton(byte buttonIdx)
+void buttonsScan(void)
 {
-  byte buttonValue;
-  unsigned long currentTime;
-  
+  byte sample;
+  byte locked;
+  byte changed;
+  byte pushed;
+  byte bit;
+
   //
-  // read the button, invert polarity if set
+  // read all the buttons at once, a 1 bit for each button that is down
   //
-  buttonValue = digitalRead(ButtonsTable[buttonIdx].ButtonPinNumber);
-  if (ButtonsTable[buttonIdx].ButtonActiveLowFlg)
-    buttonValue = !buttonValue;
+  sample = (PINK & BUTTONS_REMOTE_MASK) | (~PINF & BUTTONS_PUSH_MASK);
 
   //
-  // check if nothing is going on (waiting for button to go down and it's not pressed)
+  // a button that isn't locked out and reads differently from its debounced state toggles it
+  // now, the buttons that are locked out count down a tick
   //
-  if ((ButtonsTable[buttonIdx].State == WAITING_FOR_BUTTON_DOWN) && (buttonValue == false))
-    return(BUTTON_NO_EVENT);                      // return no new event
-  
+  locked = buttonsCounterBit0 | buttonsCounterBit1;
+  changed = (sample ^ buttonsDebouncedState) & ~locked;
+  buttonsDebouncedState ^= changed;
+
+  buttonsCounterBit1 ^= locked & ~buttonsCounterBit0;
+  buttonsCounterBit0 ^= locked;
+
   //
-  // something is going on, read the time
+  // lock out the buttons that changed for 3 ticks, the most the counters hold, while they bounce
   //
-  currentTime = millis();		
-  
+  buttonsCounterBit0 |= changed;
+  buttonsCounterBit1 |= changed;
+
   //
-  // check the state that the button was in last
+  // nothing to do unless a button has changed or is being held down
   //
-  switch(ButtonsTable[buttonIdx].State)
+  pushed = buttonsDebouncedState;
+  if ((changed | pushed) == 0)
+    return;
+
+  for (bit = 0; bit < 8; bit++)
   {
-    //
-    // check if waiting for button to go down
-    //
-    case WAITING_FOR_BUTTON_DOWN:
+    if (changed & (1 << bit))
     {
-      if (buttonValue == true)                   // check if button is now down
-      {                                          // button is down, start timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        ButtonsTable[buttonIdx].State = DEBOUNCE_AFTER_BUTTON_DOWN;
-        return(BUTTON_PUSHED);                  // return button "pressed" event
-      }
-      break;
-    }	
-    
-    //
-    // check if waiting for timer after button has gone down
-    //		
-    case DEBOUNCE_AFTER_BUTTON_DOWN:
-    {                                           // check if it has been up long enough
-      if (currentTime >= (ButtonsTable[buttonIdx].EventStartTime + BUTTON_DEBOUNCE_PERIOD))
-      {                                         // debouncing period over, start auto repeat timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        ButtonsTable[buttonIdx].State = WAITING_FOR_BUTTON_UP;
+      if (pushed & (1 << bit))
+      {
+        buttonsQueueEvent(bit, BUTTON_PUSHED);
+        buttonsRepeatTicks[bit] = BUTTON_AUTO_REPEAT_DELAY_TICKS;
       }
-      break;
+      else
+        buttonsQueueEvent(bit, BUTTON_RELEASED);
     }
 
-    //
-    // check if waiting for button to go back up
-    //			
-    case WAITING_FOR_BUTTON_UP:
+    else if (pushed & (1 << bit))
     {
-      if (buttonValue == false)                 // check if button is now up
-      {                                         // button up, start debounce timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        ButtonsTable[buttonIdx].State = DEBOUNCE_AFTER_BUTTON_UP;
-        return(BUTTON_RELEASED);                // return button "released" event
+      if (--buttonsRepeatTicks[bit] == 0)
+      {
+        buttonsQueueEvent(bit, BUTTON_REPEAT);
+        buttonsRepeatTicks[bit] = BUTTON_AUTO_REPEAT_RATE_TICKS;
       }
-                                                // button still down, check if time to auto repeat
-      if (currentTime >= (ButtonsTable[buttonIdx].EventStartTime + BUTTON_AUTO_REPEAT_DELAY))
-      {                                         // reset auto repeat timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        ButtonsTable[buttonIdx].State = WAITING_FOR_BUTTON_UP_AFTER_AUTO_REPEAT;
-        return(BUTTON_REPEAT);                  // return button "auto repeat" event
-      }
-      break;
     }
+  }
+}
 
-    //
-    // check if waiting for button to repeat
-    //
-    case WAITING_FOR_BUTTON_UP_AFTER_AUTO_REPEAT:
-    {
-      if (buttonValue == false)                 // check if button is now up
-      {                                         // button up, start debounce timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        ButtonsTable[buttonIdx].State = DEBOUNCE_AFTER_BUTTON_UP;
-        return(BUTTON_RELEASED);                // return button "released" event
-      }
-                                                // button still down, check if time to auto repeat
-      if (currentTime >= (ButtonsTable[buttonIdx].EventStartTime + BUTTON_AUTO_REPEAT_RATE))
-      {                                         // reset auto repeat timer
-        ButtonsTable[buttonIdx].EventStartTime = currentTime;
-        return(BUTTON_REPEAT);                  // return button "auto repeat" event
-      }
-      break;
-    }			
-    
-    //
-    // check if waiting for debouncing after button has gone up
-    //
-    case DEBOUNCE_AFTER_BUTTON_UP:
-    {                                            // after button goes up, wait before check for down
-      if (currentTime >= (ButtonsTable[buttonIdx].EventStartTime + BUTTON_DEBOUNCE_PERIOD))
-        ButtonsTable[buttonIdx].State = WAITING_FOR_BUTTON_DOWN;
-      break;
-    }
+
+
+//
+// add an event to the queue, if the main loop has fallen behind and it is full the event is
+// dropped
+//  Enter: buttonIdx = button number
+//         event = button event
+//
+void buttonsQueueEvent(byte buttonIdx, byte event)
+{
+  byte head;
+
+  TRACE(traceButtonEvent, buttonIdx, event, 0);
+  head = buttonsEventQueueHead;
+  if ((byte) (head - buttonsEventQueueTail) >= BUTTON_EVENT_QUEUE_SIZE)
+  {
+    buttonsEventsDroppedCount++;
+    return;
   }
-  
-  return(BUTTON_NO_EVENT);                      // return no new event
+
+#if PROFILER_ENABLED
+  //
+  // time how long the oldest event waits for the buttons task
+  //
+  if (head == buttonsEventQueueTail)
+    PROFILE_BEGIN(profileButtonDelay);
+#endif
+
+  buttonsEventQueue[head & (BUTTON_EVENT_QUEUE_SIZE - 1)] = (buttonIdx << 4) | event;
+  buttonsEventQueueHead = head + 1;
+  schedulerRaiseEvent(SCHEDULER_EVENT_BUTTON);
 }
 
+
+
+//
+// get the next button event from the queue, call this from the main loop
+//  Enter: buttonIdx -> byte to return the index of the button in
+//         event -> byte to return the event in
+//  Exit:  true returned if there was an event, false if the queue is empty
+//
+bool buttonsGetEvent(byte *buttonIdx, byte *event)
+{
+  byte tail;
+  byte entry;
+
+  tail = buttonsEventQueueTail;
+  if (tail == buttonsEventQueueHead)
+    return(false);
+
+  entry = buttonsEventQueue[tail & (BUTTON_EVENT_QUEUE_SIZE - 1)];
+  buttonsEventQueueTail = tail + 1;
+
+  *buttonIdx = entry >> 4;
+  *event = entry & 0x0f;
+  return(true);
+}
+
+
+
+//
+// check if there are button events in the queue, call this from the main loop
+//  Exit:  true returned if buttonsGetEvent() would return an event
+//
+bool buttonsEventWaiting(void)
+{
+  return(buttonsEventQueueTail != buttonsEventQueueHead);
+}
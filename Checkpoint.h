@@ -0,0 +1,234 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Mode and Show Checkpoint                     *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The mode and the place in the show are checkpointed to the battery backed RAM in the real
+// time clock, so after a brownout or power cycle the sculpture carries on where it was rather
+// than starting the show over.  The RAM doesn't wear out like the EEPROM, but each write ties
+// up the I2C bus for a few milliseconds, so writes are coalesced: the checkpoint is written when
+// the mode or step changes, no more than once a second, and refreshed every few seconds while a
+// step holds so the time into it isn't far behind.
+//
+// Writing the whole checkpoint at once would hold up the main loop for about 5ms at the RTC's
+// 100KHz I2C clock, and with it the buttons.  Only the bytes that differ from the checkpoint
+// last written are sent, no more than 8 of them each time the task runs, taking about 1ms.  The
+// checksum is the last byte so it is written last, a checkpoint cut short by the power going off
+// isn't taken as valid and the sculpture starts in the Action mode, as it would with none.
+//
+
+//
+// checkpoint constants
+//
+const byte CHECKPOINT_VERSION = 3;                      // change when CHECKPOINT_RECORD changes
+const byte CHECKPOINT_NVRAM_ADDRESS = 0;
+const unsigned int CHECKPOINT_MIN_INTERVAL_MS = 1000;   // shortest time between writes
+const unsigned int CHECKPOINT_REFRESH_MS = 5000;        // rewrite while the show plays a step
+const byte CHECKPOINT_WRITE_CHUNK_SIZE = 8;             // most bytes written each time the task runs
+
+//
+// the checkpoint, as saved in the RTC's RAM
+//
+typedef struct {
+  byte version;
+  unsigned int programLength;                   // the show program the place in the show is in
+  unsigned long programHash;
+  byte mode;
+  bool showFlg;                                 // true if show holds a place in the show
+  EXTRAVAGANZA_STEP_STATE show;
+  byte checksum;
+} CHECKPOINT_RECORD;
+
+//
+// the size is only checked on the sculpture, an int is 32 bits in the host tests in tools/
+//
+#ifdef __AVR__
+static_assert(CHECKPOINT_NVRAM_ADDRESS + sizeof(CHECKPOINT_RECORD) <= DS1307_NVRAM_SIZE,
+  "CHECKPOINT_RECORD does not fit in the RTC's RAM");
+#endif
+
+//
+// function prototypes
+//
+int checkpointRestore();
+void checkpointTask();
+void checkpointTake(CHECKPOINT_RECORD *record);
+void checkpointWriteNextChunk();
+byte checkpointChecksum(CHECKPOINT_RECORD *record);
+
+
+// ---------------------------------------------------------------------------------
+//                               Checkpoint Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the checkpoint
+//
+CHECKPOINT_RECORD checkpointSaved;              // the checkpoint last written, as it is in the RTC's RAM
+CHECKPOINT_RECORD checkpointWriting;            // the checkpoint being written
+byte checkpointWriteCount;                      // bytes of it written, sizeof(CHECKPOINT_RECORD) when done
+unsigned long checkpointLastWriteTimeMS;
+
+// ---------------------------------------------------------------------------------
+
+//
+// restore the checkpoint saved in the RTC's RAM, the show carries on from the place saved the
+// next time it is played
+//  Exit:  mode to start in returned, the Action mode if there isn't a checkpoint
+//
+int checkpointRestore()
+{
+  CHECKPOINT_RECORD record;
+  int mode;
+
+  checkpointLastWriteTimeMS = millis();
+  checkpointWriteCount = sizeof(CHECKPOINT_RECORD);
+  memset(&checkpointSaved, 0, sizeof(checkpointSaved));
+
+  if (!RTCReadNVRAM(CHECKPOINT_NVRAM_ADDRESS, (byte *) &record, sizeof(record)))
+    return(actionMode);
+
+  //
+  // only the bytes that differ from what is in the RAM are written, so keep what was read even
+  // if it isn't a checkpoint that can be used
+  //
+  checkpointSaved = record;
+
+  if ((record.version != CHECKPOINT_VERSION) || (record.checksum != checkpointChecksum(&record)))
+    return(actionMode);
+
+  //
+  // a place in a show program that has since been replaced would carry on from the middle of
+  // an instruction, or the wrong step
+  //
+  if ((record.programLength != ExtravaganzaProgramLength) || (record.programHash != ExtravaganzaProgramHash))
+    return(actionMode);
+
+  if (record.showFlg)
+    extravaganzaSetResumePoint(&record.show);
+
+  //
+  // the modes that set the time and contrast are only entered from the buttons
+  //
+  mode = record.mode;
+  if ((mode > stoppedMode) || (mode == setContrastMode) || (mode == setTimeMode))
+    mode = actionMode;
+
+  return(mode);
+}
+
+
+
+//
+// write the checkpoint when the mode or the step in the show has changed, run by the scheduler.
+// A checkpoint being written is carried on with first.
+//
+void checkpointTask()
+{
+  CHECKPOINT_RECORD record;
+  unsigned long sinceWriteMS;
+  bool changedFlg;
+
+  if (checkpointWriteCount < sizeof(CHECKPOINT_RECORD))
+  {
+    checkpointWriteNextChunk();
+    return;
+  }
+
+  sinceWriteMS = millis() - checkpointLastWriteTimeMS;
+  if (sinceWriteMS < CHECKPOINT_MIN_INTERVAL_MS)
+    return;
+
+  checkpointTake(&record);
+  changedFlg = (record.mode != checkpointSaved.mode) ||
+    (record.showFlg != checkpointSaved.showFlg) ||
+    (record.show.stepNumber != checkpointSaved.show.stepNumber);
+
+  //
+  // the time into the step only moves while the show is playing
+  //
+  if (!changedFlg &&
+      ((sinceWriteMS < CHECKPOINT_REFRESH_MS) || (record.show.positionMS == checkpointSaved.show.positionMS)))
+    return;
+
+  checkpointWriting = record;
+  checkpointWriteCount = 0;
+  checkpointWriteNextChunk();
+}
+
+
+
+//
+// carry on writing the checkpoint, sending the next bytes that differ from the checkpoint last
+// written, no more than CHECKPOINT_WRITE_CHUNK_SIZE of them
+//
+void checkpointWriteNextChunk()
+{
+  byte *writing;
+  byte *saved;
+  byte count;
+
+  writing = (byte *) &checkpointWriting;
+  saved = (byte *) &checkpointSaved;
+
+  //
+  // skip the bytes that are already in the RAM
+  //
+  while ((checkpointWriteCount < sizeof(CHECKPOINT_RECORD)) &&
+         (writing[checkpointWriteCount] == saved[checkpointWriteCount]))
+    checkpointWriteCount++;
+
+  count = sizeof(CHECKPOINT_RECORD) - checkpointWriteCount;
+  if (count > CHECKPOINT_WRITE_CHUNK_SIZE)
+    count = CHECKPOINT_WRITE_CHUNK_SIZE;
+
+  if (count != 0)
+  {
+    RTCWriteNVRAM(CHECKPOINT_NVRAM_ADDRESS + checkpointWriteCount, &writing[checkpointWriteCount], count);
+    memcpy(&saved[checkpointWriteCount], &writing[checkpointWriteCount], count);
+    checkpointWriteCount += count;
+  }
+
+  if (checkpointWriteCount >= sizeof(CHECKPOINT_RECORD))
+    checkpointLastWriteTimeMS = millis();
+}
+
+
+
+//
+// fill in a checkpoint with the current mode and place in the show
+//  Enter: record -> checkpoint to fill in
+//
+void checkpointTake(CHECKPOINT_RECORD *record)
+{
+  memset(record, 0, sizeof(CHECKPOINT_RECORD));
+  record->version = CHECKPOINT_VERSION;
+  record->programLength = ExtravaganzaProgramLength;
+  record->programHash = ExtravaganzaProgramHash;
+  record->mode = sculptureMode;
+  record->showFlg = extravaganzaGetResumePoint(&record->show);
+  record->checksum = checkpointChecksum(record);
+}
+
+
+
+//
+// compute the checksum of a checkpoint, blank RAM does not give a valid checksum
+//  Enter: record -> checkpoint to check
+//  Exit:  checksum returned
+//
+byte checkpointChecksum(CHECKPOINT_RECORD *record)
+{
+  byte checksum;
+
+  checksum = 0x5a;
+  for (unsigned int i = 0; i < offsetof(CHECKPOINT_RECORD, checksum); i++)
+    checksum = (checksum << 1 | checksum >> 7) ^ ((byte *) record)[i];
+
+  return(checksum);
+}
+
+
+// -------------------------------------- End --------------------------------------
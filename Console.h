@@ -0,0 +1,682 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                     Serial Command Console                     *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The console takes commands typed on the serial port, so colors, speeds and tunables can be
+// tried on the running sculpture without editing the show and downloading it again.  Each
+// command is a line of words separated by spaces, ended by a return or newline, and is answered
+// with a line starting "ok" or "error:".  Type "help" for the list.
+//
+// The serial port's receive interrupt buffers the characters as they arrive.  The console task
+// takes them from the buffer every 2ms and builds up the line, it carries out no more than one
+// command each time it runs and never waits for a character.  A program sending commands should
+// wait for the reply to each before sending the next, so the receive buffer can't overflow.
+// The commands are carried out in the main loop, the background process only sees the values
+// they change, which are changed with interrupts held off for a few instructions, so the motor
+// and backlight timing is not disturbed.
+//
+// The palette and velocity presets are changed in a RAM overlay (see Extravaganza.h).  The show
+// and the Play mode's gestures use a changed entry from their next step, and the changes last
+// until "revert" or the power is turned off, copy them into tools/ExtravaganzaShow.txt to keep
+// them.  "vel" and "rgb" move the disks and backlight straight away, in the Action, Light and
+// Play modes the show takes over again at its next step so they are most useful in the Stopped
+// mode.  Velocities the motors can't reach are refused, the same as in the show.
+//
+// tools/ConsoleClient.cpp sends commands from a file and checks the replies, it works with the
+// sculpture's serial port or a pseudo-terminal.  tools/SculptureSimulator.cpp runs the sketch on
+// the PC with its serial port on a pseudo-terminal, so the console can be tried without the
+// sculpture.
+//
+
+//
+// console constants
+//
+const byte CONSOLE_LINE_LENGTH = 64;            // longest command, including its end
+const byte CONSOLE_MAX_WORDS = 5;               // "palette" and its 4 values
+const unsigned int CONSOLE_DEFAULT_TRANSITION_MS = 1000;
+
+//
+// the names of the modes, in the order of Modes
+//
+const char *ConsoleModeNames[] = {"action", "light", "play", "meter", "contrast", "time", "diag", "stop"};
+
+//
+// the values that can be read with "get" and changed with "set"
+//
+enum ConsoleTunables {tunableKP, tunableKI, tunableContrast, tunableTemperature, tunableOffset, tunableTelemetry,
+#if TRACE_ENABLED
+                      tunableTachTrace,
+#endif
+                      tunableCount};
+
+const char *ConsoleTunableNames[tunableCount] = {"kp", "ki", "contrast", "temp", "offset", "telemetry",
+#if TRACE_ENABLED
+                                                 "tach"
+#endif
+};
+
+//
+// the range of each tunable
+//
+const int ConsoleTunableMin[tunableCount] = {0, 1, 0, -40, -1000, 0,
+#if TRACE_ENABLED
+                                             0
+#endif
+};
+
+const int ConsoleTunableMax[tunableCount] = {50, 2000, 127, 60, 1000, 1,
+#if TRACE_ENABLED
+                                             1
+#endif
+};
+
+//
+// function prototypes
+//
+void consoleInitialize();
+void consoleTask();
+void consoleExecute(char *line);
+byte consoleSplitWords(char *line, char **words);
+void consoleHelp();
+void consoleMode(char **words, byte wordCount);
+void consoleVelocities(char **words, byte wordCount);
+void consoleColor(char **words, byte wordCount);
+void consolePalette(char **words, byte wordCount);
+void consolePreset(char **words, byte wordCount);
+void consoleGet(char **words, byte wordCount);
+void consoleSet(char **words, byte wordCount);
+int consoleGetTunable(byte tunable);
+void consoleSetTunable(byte tunable, int value);
+int consoleFindName(char *word, const char **names, byte count);
+bool consoleParseLong(char *word, long minValue, long maxValue, long *value);
+bool consoleParseVelocity(char *word, float *velocity);
+void consoleReplyOK();
+void consoleReplyError(const __FlashStringHelper *message);
+
+
+// ---------------------------------------------------------------------------------
+//                                 Console Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the console
+//
+char consoleLine[CONSOLE_LINE_LENGTH];
+byte consoleLineLength;
+bool consoleLineTooLongFlg;                     // true to throw away the rest of the line
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the console with an empty line
+//
+void consoleInitialize()
+{
+  consoleLineLength = 0;
+  consoleLineTooLongFlg = false;
+}
+
+
+
+//
+// add the characters received to the line, carrying out the command when it ends, run by the
+// scheduler
+//
+void consoleTask()
+{
+  char c;
+
+  while (Serial.available() > 0)
+  {
+    c = Serial.read();
+
+    //
+    // a return or newline ends the line, the newline after a return ends an empty line which
+    // is ignored
+    //
+    if ((c == '\r') || (c == '\n'))
+    {
+      if (consoleLineTooLongFlg)
+        consoleReplyError(F("line too long"));
+      else if (consoleLineLength != 0)
+      {
+        consoleLine[consoleLineLength] = 0;
+        consoleExecute(consoleLine);
+      }
+
+      consoleLineLength = 0;
+      consoleLineTooLongFlg = false;
+      return;
+    }
+
+    //
+    // backspace and delete remove the last character, so the console can be typed into
+    //
+    if ((c == '\b') || (c == 0x7f))
+    {
+      if (consoleLineLength != 0)
+        consoleLineLength--;
+      continue;
+    }
+
+    if (consoleLineLength < CONSOLE_LINE_LENGTH - 1)
+      consoleLine[consoleLineLength++] = c;
+    else
+      consoleLineTooLongFlg = true;
+  }
+}
+
+
+
+//
+// carry out a command
+//  Enter: line -> the command, its words are split apart in place
+//
+void consoleExecute(char *line)
+{
+  char *words[CONSOLE_MAX_WORDS + 1];
+  byte wordCount;
+
+  wordCount = consoleSplitWords(line, words);
+  if (wordCount == 0)
+    return;
+  if (wordCount > CONSOLE_MAX_WORDS)
+  {
+    consoleReplyError(F("too many values"));
+    return;
+  }
+
+  if (strcmp_P(words[0], PSTR("help")) == 0)
+    consoleHelp();
+  else if (strcmp_P(words[0], PSTR("mode")) == 0)
+    consoleMode(words, wordCount);
+  else if (strcmp_P(words[0], PSTR("vel")) == 0)
+    consoleVelocities(words, wordCount);
+  else if (strcmp_P(words[0], PSTR("rgb")) == 0)
+    consoleColor(words, wordCount);
+  else if (strcmp_P(words[0], PSTR("palette")) == 0)
+    consolePalette(words, wordCount);
+  else if (strcmp_P(words[0], PSTR("preset")) == 0)
+    consolePreset(words, wordCount);
+  else if ((strcmp_P(words[0], PSTR("revert")) == 0) && (wordCount == 1))
+  {
+    extravaganzaRevertOverlay();
+    consoleReplyOK();
+  }
+  else if (strcmp_P(words[0], PSTR("get")) == 0)
+    consoleGet(words, wordCount);
+  else if (strcmp_P(words[0], PSTR("set")) == 0)
+    consoleSet(words, wordCount);
+  else if ((strcmp_P(words[0], PSTR("save")) == 0) && (wordCount == 1))
+  {
+    ultrasonicSaveCalibration();
+    consoleReplyOK();
+  }
+  else
+    consoleReplyError(F("unknown command, type help"));
+}
+
+
+
+//
+// split a line into words separated by spaces or tabs
+//  Enter: line -> the line, a zero is written after each word
+//         words -> filled in with a pointer to each word, room for CONSOLE_MAX_WORDS + 1
+//  Exit:  number of words returned, CONSOLE_MAX_WORDS + 1 if there are more than fit
+//
+byte consoleSplitWords(char *line, char **words)
+{
+  byte wordCount;
+
+  wordCount = 0;
+  while (true)
+  {
+    while ((*line == ' ') || (*line == '\t'))
+      line++;
+    if (*line == 0)
+      return(wordCount);
+
+    if (wordCount > CONSOLE_MAX_WORDS)
+      return(wordCount);
+    words[wordCount++] = line;
+
+    while ((*line != 0) && (*line != ' ') && (*line != '\t'))
+      line++;
+    if (*line != 0)
+      *line++ = 0;
+  }
+}
+
+
+
+//
+// list the commands
+//
+void consoleHelp()
+{
+  Serial.println(F("mode [action|light|play|meter|contrast|time|diag|stop]"));
+  Serial.println(F("vel OUTER INNER [MS]           disk velocities in RPM"));
+  Serial.println(F("rgb RED GREEN BLUE [MS]        backlight color"));
+  Serial.println(F("palette N [RED GREEN BLUE]     show or change a palette color"));
+  Serial.println(F("preset N [OUTER INNER]         show or change a velocity preset"));
+  Serial.println(F("revert                         undo the palette and preset changes"));
+  Serial.print(F("get [NAME], set NAME VALUE     "));
+  for (byte i = 0; i < tunableCount; i++)
+  {
+    Serial.print(ConsoleTunableNames[i]);
+    Serial.print(' ');
+  }
+  Serial.println();
+  Serial.println(F("save                           save the ultrasonic calibration in EEPROM"));
+  consoleReplyOK();
+}
+
+
+
+//
+// show or change the mode
+//  Enter: words -> "mode" and the name of the new mode, if given
+//
+void consoleMode(char **words, byte wordCount)
+{
+  int mode;
+
+  if (wordCount == 1)
+  {
+    Serial.print(F("mode "));
+    Serial.println(ConsoleModeNames[sculptureMode]);
+    consoleReplyOK();
+    return;
+  }
+
+  mode = consoleFindName(words[1], ConsoleModeNames, stoppedMode + 1);
+  if ((mode < 0) || (wordCount != 2))
+  {
+    consoleReplyError(F("unknown mode"));
+    return;
+  }
+
+  setSculptureMode(mode);
+  consoleReplyOK();
+}
+
+
+
+//
+// transition the disks to new velocities
+//  Enter: words -> "vel", the outer and inner disk velocities in RPM and the transition time
+//
+void consoleVelocities(char **words, byte wordCount)
+{
+  float outerVelocity;
+  float innerVelocity;
+  long transitionMS;
+
+  transitionMS = CONSOLE_DEFAULT_TRANSITION_MS;
+
+  if (((wordCount != 3) && (wordCount != 4)) ||
+      !consoleParseVelocity(words[1], &outerVelocity) ||
+      !consoleParseVelocity(words[2], &innerVelocity) ||
+      ((wordCount == 4) && !consoleParseLong(words[3], 1, 60000, &transitionMS)))
+  {
+    consoleReplyError(F("expected vel OUTER INNER [MS]"));
+    return;
+  }
+
+  diskVelocitiesStartTransition(outerVelocity, innerVelocity, transitionMS);
+  consoleReplyOK();
+}
+
+
+
+//
+// transition the backlight to a new color
+//  Enter: words -> "rgb", the red, green and blue values and the transition time
+//
+void consoleColor(char **words, byte wordCount)
+{
+  long rgb[3];
+  long transitionMS;
+
+  transitionMS = CONSOLE_DEFAULT_TRANSITION_MS;
+
+  if (((wordCount != 4) && (wordCount != 5)) ||
+      !consoleParseLong(words[1], 0, 255, &rgb[red]) ||
+      !consoleParseLong(words[2], 0, 255, &rgb[green]) ||
+      !consoleParseLong(words[3], 0, 255, &rgb[blue]) ||
+      ((wordCount == 5) && !consoleParseLong(words[4], 1, 60000, &transitionMS)))
+  {
+    consoleReplyError(F("expected rgb RED GREEN BLUE [MS]"));
+    return;
+  }
+
+  backlightRetargetTransition(rgb[red], rgb[green], rgb[blue], transitionMS);
+  consoleReplyOK();
+}
+
+
+
+//
+// show or change a palette color in the overlay
+//  Enter: words -> "palette", the palette color, and the new red, green and blue values if given
+//
+void consolePalette(char **words, byte wordCount)
+{
+  long idx;
+  long rgb[3];
+  byte currentRGB[3];
+
+  if (((wordCount != 2) && (wordCount != 5)) ||
+      !consoleParseLong(words[1], 0, ExtravaganzaPaletteLength - 1, &idx))
+  {
+    consoleReplyError(F("expected palette N [RED GREEN BLUE]"));
+    return;
+  }
+
+  if (wordCount == 2)
+  {
+    extravaganzaGetPaletteColor(idx, &currentRGB[red], &currentRGB[green], &currentRGB[blue]);
+    Serial.print(F("palette "));
+    Serial.print(idx);
+    for (byte i = 0; i < 3; i++)
+    {
+      Serial.print(' ');
+      Serial.print(currentRGB[i]);
+    }
+    Serial.println();
+    consoleReplyOK();
+    return;
+  }
+
+  if (!consoleParseLong(words[2], 0, 255, &rgb[red]) ||
+      !consoleParseLong(words[3], 0, 255, &rgb[green]) ||
+      !consoleParseLong(words[4], 0, 255, &rgb[blue]))
+  {
+    consoleReplyError(F("colors must be 0 - 255"));
+    return;
+  }
+
+  extravaganzaSetPaletteColor(idx, rgb[red], rgb[green], rgb[blue]);
+  consoleReplyOK();
+}
+
+
+
+//
+// show or change a velocity preset in the overlay
+//  Enter: words -> "preset", the preset, and the new outer and inner disk velocities if given
+//
+void consolePreset(char **words, byte wordCount)
+{
+  long idx;
+  float outerVelocity;
+  float innerVelocity;
+
+  if (((wordCount != 2) && (wordCount != 4)) ||
+      !consoleParseLong(words[1], 0, ExtravaganzaVelocityPresetsLength - 1, &idx))
+  {
+    consoleReplyError(F("expected preset N [OUTER INNER]"));
+    return;
+  }
+
+  if (wordCount == 2)
+  {
+    extravaganzaGetVelocityPreset(idx, &outerVelocity, &innerVelocity);
+    Serial.print(F("preset "));
+    Serial.print(idx);
+    Serial.print(' ');
+    Serial.print(outerVelocity, 1);
+    Serial.print(' ');
+    Serial.println(innerVelocity, 1);
+    consoleReplyOK();
+    return;
+  }
+
+  if (!consoleParseVelocity(words[2], &outerVelocity) || !consoleParseVelocity(words[3], &innerVelocity))
+  {
+    consoleReplyError(F("velocity out of range"));
+    return;
+  }
+
+  extravaganzaSetVelocityPreset(idx, outerVelocity, innerVelocity);
+  consoleReplyOK();
+}
+
+
+
+//
+// show a tunable, or all of them
+//  Enter: words -> "get" and the name of the tunable, if given
+//
+void consoleGet(char **words, byte wordCount)
+{
+  int tunable;
+
+  if (wordCount > 2)
+  {
+    consoleReplyError(F("expected get [NAME]"));
+    return;
+  }
+
+  tunable = -1;
+  if (wordCount == 2)
+  {
+    tunable = consoleFindName(words[1], ConsoleTunableNames, tunableCount);
+    if (tunable < 0)
+    {
+      consoleReplyError(F("unknown name"));
+      return;
+    }
+  }
+
+  for (byte i = 0; i < tunableCount; i++)
+  {
+    if ((tunable >= 0) && (i != tunable))
+      continue;
+
+    Serial.print(ConsoleTunableNames[i]);
+    Serial.print(' ');
+    Serial.println(consoleGetTunable(i));
+  }
+  consoleReplyOK();
+}
+
+
+
+//
+// change a tunable
+//  Enter: words -> "set", the name of the tunable and its new value
+//
+void consoleSet(char **words, byte wordCount)
+{
+  int tunable;
+  long value;
+
+  if (wordCount != 3)
+  {
+    consoleReplyError(F("expected set NAME VALUE"));
+    return;
+  }
+
+  tunable = consoleFindName(words[1], ConsoleTunableNames, tunableCount);
+  if (tunable < 0)
+  {
+    consoleReplyError(F("unknown name"));
+    return;
+  }
+
+  if (!consoleParseLong(words[2], ConsoleTunableMin[tunable], ConsoleTunableMax[tunable], &value))
+  {
+    Serial.print(F("error: "));
+    Serial.print(ConsoleTunableNames[tunable]);
+    Serial.print(F(" must be "));
+    Serial.print(ConsoleTunableMin[tunable]);
+    Serial.print(F(" - "));
+    Serial.println(ConsoleTunableMax[tunable]);
+    return;
+  }
+
+  consoleSetTunable(tunable, value);
+  consoleReplyOK();
+}
+
+
+
+//
+// read a tunable
+//  Enter: tunable = ConsoleTunables value
+//  Exit:  its value returned
+//
+int consoleGetTunable(byte tunable)
+{
+  switch(tunable)
+  {
+    case tunableKP:
+      return(motorKP);
+    case tunableKI:
+      return(motorKI);
+    case tunableContrast:
+      return(getContrastByteFromEEPROM());
+    case tunableTemperature:
+      return(ultrasonicTemperatureC);
+    case tunableOffset:
+      return(ultrasonicCalibration.offsetInMM);
+    case tunableTelemetry:
+      return(telemetryIsEnabled());
+#if TRACE_ENABLED
+    case tunableTachTrace:
+      return(traceTachEdgesFlg);
+#endif
+  }
+  return(0);
+}
+
+
+
+//
+// change a tunable, the gains and the ultrasonic calibration last until the power is turned
+// off (see "save" for the calibration), the contrast is saved in EEPROM as the Set Contrast mode
+// does
+//  Enter: tunable = ConsoleTunables value
+//         value = new value, in its range
+//
+void consoleSetTunable(byte tunable, int value)
+{
+  switch(tunable)
+  {
+    case tunableKP:
+      motorSetGains(value, motorKI);
+      break;
+    case tunableKI:
+      motorSetGains(motorKP, value);
+      break;
+    case tunableContrast:
+      EEPROM.write(EEPROM_CONTRAST_BYTE_ADDRESS, value);
+      LCDSetContrast(value);
+      break;
+    case tunableTemperature:
+      ultrasonicSetTemperature(value);
+      break;
+    case tunableOffset:
+      ultrasonicSetOffset(value);
+      break;
+    case tunableTelemetry:
+      telemetryEnable(value);
+      break;
+#if TRACE_ENABLED
+    case tunableTachTrace:
+      traceTachEdgesFlg = value;
+      break;
+#endif
+  }
+}
+
+
+
+//
+// look up a word in a list of names
+//  Enter: word -> word to find
+//         names -> list of names
+//         count = number of names
+//  Exit:  index of the name returned, -1 if not found
+//
+int consoleFindName(char *word, const char **names, byte count)
+{
+  for (byte i = 0; i < count; i++)
+  {
+    if (strcmp(word, names[i]) == 0)
+      return(i);
+  }
+  return(-1);
+}
+
+
+
+//
+// read a whole number
+//  Enter: word -> the number in decimal
+//         minValue, maxValue = range allowed
+//         value -> set to the number
+//  Exit:  true returned if the word is a number in the range
+//
+bool consoleParseLong(char *word, long minValue, long maxValue, long *value)
+{
+  char *end;
+  long number;
+
+  number = strtol(word, &end, 10);
+  if ((end == word) || (*end != 0) || (number < minValue) || (number > maxValue))
+    return(false);
+
+  *value = number;
+  return(true);
+}
+
+
+
+//
+// read a disk velocity
+//  Enter: word -> velocity in RPM, negative is counter-clockwise
+//         velocity -> set to the velocity
+//  Exit:  true returned if the word is a velocity the motors can reach
+//
+bool consoleParseVelocity(char *word, float *velocity)
+{
+  char *end;
+  float number;
+
+  number = strtod(word, &end);
+  if ((end == word) || (*end != 0) || !extravaganzaCheckVelocity(number))
+    return(false);
+
+  *velocity = number;
+  return(true);
+}
+
+
+
+//
+// answer a command that was carried out
+//
+void consoleReplyOK()
+{
+  Serial.println(F("ok"));
+}
+
+
+
+//
+// answer a command that could not be carried out
+//  Enter: message -> why, in program memory
+//
+void consoleReplyError(const __FlashStringHelper *message)
+{
+  Serial.print(F("error: "));
+  Serial.println(message);
+}
+
+
+// -------------------------------------- End --------------------------------------
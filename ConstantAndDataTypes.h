@@ -96,7 +96,7 @@ const int TEST_D9_PIN = 9;
 const int LED_PIN = 13;
 
 //
-// buttons and remote pin assignments
+// buttons and remote pin assignments, Buttons.h reads these directly as PF5 - PF7 and PK0 - PK3
 //
 const int BUTTON_UP_PIN = 61;
 const int BUTTON_MODE_PIN = 60;
@@ -112,11 +112,14 @@ const int REMOTE_BUTTON_D_PIN = 64;
 // EERROM storage locations
 //
 const int EEPROM_CONTRAST_BYTE_ADDRESS = 0;
+const int EEPROM_ULTRASONIC_CALIBRATION_ADDRESS = 1;      // ULTRASONIC_CALIBRATION, 9 bytes
+const int EEPROM_ANALYTICS_ADDRESS = 16;                 // ring of ANALYTICS_RECORD slots
+const byte EEPROM_ANALYTICS_SLOT_COUNT = 8;
 
 //
 // motion constants constants
 //
-const float GEAR_REDUCTION_TO_FINAL_STAGE = 127;
+constexpr float GEAR_REDUCTION_TO_FINAL_STAGE = 127;
 const long LINES_ON_TACHOMETER_DISK = 25;
 const float MINIMUM_VELOCITY_IN_RPM = 0.9;
 
@@ -129,6 +132,7 @@ const int MOTOR_KINT_SPEED_ERROR_MAX = 2000;
 const int MOTOR_MAX_PWM_FROM_INTEGRAL_TERM = 125;
 const long MOTOR_KI_PROP_INT_CONTROL = MOTOR_KINT_SPEED_ERROR_MAX / MOTOR_MAX_PWM_FROM_INTEGRAL_TERM;
 const int MOTOR_MAX_PWM = 220;
+const long MOTOR_MAX_SPEED_IN_RPM = 7700;       // fastest motor speed the PI loop can hold at MOTOR_MAX_PWM
 
 //
 // table normalize for eye nonlinearity with the function: x ^ 1.8
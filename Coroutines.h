@@ -0,0 +1,98 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                    Stackless Mode Coroutines                   *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// A mode is written as one or more coroutines: functions that read from top to bottom like a
+// blocking loop, but return to the scheduler at each await and carry on from the same place the
+// next time they are called.  Several coroutines can take turns, such as a color show and an
+// LCD animation, all on the one stack.
+//
+// The coroutines are built on a switch statement, each await saves its line number and the
+// next call jumps back to it.  This means:
+//
+//   Local variables are NOT kept across an await, use global variables for anything needed
+//   after one.
+//
+//   Declare local variables at the top of the function, before CO_BEGIN.
+//
+//   Don't use a switch statement between CO_BEGIN and CO_END, put it in another function.
+//
+// A coroutine looks like this:
+//
+//   void blinkCoroutine(COROUTINE *co)
+//   {
+//     CO_BEGIN(co);
+//     while (true)
+//     {
+//       digitalWrite(LED_PIN, HIGH);
+//       CO_AWAIT_MS(co, 500);
+//       digitalWrite(LED_PIN, LOW);
+//       CO_AWAIT_MS(co, 500);
+//     }
+//     CO_END(co);
+//   }
+//
+
+//
+// the state of a coroutine
+//
+typedef struct {
+  unsigned int resumeLine;                      // line to carry on from, 0 to start at the top
+  unsigned long waitStartTimeMS;                // used by CO_AWAIT_MS
+  unsigned long distanceTimeMS;                 // used by CO_AWAIT_DISTANCE
+} COROUTINE;
+
+
+// ---------------------------------------------------------------------------------
+//                                Coroutine Macros
+// ---------------------------------------------------------------------------------
+
+//
+// start and end the body of a coroutine, a coroutine that reaches its end starts over
+//
+#define CO_BEGIN(co) switch((co)->resumeLine) { case 0:
+#define CO_END(co) } (co)->resumeLine = 0
+
+//
+// start a coroutine over from the top the next time it is called
+//
+#define CO_RESTART(co) (co)->resumeLine = 0
+
+//
+// return to the scheduler, carrying on from here the next time
+//
+#define CO_YIELD(co) do { (co)->resumeLine = __LINE__; return; case __LINE__: ; } while (0)
+
+//
+// return to the scheduler until a condition is true, the condition is checked each time the
+// coroutine is called
+//
+#define CO_AWAIT(co, condition) do { (co)->resumeLine = __LINE__; case __LINE__: if (!(condition)) return; } while (0)
+
+//
+// wait for a period of time
+//
+#define CO_AWAIT_MS(co, periodMS) do { (co)->waitStartTimeMS = millis(); CO_AWAIT(co, (millis() - (co)->waitStartTimeMS) >= (unsigned long) (periodMS)); } while (0)
+
+//
+// wait for the disk velocity and backlight transitions to finish
+//
+#define CO_AWAIT_TRANSITION(co) CO_AWAIT(co, diskVelocitiesTransitionIsFinished() && backlightTransitionIsFinished())
+
+//
+// wait for the background ranging to measure a new filtered distance
+//
+#define CO_AWAIT_DISTANCE(co) do { (co)->distanceTimeMS = ultrasonicGetFilteredDistanceTimeMS(); CO_AWAIT(co, ultrasonicGetFilteredDistanceTimeMS() != (co)->distanceTimeMS); } while (0)
+
+//
+// wait for an Up or Down button event, the mode must have set modeButtonHandler to
+// modeCoroutineButtonHandler.  The button and event are copied into buttonIdx and event.
+//
+#define CO_AWAIT_BUTTON(co, buttonIdx, event) do { CO_AWAIT(co, modeButtonEvent != BUTTON_NO_EVENT); \
+  (buttonIdx) = modeButtonIdx; (event) = modeButtonEvent; modeButtonEvent = BUTTON_NO_EVENT; } while (0)
+
+
+// -------------------------------------- End --------------------------------------
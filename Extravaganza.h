@@ -21,54 +21,551 @@ enum Colour {red, green, blue};
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                                    //
-//                                            Motor Velocities Definitions                                            //
+//                                              Motor Velocity Limits                                                 //
 //                                                                                                                    //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 enum Disc {front, back};
 
-#define velocitiesOff {0, 0}
-#define velocitiesDizzyUp {-10, 10}
-#define velocitiesBlaster {15, 20}
-#define trippingBalls {20.0, -20.0}
-#define moreBallTripping {-20.0, 20.0}
-#define Chiaroscuro {250, -250.0}
-#define reversedChiaroscuro {-250.0, 250.0}
-#define cruuuising {30.0, 15.0}
-#define reverseCruuuising {10.0, 20.0}
+//
+// Every disk velocity the sculpture is given, by the show, the Play mode's response curve or
+// the console, is held to the same motor model as tools/ExtravaganzaCompiler.cpp: after the
+// gear reduction the motor speed must be one the PI loop can hold at MOTOR_MAX_PWM, which
+// also keeps it well inside the int used by diskVelocitiesSet().
+//
+static_assert(MOTOR_MAX_SPEED_IN_RPM <= 32767,
+  "MOTOR_MAX_SPEED_IN_RPM must fit in the int used by diskVelocitiesSet()");
+
+
+//
+// absolute value of a velocity
+//
+constexpr float extravaganzaCheckAbs(float value)
+{
+  return(value < 0 ? -value : value);
+}
+
+
+//
+// check that the motors can reach a disk velocity
+//
+constexpr bool extravaganzaCheckVelocity(float velocityInRPM)
+{
+  return(extravaganzaCheckAbs(velocityInRPM * GEAR_REDUCTION_TO_FINAL_STAGE) <= MOTOR_MAX_SPEED_IN_RPM);
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                                    //
-//                                                 Extravaganza Table                                                 //
+//                                          Extravaganza Show Program Format                                          //
 //                                                                                                                    //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-typedef struct {
-  const byte rgb[3];
-  const float discVelocities[2];
-  const unsigned int transitionDuration; // length of time in ms to transition to this entry
-  const unsigned int postTransitionDuration; // length of time to remain at this entry after transition
-} ExtravaganzaEntry;
-
-const ExtravaganzaEntry PROGMEM ExtravaganzaTable[] = {
-  {rgbmistyBlue,               Chiaroscuro, 5000, 1500},
-  {rgbPureGreen,                cruuuising, 5000, 1500},
-  {rgbMellowYellllllow,         cruuuising, 5000, 1500},
-  {rgbPogchamp,         reversedChiaroscuro, 2500, 500},
-  {rgbMellowYellllllow,         cruuuising, 5000, 1500},
-  {rgbPureGreen,                cruuuising, 5000, 1500},
-  {rgbmistyBlue,                Chiaroscuro, 5000, 750},
-  {rgbPureGreen,         reverseCruuuising, 5000, 1500},
-  {rgbPogchamp,         reversedChiaroscuro, 2500, 500}
+//
+// The Action and Light modes play a show program: a compact list of instructions stored in
+// program memory.  Each instruction is an opcode byte followed by its operands:
+//
+//   STEP(color, preset, transitionMS, postTransitionMS)   transition to a palette color and velocity
+//                                                         preset, then hold them          (5 bytes)
+//   COLOR(color)                                          select a palette color          (2 bytes)
+//   RGB(red, green, blue)                                 select a color directly         (4 bytes)
+//   PRESET(preset)                                        select a velocity preset        (2 bytes)
+//   VELOCITY(outerRPM, innerRPM)                          select velocities directly      (5 bytes)
+//   MOVE(transitionMS, postTransitionMS)                  transition to the selected color and
+//                                                         velocities, then hold them      (3 bytes)
+//   REPEAT(count) ... LOOP()                              play the instructions between count times
+//   RANDOM(count)                                         play one of the next count instructions,
+//                                                         picked at random, and skip the others
+//   JUMP(address)                                         continue at a byte offset in the program
+//   END()                                                 start the show over
+//
+// Durations are stored in units of 50ms (0 - 12750ms), velocities are stored in units of 1/16 RPM.
+//
+const int PROGRAM_DURATION_UNIT_MS = 50;
+const int PROGRAM_VELOCITY_UNITS_PER_RPM = 16;
+const byte PROGRAM_MAX_REPEAT_DEPTH = 4;
+
+enum ProgramOpcode {opEnd, opStep, opMove, opColor, opRGB, opPreset, opVelocity, opRepeat, opLoop, opRandom, opJump};
+
+constexpr byte ProgramOpcodeLength[] PROGMEM = {1, 5, 3, 2, 4, 2, 5, 2, 1, 2, 3};
+
+//
+// a duration in program units, a duration that can not be stored exactly stops the build rather
+// than wrapping around or being cut short
+//
+template <long durationMS> struct ProgramDuration
+{
+  static_assert((durationMS >= 0) && (durationMS <= 255L * PROGRAM_DURATION_UNIT_MS),
+    "show program durations must be 0 - 12750 ms");
+  static_assert(durationMS % PROGRAM_DURATION_UNIT_MS == 0,
+    "show program durations must be a multiple of 50 ms");
+  static constexpr byte units = durationMS / PROGRAM_DURATION_UNIT_MS;
 };
 
-const int ExtravaganzaTableLength = sizeof(ExtravaganzaTable) / sizeof(ExtravaganzaEntry);
+#define PROGRAM_DURATION(ms) ProgramDuration<(ms)>::units
+#define PROGRAM_VELOCITY_LOW(rpm) (byte) ((int) ((rpm) * PROGRAM_VELOCITY_UNITS_PER_RPM) & 0xff)
+#define PROGRAM_VELOCITY_HIGH(rpm) (byte) (((int) ((rpm) * PROGRAM_VELOCITY_UNITS_PER_RPM) >> 8) & 0xff)
+
+#define STEP(color, preset, transitionMS, postMS) opStep, color, preset, PROGRAM_DURATION(transitionMS), PROGRAM_DURATION(postMS)
+#define COLOR(color) opColor, color
+#define RGB(r, g, b) opRGB, r, g, b
+#define PRESET(preset) opPreset, preset
+#define VELOCITY(outerRPM, innerRPM) opVelocity, PROGRAM_VELOCITY_LOW(outerRPM), PROGRAM_VELOCITY_HIGH(outerRPM), PROGRAM_VELOCITY_LOW(innerRPM), PROGRAM_VELOCITY_HIGH(innerRPM)
+#define MOVE(transitionMS, postMS) opMove, PROGRAM_DURATION(transitionMS), PROGRAM_DURATION(postMS)
+#define REPEAT(count) opRepeat, count
+#define LOOP() opLoop
+#define RANDOM(count) opRandom, count
+#define JUMP(address) opJump, (byte) ((address) & 0xff), (byte) ((address) >> 8)
+#define END() opEnd
+
+//
+// the palette, velocity presets and show program are in ExtravaganzaShow.h, it is generated
+// from the show description in tools/ExtravaganzaShow.txt with tools/ExtravaganzaCompiler.cpp,
+// which checks the show against the motors before writing it.  Each is written once there and
+// used to build both the program memory copy and the compile time checks below.  Another
+// generated show can be built in its place by defining EXTRAVAGANZA_SHOW_HEADER as its file
+// name, tools/CheckLongShow.sh does this to check that a long show builds.
+//
+#ifdef EXTRAVAGANZA_SHOW_HEADER
+#include EXTRAVAGANZA_SHOW_HEADER
+#else
+#include "ExtravaganzaShow.h"
+#endif
+
+#define EXTRAVAGANZA_ENTRY(...) {__VA_ARGS__},
+
+const COLOR_ENTRY PROGMEM ExtravaganzaPalette[] = {
+  EXTRAVAGANZA_PALETTE(EXTRAVAGANZA_ENTRY)
+};
+
+const float PROGMEM ExtravaganzaVelocityPresets[][2] = {
+  EXTRAVAGANZA_VELOCITY_PRESETS(EXTRAVAGANZA_ENTRY)
+};
+
+const byte PROGMEM ExtravaganzaProgram[] = {
+  EXTRAVAGANZA_PROGRAM
+};
+
+const int ExtravaganzaProgramLength = sizeof(ExtravaganzaProgram);
+const int ExtravaganzaPaletteLength = sizeof(ExtravaganzaPalette) / sizeof(COLOR_ENTRY);
+const int ExtravaganzaVelocityPresetsLength = sizeof(ExtravaganzaVelocityPresets) / sizeof(ExtravaganzaVelocityPresets[0]);
+
+// ---------------------------------------------------------------------------------
+//                              Extravaganza Show Checks
+// ---------------------------------------------------------------------------------
+
+//
+// Copies of the palette, velocity presets and show program that only exist while compiling,
+// they are used to check the show so that a bad show stops the build rather than misbehaving on
+// the floor.  An instruction that can't be decoded, a palette color or preset that isn't there,
+// a jump into the middle of an instruction or a velocity the motors can't reach stops the build.
+//
+constexpr int ExtravaganzaPaletteCheck[][3] = {
+  EXTRAVAGANZA_PALETTE(EXTRAVAGANZA_ENTRY)
+};
+
+constexpr float ExtravaganzaVelocityPresetsCheck[][2] = {
+  EXTRAVAGANZA_VELOCITY_PRESETS(EXTRAVAGANZA_ENTRY)
+};
+
+constexpr byte ExtravaganzaProgramCheck[] = {
+  EXTRAVAGANZA_PROGRAM
+};
+
+
+//
+// check the colors of the palette from idx to its end
+//
+constexpr bool extravaganzaCheckPaletteColors(int idx)
+{
+  return((idx >= ExtravaganzaPaletteLength) ||
+    ((ExtravaganzaPaletteCheck[idx][red] >= 0) && (ExtravaganzaPaletteCheck[idx][red] <= 255) &&
+     (ExtravaganzaPaletteCheck[idx][green] >= 0) && (ExtravaganzaPaletteCheck[idx][green] <= 255) &&
+     (ExtravaganzaPaletteCheck[idx][blue] >= 0) && (ExtravaganzaPaletteCheck[idx][blue] <= 255) &&
+     extravaganzaCheckPaletteColors(idx + 1)));
+}
+
+
+
+//
+// check the velocity presets from idx to the end
+//
+constexpr bool extravaganzaCheckPresetVelocities(int idx)
+{
+  return((idx >= ExtravaganzaVelocityPresetsLength) ||
+    (extravaganzaCheckVelocity(ExtravaganzaVelocityPresetsCheck[idx][front]) &&
+     extravaganzaCheckVelocity(ExtravaganzaVelocityPresetsCheck[idx][back]) &&
+     extravaganzaCheckPresetVelocities(idx + 1)));
+}
+
+
+
+//
+// The program checks below walk the instructions by recursing, as a constexpr function can't
+// loop in C++11.  Walking one instruction at a time would recurse once per instruction and a
+// long show would go past the compiler's limit on how deep it recurses, so each check splits
+// the instructions it is given in half, checks the first half and then the half after it.  The
+// compiler then only recurses as deep as the log of the number of instructions.  The number of
+// instructions isn't known in advance, the checks are given one per byte of the program, which
+// is never too few, and stop splitting once they are past the end of the program.
+//
+
+//
+// length of the instruction at an address in the program, an unknown opcode is taken as one
+// byte long so the checks can step over it, and there is nothing to step over past the end
+//
+constexpr int extravaganzaCheckInstructionLength(int address)
+{
+  return((address >= ExtravaganzaProgramLength) ? 0 :
+    (ExtravaganzaProgramCheck[address] > opJump) ? 1 : ProgramOpcodeLength[ExtravaganzaProgramCheck[address]]);
+}
+
+
+
+//
+// find the address count instructions after an address, stepping over the first half of them
+// and then the rest
+//
+constexpr int extravaganzaCheckSkip(int address, int count)
+{
+  return((count == 0) ? address :
+    (count == 1) ? address + extravaganzaCheckInstructionLength(address) :
+    extravaganzaCheckSkip(extravaganzaCheckSkip(address, count / 2), count - count / 2));
+}
+
+
+
+//
+// read a 16 bit operand, stored low byte first
+//
+constexpr int extravaganzaCheckWord(int address)
+{
+  return(ExtravaganzaProgramCheck[address] | (ExtravaganzaProgramCheck[address + 1] << 8));
+}
+
+
+
+//
+// read a velocity operand
+//
+constexpr float extravaganzaCheckProgramVelocity(int address)
+{
+  return((float) (extravaganzaCheckWord(address) >= 0x8000 ? extravaganzaCheckWord(address) - 0x10000 :
+    extravaganzaCheckWord(address)) / PROGRAM_VELOCITY_UNITS_PER_RPM);
+}
+
+
+
+//
+// larger and smaller of two values
+//
+constexpr int extravaganzaCheckLarger(int value1, int value2)
+{
+  return(value1 > value2 ? value1 : value2);
+}
+
+constexpr int extravaganzaCheckSmaller(int value1, int value2)
+{
+  return(value1 < value2 ? value1 : value2);
+}
+
+
+
+//
+// check that count instructions from address can be decoded and fit in the program
+//
+constexpr bool extravaganzaCheckInstructions(int address, int count)
+{
+  return((address >= ExtravaganzaProgramLength) ||
+    ((count == 1) ?
+      (ExtravaganzaProgramCheck[address] <= opJump) &&
+      (address + extravaganzaCheckInstructionLength(address) <= ExtravaganzaProgramLength) :
+      extravaganzaCheckInstructions(address, count / 2) &&
+      extravaganzaCheckInstructions(extravaganzaCheckSkip(address, count / 2), count - count / 2)));
+}
+
+
+
+//
+// check that an address is the start of one of count instructions from address
+//  Enter:  target = address to look for
+//
+constexpr bool extravaganzaCheckIsInstruction(int address, int count, int target)
+{
+  return((address < ExtravaganzaProgramLength) && (address <= target) &&
+    ((count == 1) ? (address == target) :
+      extravaganzaCheckIsInstruction(address, count / 2, target) ||
+      extravaganzaCheckIsInstruction(extravaganzaCheckSkip(address, count / 2), count - count / 2, target)));
+}
+
+
+
+//
+// check the operands of one instruction
+//
+constexpr bool extravaganzaCheckOperands(int address)
+{
+  return(
+    (address + extravaganzaCheckInstructionLength(address) > ExtravaganzaProgramLength) ? false :
+    (ExtravaganzaProgramCheck[address] == opStep) ?
+      (ExtravaganzaProgramCheck[address + 1] < ExtravaganzaPaletteLength) &&
+      (ExtravaganzaProgramCheck[address + 2] < ExtravaganzaVelocityPresetsLength) &&
+      (ExtravaganzaProgramCheck[address + 3] + ExtravaganzaProgramCheck[address + 4] > 0) :
+    (ExtravaganzaProgramCheck[address] == opMove) ?
+      (ExtravaganzaProgramCheck[address + 1] + ExtravaganzaProgramCheck[address + 2] > 0) :
+    (ExtravaganzaProgramCheck[address] == opColor) ?
+      (ExtravaganzaProgramCheck[address + 1] < ExtravaganzaPaletteLength) :
+    (ExtravaganzaProgramCheck[address] == opPreset) ?
+      (ExtravaganzaProgramCheck[address + 1] < ExtravaganzaVelocityPresetsLength) :
+    (ExtravaganzaProgramCheck[address] == opVelocity) ?
+      extravaganzaCheckVelocity(extravaganzaCheckProgramVelocity(address + 1)) &&
+      extravaganzaCheckVelocity(extravaganzaCheckProgramVelocity(address + 3)) :
+    (ExtravaganzaProgramCheck[address] == opJump) ?
+      extravaganzaCheckIsInstruction(0, ExtravaganzaProgramLength, extravaganzaCheckWord(address + 1)) :
+    true);
+}
+
+
+
+//
+// check the operands of count instructions from address
+//
+constexpr bool extravaganzaCheckProgramOperands(int address, int count)
+{
+  return((address >= ExtravaganzaProgramLength) ||
+    ((count == 1) ? extravaganzaCheckOperands(address) :
+      extravaganzaCheckProgramOperands(address, count / 2) &&
+      extravaganzaCheckProgramOperands(extravaganzaCheckSkip(address, count / 2), count - count / 2)));
+}
+
+
+
+//
+// change in the number of REPEATs waiting for their LOOP over count instructions from address
+//
+constexpr int extravaganzaCheckRepeatChange(int address, int count)
+{
+  return((address >= ExtravaganzaProgramLength) ? 0 :
+    (count == 1) ?
+      ((ExtravaganzaProgramCheck[address] == opRepeat) ? 1 : (ExtravaganzaProgramCheck[address] == opLoop) ? -1 : 0) :
+    extravaganzaCheckRepeatChange(address, count / 2) +
+    extravaganzaCheckRepeatChange(extravaganzaCheckSkip(address, count / 2), count - count / 2));
+}
+
+
+
+//
+// most and fewest REPEATs waiting for their LOOP after any of count instructions from address,
+// counted from the number waiting before them.  The second half starts from the change over
+// the first half.
+//
+constexpr int extravaganzaCheckRepeatDeepest(int address, int count)
+{
+  return((address >= ExtravaganzaProgramLength) ? 0 :
+    (count == 1) ? extravaganzaCheckRepeatChange(address, 1) :
+    extravaganzaCheckLarger(extravaganzaCheckRepeatDeepest(address, count / 2),
+      extravaganzaCheckRepeatChange(address, count / 2) +
+      extravaganzaCheckRepeatDeepest(extravaganzaCheckSkip(address, count / 2), count - count / 2)));
+}
+
+constexpr int extravaganzaCheckRepeatShallowest(int address, int count)
+{
+  return((address >= ExtravaganzaProgramLength) ? 0 :
+    (count == 1) ? extravaganzaCheckRepeatChange(address, 1) :
+    extravaganzaCheckSmaller(extravaganzaCheckRepeatShallowest(address, count / 2),
+      extravaganzaCheckRepeatChange(address, count / 2) +
+      extravaganzaCheckRepeatShallowest(extravaganzaCheckSkip(address, count / 2), count - count / 2)));
+}
+
+
+
+//
+// check that the REPEATs and LOOPs pair up and are not nested too deep: there is never a LOOP
+// without a REPEAT waiting for it, never more REPEATs waiting than can be kept, and none left
+// waiting at the end
+//
+constexpr bool extravaganzaCheckRepeats()
+{
+  return((extravaganzaCheckRepeatChange(0, ExtravaganzaProgramLength) == 0) &&
+    (extravaganzaCheckRepeatShallowest(0, ExtravaganzaProgramLength) >= 0) &&
+    (extravaganzaCheckRepeatDeepest(0, ExtravaganzaProgramLength) <= PROGRAM_MAX_REPEAT_DEPTH));
+}
+
+
+
+//
+// check that there is a STEP or MOVE in count instructions from address, without one the show
+// never moves
+//
+constexpr bool extravaganzaCheckHasStep(int address, int count)
+{
+  return((address < ExtravaganzaProgramLength) &&
+    ((count == 1) ?
+      (ExtravaganzaProgramCheck[address] == opStep) || (ExtravaganzaProgramCheck[address] == opMove) :
+      extravaganzaCheckHasStep(address, count / 2) ||
+      extravaganzaCheckHasStep(extravaganzaCheckSkip(address, count / 2), count - count / 2)));
+}
+
+
+static_assert(ExtravaganzaPaletteLength > 0,
+  "ExtravaganzaPalette must have at least one color");
+static_assert(extravaganzaCheckPaletteColors(0),
+  "ExtravaganzaPalette colors must be 0 - 255");
+static_assert(extravaganzaCheckPresetVelocities(0),
+  "ExtravaganzaVelocityPresets velocity is faster than the motors can reach (MOTOR_MAX_SPEED_IN_RPM)");
+static_assert(extravaganzaCheckInstructions(0, ExtravaganzaProgramLength),
+  "ExtravaganzaProgram has an unknown opcode or an instruction cut off by the end of the program");
+static_assert(extravaganzaCheckProgramOperands(0, ExtravaganzaProgramLength),
+  "ExtravaganzaProgram has a color or preset that isn't defined, a step that takes no time, a velocity "
+  "the motors can not reach, or a JUMP that doesn't land on an instruction");
+static_assert(extravaganzaCheckRepeats(),
+  "ExtravaganzaProgram REPEATs and LOOPs don't pair up or are nested more than 4 deep");
+static_assert(extravaganzaCheckHasStep(0, ExtravaganzaProgramLength),
+  "ExtravaganzaProgram must have at least one STEP or MOVE");
+
+
+//
+// multiplier for the hash of the show program
+//
+const unsigned long EXTRAVAGANZA_PROGRAM_HASH_MULTIPLIER = 16777619;
+
+
+//
+// square of a hash value
+//
+constexpr unsigned long extravaganzaCheckSquare(unsigned long value)
+{
+  return(value * value);
+}
+
+
+//
+// the hash multiplier raised to a power, squaring the power for half the count so it only
+// recurses as deep as the log of the count
+//
+constexpr unsigned long extravaganzaCheckHashPower(int count)
+{
+  return((count == 0) ? 1 :
+    extravaganzaCheckSquare(extravaganzaCheckHashPower(count / 2)) *
+    ((count % 2) ? EXTRAVAGANZA_PROGRAM_HASH_MULTIPLIER : 1));
+}
+
+
+
+//
+// hash count bytes of the program from address.  The two halves are hashed separately and
+// combined, the same as the checks above, so a long program doesn't go past the compiler's
+// limit on how deep it recurses.
+//
+constexpr unsigned long extravaganzaCheckHash(int address, int count)
+{
+  return((count == 0) ? 0 :
+    (count == 1) ? ExtravaganzaProgramCheck[address] + 1UL :
+    extravaganzaCheckHash(address, count / 2) * extravaganzaCheckHashPower(count - count / 2) +
+    extravaganzaCheckHash(address + count / 2, count - count / 2));
+}
+
+//
+// a hash of the show program, saved with a place in the show so that a place saved while
+// playing a different program isn't used
+//
+constexpr unsigned long ExtravaganzaProgramHash = extravaganzaCheckHash(0, ExtravaganzaProgramLength);
+
+//
+// the state of the show after a step has been read, this is enough to carry on the show from
+// that step
+//
+typedef struct {
+  int programCounter;                           // instruction after the step
+  byte stepNumber;
+  byte repeatDepth;
+  int repeatAddress[PROGRAM_MAX_REPEAT_DEPTH];
+  byte repeatCount[PROGRAM_MAX_REPEAT_DEPTH];
+  byte red;
+  byte green;
+  byte blue;
+  float outerVelocity;
+  float innerVelocity;
+  unsigned int transitionDurationMS;
+  unsigned int postTransitionDurationMS;
+  unsigned int positionMS;                      // time from the start of the step
+  unsigned long passPositionMS;                 // time from the start of the pass to the start of the step
+} EXTRAVAGANZA_STEP_STATE;
+
+//
+// number of steps whose state is kept, enough for the step being executed and the steps that
+// fill the rest of the motion queue
+//
+const byte EXTRAVAGANZA_STEP_STATE_COUNT = MOTION_QUEUE_SIZE / 2;
 
 //
 // function prototypes
 //
 void showActionMode();
 void showLightsMode();
+void showExtravaganzaProgram(COROUTINE *co, bool moveDisksFlg);
+void stopExtravaganzaProgram();
+void extravaganzaProgramReset();
+bool extravaganzaProgramQueueNextStep(bool moveDisksFlg);
+void extravaganzaProgramQueueStep(bool moveDisksFlg, unsigned int transitionDurationMS, unsigned int postTransitionDurationMS);
+void extravaganzaProgramResume(EXTRAVAGANZA_STEP_STATE *state, bool moveDisksFlg);
+unsigned int extravaganzaProgramReadWord(int address);
+unsigned long extravaganzaShowPositionMS();
+bool extravaganzaGetResumePoint(EXTRAVAGANZA_STEP_STATE *state);
+void extravaganzaSetResumePoint(EXTRAVAGANZA_STEP_STATE *state);
+void extravaganzaGetPaletteColor(byte idx, byte *red, byte *green, byte *blue);
+void extravaganzaSetPaletteColor(byte idx, byte red, byte green, byte blue);
+void extravaganzaGetVelocityPreset(byte idx, float *outerVelocity, float *innerVelocity);
+void extravaganzaSetVelocityPreset(byte idx, float outerVelocity, float innerVelocity);
+void extravaganzaRevertOverlay();
+
+
+//
+// global variables used to schedule the show on an absolute timeline
+//
+unsigned long extravaganzaShowStartTimeMS;      // time (from millis()) the show started
+unsigned long extravaganzaShowScheduledMS;      // offset from the show start to the next segment to queue
+unsigned long extravaganzaShowPassScheduledMS;  // offset from the show start to the pass being queued
+byte extravaganzaDisplayedStep;
+bool extravaganzaShowRunningFlg;
+
+
+//
+// global variables used to resume the show from where it was stopped, the state of each step
+// queued is kept until the step has been executed
+//
+EXTRAVAGANZA_STEP_STATE extravaganzaStepStates[EXTRAVAGANZA_STEP_STATE_COUNT];
+unsigned long extravaganzaStepStartTimeMS[EXTRAVAGANZA_STEP_STATE_COUNT];
+bool extravaganzaStepStateValidFlg[EXTRAVAGANZA_STEP_STATE_COUNT];
+byte extravaganzaStepStateNextIdx;              // the step numbers start over each pass, so they are kept in turn
+EXTRAVAGANZA_STEP_STATE extravaganzaResumeState;
+bool extravaganzaResumeFlg;
+
+
+//
+// global variables used by the show program interpreter
+//
+int extravaganzaProgramCounter;
+byte extravaganzaProgramStepNumber;
+byte extravaganzaProgramRed;
+byte extravaganzaProgramGreen;
+byte extravaganzaProgramBlue;
+float extravaganzaProgramOuterVelocity;
+float extravaganzaProgramInnerVelocity;
+byte extravaganzaProgramRepeatDepth;
+int extravaganzaProgramRepeatAddress[PROGRAM_MAX_REPEAT_DEPTH];
+byte extravaganzaProgramRepeatCount[PROGRAM_MAX_REPEAT_DEPTH];
+
+
+//
+// global variables holding the overlay of the palette and velocity presets, an entry
+// changed from the serial console is kept here and used in place of the one in program memory
+// until the overlay is reverted or the power is turned off
+//
+byte extravaganzaPaletteOverlay[ExtravaganzaPaletteLength][3];
+bool extravaganzaPaletteOverlayFlg[ExtravaganzaPaletteLength];
+float extravaganzaPresetOverlay[ExtravaganzaVelocityPresetsLength][2];
+bool extravaganzaPresetOverlayFlg[ExtravaganzaVelocityPresetsLength];
 
 
 // ---------------------------------------------------------------------------------
@@ -76,208 +573,603 @@ void showLightsMode();
 // ---------------------------------------------------------------------------------
 
 //
-// run the Action mode, return when no longer in this mode
+// run the Action mode
 //
 void showActionMode()
 {
-  int idx = 0;
-  int lastTableIdx;
+  showExtravaganzaProgram(&modeCoroutine, true);
+}
 
-  //
-  // run through the table, executing the motions and background color changes
-  //
-  lastTableIdx = ExtravaganzaTableLength - 1;
+
+// ---------------------------------------------------------------------------------
+//                                The Lights Mode
+// ---------------------------------------------------------------------------------
+
+//
+// run the Lights mode
+//
+void showLightsMode()
+{
+  showExtravaganzaProgram(&modeCoroutine, false);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                            Extravaganza Program Player
+// ---------------------------------------------------------------------------------
+
+//
+// play the show program over and over, carrying on from where it was last stopped, or from
+// the beginning.  Every segment is scheduled from the start of the show using the sum of the
+// durations before it, so a late start never pushes back the steps that follow.  The
+// background process executes the segments, all that is needed here is to keep the queue
+// topped up each time a step starts.
+//  Enter:  co -> coroutine state
+//          moveDisksFlg = true to move the disks, false to keep them stopped
+//
+void showExtravaganzaProgram(COROUTINE *co, bool moveDisksFlg)
+{
+  CO_BEGIN(co);
+  extravaganzaProgramReset();
+  extravaganzaShowStartTimeMS = millis();
+  extravaganzaShowScheduledMS = 0;
+  extravaganzaShowPassScheduledMS = 0;
+  motionQueueStart();
+  extravaganzaDisplayedStep = 0xff;
+
+  if (extravaganzaResumeFlg)
+    extravaganzaProgramResume(&extravaganzaResumeState, moveDisksFlg);
+  extravaganzaShowRunningFlg = true;
 
   while (true)
   {
-    for (idx = 0; idx <= lastTableIdx; idx++)
+    //
+    // queue the transition and post transition segments of as many steps as will fit
+    //
+    while (motionQueueSpace() >= 2)
     {
-      //
-      // get the disk velocities from the table and transition from the current velocities
-      //   to new velocities over the given duration period
-      //
-      diskVelocitiesStartTransition(
-        pgm_read_float(&ExtravaganzaTable[idx].discVelocities[front]),
-        pgm_read_float(&ExtravaganzaTable[idx].discVelocities[back]),
-        pgm_read_word(&ExtravaganzaTable[idx].transitionDuration));
-
-      //
-      // get the backlight color from the table and transition from the current RGB values
-      //   to new values over the given duration period
-      //
-      backlightStartTransition(
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[red]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[green]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[blue]),
-        pgm_read_word(&ExtravaganzaTable[idx].transitionDuration));
-
-      //
-      // update the LCD display with the table entry number currently being executed
-      //
-      LCDSetCursorXY(26, 3);
-      LCDPrintUnsignedIntWithPadding(idx, 3, ' ');
-
-
-      //
-      // execute other task while waiting for transition to complete
-      //
-      while (diskVelocitiesTransitionIsFinished() == false)
-      {
-        //
-        // check for button presses...
-        //
-        executeTasks();
+      if (!extravaganzaProgramQueueNextStep(moveDisksFlg))
+        break;
+    }
 
-        //
-        // return if no longer in this mode
-        //
-        if (sculptureMode != actionMode)
-          return;
-      }
-
-
-
-      //
-      // get the disk velocities from the table and transition from the current velocities
-      //   to new velocities over the given duration period
-      //
-      diskVelocitiesStartTransition(
-        pgm_read_float(&ExtravaganzaTable[idx].discVelocities[front]),
-        pgm_read_float(&ExtravaganzaTable[idx].discVelocities[back]),
-        pgm_read_word(&ExtravaganzaTable[idx].postTransitionDuration));
-
-      //
-      // get the backlight color from the table and transition from the current RGB values
-      //   to new values over the given duration period
-      //
-      backlightStartTransition(
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[red]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[green]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[blue]),
-        pgm_read_word(&ExtravaganzaTable[idx].postTransitionDuration));
-
-      //
-      // update the LCD display with the table entry number currently being executed
-      //
-      LCDSetCursorXY(26, 3);
-      LCDPrintUnsignedIntWithPadding(idx, 3, ' ');
-
-
-      //
-      // execute other task while waiting for transition to complete
-      //
-      while (diskVelocitiesTransitionIsFinished() == false)
-      {
-        //
-        // check for button presses...
-        //
-        executeTasks();
+    //
+    // update the LCD display with the step number currently being executed, at power up the
+    // first steps are queued before the LCD is set up
+    //
+    CO_AWAIT(co, modeDisplayReadyFlg);
+    extravaganzaDisplayedStep = motionQueueCurrentTag();
+    LCDSetCursorXY(26, 3);
+    LCDPrintUnsignedIntWithPadding(extravaganzaDisplayedStep, 3, ' ');
 
-        //
-        // return if no longer in this mode
-        //
-        if (sculptureMode != actionMode)
-          return;
-      }
-    }
+    //
+    // wait for the next step to start
+    //
+    CO_AWAIT(co, motionQueueCurrentTag() != extravaganzaDisplayedStep);
   }
+  CO_END(co);
+}
+
+
+
+//
+// stop playing the show program, the disks and backlight are left where they are.  The step
+// being executed is remembered so the show carries on from it the next time it is played.
+//
+void stopExtravaganzaProgram()
+{
+  extravaganzaResumeFlg = extravaganzaGetResumePoint(&extravaganzaResumeState);
+  extravaganzaShowRunningFlg = false;
+  motionQueueStop();
+}
+
+
+
+//
+// get the current position in the show, or where it was stopped if it isn't playing
+//  Exit:  number of milliseconds since the start of the current pass through the program
+//
+unsigned long extravaganzaShowPositionMS()
+{
+  EXTRAVAGANZA_STEP_STATE state;
+
+  if (!extravaganzaGetResumePoint(&state))
+    return(0);
+
+  return(state.passPositionMS + state.positionMS);
+}
+
+
+
+//
+// get the place in the show to carry on from: the step being executed if the show is playing,
+// otherwise where it was last stopped
+//  Enter:  state -> filled in with the state of the step and the time into it
+//  Exit:   true returned if there is a place to carry on from, false to start from the beginning
+//
+bool extravaganzaGetResumePoint(EXTRAVAGANZA_STEP_STATE *state)
+{
+  unsigned long currentTime;
+  unsigned long positionMS;
+  unsigned long stepDurationMS;
+  int currentIdx;
+
+  if (!extravaganzaShowRunningFlg)
+  {
+    if (extravaganzaResumeFlg)
+      *state = extravaganzaResumeState;
+    return(extravaganzaResumeFlg);
+  }
+
+  //
+  // the step being executed is the last one to have started
+  //
+  currentTime = millis();
+  currentIdx = -1;
+  for (byte i = 0; i < EXTRAVAGANZA_STEP_STATE_COUNT; i++)
+  {
+    if (!extravaganzaStepStateValidFlg[i] || ((long) (currentTime - extravaganzaStepStartTimeMS[i]) < 0))
+      continue;
+
+    if ((currentIdx < 0) || ((long) (extravaganzaStepStartTimeMS[i] - extravaganzaStepStartTimeMS[currentIdx]) > 0))
+      currentIdx = i;
+  }
+
+  if (currentIdx < 0)
+    return(false);
+
+  //
+  // the show holds the last step if the queue runs dry, so don't go past its end
+  //
+  *state = extravaganzaStepStates[currentIdx];
+  positionMS = currentTime - extravaganzaStepStartTimeMS[currentIdx];
+  stepDurationMS = (unsigned long) state->transitionDurationMS + state->postTransitionDurationMS;
+  if (positionMS > stepDurationMS)
+    positionMS = stepDurationMS;
+  state->positionMS = positionMS;
+  return(true);
+}
+
+
+
+//
+// set the place in the show to carry on from the next time it is played, such as one saved
+// before the power was turned off
+//  Enter:  state -> state of the step to carry on from
+//
+void extravaganzaSetResumePoint(EXTRAVAGANZA_STEP_STATE *state)
+{
+  extravaganzaResumeState = *state;
+  extravaganzaResumeFlg = true;
 }
 
 
 // ---------------------------------------------------------------------------------
-//                                The Lights Mode
+//                          Extravaganza Program Interpreter
 // ---------------------------------------------------------------------------------
 
 //
-// run the Lights mode, return when no longer in this mode
+// start the show program from the beginning
 //
-void showLightsMode()
+void extravaganzaProgramReset()
 {
-  int idx = 0;
-  int lastTableIdx;
+  extravaganzaProgramCounter = 0;
+  extravaganzaProgramStepNumber = 0;
+  extravaganzaProgramRepeatDepth = 0;
+  extravaganzaProgramRed = 0;
+  extravaganzaProgramGreen = 0;
+  extravaganzaProgramBlue = 0;
+  extravaganzaProgramOuterVelocity = 0;
+  extravaganzaProgramInnerVelocity = 0;
+
+  for (byte i = 0; i < EXTRAVAGANZA_STEP_STATE_COUNT; i++)
+    extravaganzaStepStateValidFlg[i] = false;
+  extravaganzaStepStateNextIdx = 0;
+}
+
+
+
+//
+// carry on the show from a step, finishing that step then continuing with the instructions
+// after it.  The disks are often stopped, such as after a power failure, so the step's whole
+// transition is played again, then the time left of its hold.
+//  Enter:  state -> state of the step to carry on from
+//          moveDisksFlg = true to move the disks, false to keep them stopped
+//
+void extravaganzaProgramResume(EXTRAVAGANZA_STEP_STATE *state, bool moveDisksFlg)
+{
+  unsigned int heldMS;
+  unsigned int postTransitionDurationMS;
+
+  if (state->programCounter >= ExtravaganzaProgramLength)
+    return;
+
+  extravaganzaProgramCounter = state->programCounter;
+  extravaganzaProgramStepNumber = state->stepNumber;
+  extravaganzaProgramRepeatDepth = state->repeatDepth;
+  if (extravaganzaProgramRepeatDepth > PROGRAM_MAX_REPEAT_DEPTH)
+    extravaganzaProgramRepeatDepth = 0;
+
+  for (byte i = 0; i < PROGRAM_MAX_REPEAT_DEPTH; i++)
+  {
+    extravaganzaProgramRepeatAddress[i] = state->repeatAddress[i];
+    extravaganzaProgramRepeatCount[i] = state->repeatCount[i];
+  }
+
+  extravaganzaProgramRed = state->red;
+  extravaganzaProgramGreen = state->green;
+  extravaganzaProgramBlue = state->blue;
+  extravaganzaProgramOuterVelocity = state->outerVelocity;
+  extravaganzaProgramInnerVelocity = state->innerVelocity;
 
   //
-  // run through the table, executing the motions and background color changes
+  // the step is queued first, so its pass started that long before the show did
   //
-  lastTableIdx = ExtravaganzaTableLength - 1;
+  extravaganzaShowPassScheduledMS = extravaganzaShowScheduledMS - state->passPositionMS;
 
-  while (true)
+  //
+  // hold for the rest of the step, at least one duration unit
+  //
+  heldMS = 0;
+  if (state->positionMS > state->transitionDurationMS)
+    heldMS = state->positionMS - state->transitionDurationMS;
+
+  postTransitionDurationMS = PROGRAM_DURATION_UNIT_MS;
+  if (state->postTransitionDurationMS > heldMS + PROGRAM_DURATION_UNIT_MS)
+    postTransitionDurationMS = state->postTransitionDurationMS - heldMS;
+
+  extravaganzaProgramQueueStep(moveDisksFlg, state->transitionDurationMS, postTransitionDurationMS);
+}
+
+
+
+//
+// execute show program instructions until a step has been added to the motion queue, the
+// queue must have room for 2 segments
+//  Enter:  moveDisksFlg = true to move the disks, false to keep them stopped
+//  Exit:   true returned if a step was queued, false returned if the program has no steps
+//
+bool extravaganzaProgramQueueNextStep(bool moveDisksFlg)
+{
+  byte opcode;
+  int address;
+  int nextAddress;
+  int randomGroupEnd;
+  byte entryIdx;
+  byte count;
+  byte choice;
+  byte instructionCount;
+  unsigned int transitionDurationMS;
+  unsigned int postTransitionDurationMS;
+
+  randomGroupEnd = -1;
+
+  //
+  // limit the number of instructions executed, so a program that never reaches a step
+  // can not hang the sculpture
+  //
+  for (instructionCount = 0; instructionCount < 100; instructionCount++)
   {
-    for (idx = 0; idx <= lastTableIdx; idx++)
+    address = extravaganzaProgramCounter;
+    if (address >= ExtravaganzaProgramLength)
+      address = 0;
+
+    opcode = pgm_read_byte(&ExtravaganzaProgram[address]);
+    if (opcode > opJump)
+      opcode = opEnd;
+
+    //
+    // determine where the next instruction is, after the last instruction picked by
+    // RANDOM continue after the whole group
+    //
+    nextAddress = address + pgm_read_byte(&ProgramOpcodeLength[opcode]);
+    if (randomGroupEnd >= 0)
     {
+      nextAddress = randomGroupEnd;
+      randomGroupEnd = -1;
+    }
 
-      diskVelocitiesStartTransition(0, 0, pgm_read_word(&ExtravaganzaTable[idx].transitionDuration));
-
-      //
-      // get the backlight color from the table and transition from the current RGB values
-      //   to new values over the given duration period
-      //
-      backlightStartTransition(
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[red]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[green]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[blue]),
-        pgm_read_word(&ExtravaganzaTable[idx].transitionDuration));
-
-      //
-      // update the LCD display with the table entry number currently being executed
-      //
-      LCDSetCursorXY(26, 3);
-      LCDPrintUnsignedIntWithPadding(idx, 3, ' ');
-
-
-      //
-      // execute other task while waiting for transition to complete
-      //
-      while (diskVelocitiesTransitionIsFinished() == false)
-      {
-        //
-        // check for button presses...
-        //
-        executeTasks();
+    switch(opcode)
+    {
+      case opEnd:
+        extravaganzaProgramCounter = 0;
+        extravaganzaProgramStepNumber = 0;
+        extravaganzaProgramRepeatDepth = 0;
+        extravaganzaShowPassScheduledMS = extravaganzaShowScheduledMS;
+        continue;
+
+      case opStep:
+        entryIdx = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        extravaganzaGetPaletteColor(entryIdx, &extravaganzaProgramRed, &extravaganzaProgramGreen, &extravaganzaProgramBlue);
+        entryIdx = pgm_read_byte(&ExtravaganzaProgram[address + 2]);
+        extravaganzaGetVelocityPreset(entryIdx, &extravaganzaProgramOuterVelocity, &extravaganzaProgramInnerVelocity);
+        transitionDurationMS = pgm_read_byte(&ExtravaganzaProgram[address + 3]) * PROGRAM_DURATION_UNIT_MS;
+        postTransitionDurationMS = pgm_read_byte(&ExtravaganzaProgram[address + 4]) * PROGRAM_DURATION_UNIT_MS;
+        break;
+
+      case opMove:
+        transitionDurationMS = pgm_read_byte(&ExtravaganzaProgram[address + 1]) * PROGRAM_DURATION_UNIT_MS;
+        postTransitionDurationMS = pgm_read_byte(&ExtravaganzaProgram[address + 2]) * PROGRAM_DURATION_UNIT_MS;
+        break;
+
+      case opColor:
+        entryIdx = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        extravaganzaGetPaletteColor(entryIdx, &extravaganzaProgramRed, &extravaganzaProgramGreen, &extravaganzaProgramBlue);
+        extravaganzaProgramCounter = nextAddress;
+        continue;
 
+      case opRGB:
+        extravaganzaProgramRed = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        extravaganzaProgramGreen = pgm_read_byte(&ExtravaganzaProgram[address + 2]);
+        extravaganzaProgramBlue = pgm_read_byte(&ExtravaganzaProgram[address + 3]);
+        extravaganzaProgramCounter = nextAddress;
+        continue;
+
+      case opPreset:
+        entryIdx = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        extravaganzaGetVelocityPreset(entryIdx, &extravaganzaProgramOuterVelocity, &extravaganzaProgramInnerVelocity);
+        extravaganzaProgramCounter = nextAddress;
+        continue;
+
+      case opVelocity:
+        extravaganzaProgramOuterVelocity = (float) (int) extravaganzaProgramReadWord(address + 1) / PROGRAM_VELOCITY_UNITS_PER_RPM;
+        extravaganzaProgramInnerVelocity = (float) (int) extravaganzaProgramReadWord(address + 3) / PROGRAM_VELOCITY_UNITS_PER_RPM;
+        extravaganzaProgramCounter = nextAddress;
+        continue;
+
+      case opRepeat:
         //
-        // return if no longer in this mode
+        // remember where the loop starts and how many more times to play it
         //
-        if (sculptureMode != lightMode)
-          return;
-      }
-
-
-      diskVelocitiesStartTransition(0, 0, pgm_read_word(&ExtravaganzaTable[idx].postTransitionDuration));
-
-      //
-      // get the backlight color from the table and transition from the current RGB values
-      //   to new values over the given duration period
-      //
-      backlightStartTransition(
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[red]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[green]),
-        pgm_read_byte(&ExtravaganzaTable[idx].rgb[blue]),
-        pgm_read_word(&ExtravaganzaTable[idx].postTransitionDuration));
-
-      //
-      // update the LCD display with the table entry number currently being executed
-      //
-      LCDSetCursorXY(26, 3);
-      LCDPrintUnsignedIntWithPadding(idx, 3, ' ');
-
-
-      //
-      // execute other task while waiting for transition to complete
-      //
-      while (diskVelocitiesTransitionIsFinished() == false)
-      {
+        count = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        if ((count > 0) && (extravaganzaProgramRepeatDepth < PROGRAM_MAX_REPEAT_DEPTH))
+        {
+          extravaganzaProgramRepeatAddress[extravaganzaProgramRepeatDepth] = nextAddress;
+          extravaganzaProgramRepeatCount[extravaganzaProgramRepeatDepth] = count - 1;
+          extravaganzaProgramRepeatDepth++;
+        }
+        extravaganzaProgramCounter = nextAddress;
+        continue;
+
+      case opLoop:
+        if (extravaganzaProgramRepeatDepth == 0)
+        {
+          extravaganzaProgramCounter = nextAddress;
+          continue;
+        }
+
+        if (extravaganzaProgramRepeatCount[extravaganzaProgramRepeatDepth - 1] == 0)
+        {
+          extravaganzaProgramRepeatDepth--;
+          extravaganzaProgramCounter = nextAddress;
+        }
+        else
+        {
+          extravaganzaProgramRepeatCount[extravaganzaProgramRepeatDepth - 1]--;
+          extravaganzaProgramCounter = extravaganzaProgramRepeatAddress[extravaganzaProgramRepeatDepth - 1];
+        }
+        continue;
+
+      case opRandom:
         //
-        // check for button presses...
+        // find the end of the group of instructions, then the one to play
         //
-        executeTasks();
+        count = pgm_read_byte(&ExtravaganzaProgram[address + 1]);
+        if (count == 0)
+        {
+          extravaganzaProgramCounter = nextAddress;
+          continue;
+        }
+
+        choice = random(count);
+        randomGroupEnd = nextAddress;
+        extravaganzaProgramCounter = ExtravaganzaProgramLength;
+        while (count > 0)
+        {
+          if (randomGroupEnd >= ExtravaganzaProgramLength)
+            break;
+          if (choice == 0)
+            extravaganzaProgramCounter = randomGroupEnd;
+          opcode = pgm_read_byte(&ExtravaganzaProgram[randomGroupEnd]);
+          if (opcode > opJump)
+            opcode = opEnd;
+          randomGroupEnd += pgm_read_byte(&ProgramOpcodeLength[opcode]);
+          choice--;
+          count--;
+        }
 
         //
-        // return if no longer in this mode
+        // a group cut short by the end of the program can pick past its end, carry on from
+        // the beginning the same as an instruction that runs off the end
         //
-        if (sculptureMode != lightMode)
-          return;
-      }
+        if (extravaganzaProgramCounter >= ExtravaganzaProgramLength)
+        {
+          extravaganzaProgramCounter = 0;
+          randomGroupEnd = -1;
+        }
+        continue;
+
+      case opJump:
+        extravaganzaProgramCounter = extravaganzaProgramReadWord(address + 1);
+        continue;
     }
+
+    //
+    // a step or move has been read, queue it
+    //
+    extravaganzaProgramCounter = nextAddress;
+    extravaganzaProgramQueueStep(moveDisksFlg, transitionDurationMS, postTransitionDurationMS);
+    return(true);
+  }
+
+  return(false);
+}
+
+
+
+//
+// queue the transition segment of a step followed by the segment that holds the values, the
+// state of the show after the step is kept so the show can carry on from it.  The queue must
+// have room for 2 segments.
+//  Enter:  moveDisksFlg = true to move the disks, false to keep them stopped
+//          transitionDurationMS = time to transition to the step's color and velocities
+//          postTransitionDurationMS = time to hold them
+//
+void extravaganzaProgramQueueStep(bool moveDisksFlg, unsigned int transitionDurationMS, unsigned int postTransitionDurationMS)
+{
+  MOTION_SEGMENT segment;
+  EXTRAVAGANZA_STEP_STATE *state;
+  byte stateIdx;
+
+  //
+  // save the state after this step
+  //
+  stateIdx = extravaganzaStepStateNextIdx;
+  extravaganzaStepStateNextIdx = (stateIdx + 1) % EXTRAVAGANZA_STEP_STATE_COUNT;
+  state = &extravaganzaStepStates[stateIdx];
+  state->programCounter = extravaganzaProgramCounter;
+  state->stepNumber = extravaganzaProgramStepNumber;
+  state->repeatDepth = extravaganzaProgramRepeatDepth;
+  for (byte i = 0; i < PROGRAM_MAX_REPEAT_DEPTH; i++)
+  {
+    state->repeatAddress[i] = extravaganzaProgramRepeatAddress[i];
+    state->repeatCount[i] = extravaganzaProgramRepeatCount[i];
   }
+  state->red = extravaganzaProgramRed;
+  state->green = extravaganzaProgramGreen;
+  state->blue = extravaganzaProgramBlue;
+  state->outerVelocity = extravaganzaProgramOuterVelocity;
+  state->innerVelocity = extravaganzaProgramInnerVelocity;
+  state->transitionDurationMS = transitionDurationMS;
+  state->postTransitionDurationMS = postTransitionDurationMS;
+  state->positionMS = 0;
+  state->passPositionMS = extravaganzaShowScheduledMS - extravaganzaShowPassScheduledMS;
+  extravaganzaStepStartTimeMS[stateIdx] = extravaganzaShowStartTimeMS + extravaganzaShowScheduledMS;
+  extravaganzaStepStateValidFlg[stateIdx] = true;
+
+  //
+  // queue the segments
+  //
+  if (moveDisksFlg)
+  {
+    segment.outerDiskVelocityInRPM = extravaganzaProgramOuterVelocity;
+    segment.innerDiskVelocityInRPM = extravaganzaProgramInnerVelocity;
+  }
+  else
+  {
+    segment.outerDiskVelocityInRPM = 0;
+    segment.innerDiskVelocityInRPM = 0;
+  }
+
+  segment.red = extravaganzaProgramRed;
+  segment.green = extravaganzaProgramGreen;
+  segment.blue = extravaganzaProgramBlue;
+  segment.tag = extravaganzaProgramStepNumber;
+  extravaganzaProgramStepNumber++;
+
+  segment.startTimeMS = extravaganzaShowStartTimeMS + extravaganzaShowScheduledMS;
+  segment.durationMS = transitionDurationMS;
+  motionQueueAdd(&segment);
+  extravaganzaShowScheduledMS += segment.durationMS;
+
+  segment.startTimeMS = extravaganzaShowStartTimeMS + extravaganzaShowScheduledMS;
+  segment.durationMS = postTransitionDurationMS;
+  motionQueueAdd(&segment);
+  extravaganzaShowScheduledMS += segment.durationMS;
+}
+
+
+
+//
+// read a 16 bit operand from the show program, stored low byte first
+//  Enter:  address = byte offset in the program of the operand
+//
+unsigned int extravaganzaProgramReadWord(int address)
+{
+  return(pgm_read_byte(&ExtravaganzaProgram[address]) | (pgm_read_byte(&ExtravaganzaProgram[address + 1]) << 8));
+}
+
+
+
+// ---------------------------------------------------------------------------------
+//                         Palette and Velocity Preset Overlay
+// ---------------------------------------------------------------------------------
+
+//
+// get a palette color, from the overlay if it has been changed
+//  Enter:  idx = palette color
+//          red, green, blue -> set to the color
+//
+void extravaganzaGetPaletteColor(byte idx, byte *red, byte *green, byte *blue)
+{
+  if ((idx < ExtravaganzaPaletteLength) && extravaganzaPaletteOverlayFlg[idx])
+  {
+    *red = extravaganzaPaletteOverlay[idx][0];
+    *green = extravaganzaPaletteOverlay[idx][1];
+    *blue = extravaganzaPaletteOverlay[idx][2];
+    return;
+  }
+
+  *red = pgm_read_byte(&ExtravaganzaPalette[idx].red);
+  *green = pgm_read_byte(&ExtravaganzaPalette[idx].green);
+  *blue = pgm_read_byte(&ExtravaganzaPalette[idx].blue);
+}
+
+
+
+//
+// change a palette color in the overlay, the show uses it from its next step
+//  Enter:  idx = palette color, less than ExtravaganzaPaletteLength
+//          red, green, blue = new color
+//
+void extravaganzaSetPaletteColor(byte idx, byte red, byte green, byte blue)
+{
+  extravaganzaPaletteOverlay[idx][0] = red;
+  extravaganzaPaletteOverlay[idx][1] = green;
+  extravaganzaPaletteOverlay[idx][2] = blue;
+  extravaganzaPaletteOverlayFlg[idx] = true;
+}
+
+
+
+//
+// get a velocity preset, from the overlay if it has been changed
+//  Enter:  idx = velocity preset
+//          outerVelocity, innerVelocity -> set to the disk velocities in RPM
+//
+void extravaganzaGetVelocityPreset(byte idx, float *outerVelocity, float *innerVelocity)
+{
+  if ((idx < ExtravaganzaVelocityPresetsLength) && extravaganzaPresetOverlayFlg[idx])
+  {
+    *outerVelocity = extravaganzaPresetOverlay[idx][front];
+    *innerVelocity = extravaganzaPresetOverlay[idx][back];
+    return;
+  }
+
+  *outerVelocity = pgm_read_float(&ExtravaganzaVelocityPresets[idx][front]);
+  *innerVelocity = pgm_read_float(&ExtravaganzaVelocityPresets[idx][back]);
+}
+
+
+
+//
+// change a velocity preset in the overlay, the show uses it from its next step
+//  Enter:  idx = velocity preset, less than ExtravaganzaVelocityPresetsLength
+//          outerVelocity, innerVelocity = new disk velocities in RPM
+//
+void extravaganzaSetVelocityPreset(byte idx, float outerVelocity, float innerVelocity)
+{
+  extravaganzaPresetOverlay[idx][front] = outerVelocity;
+  extravaganzaPresetOverlay[idx][back] = innerVelocity;
+  extravaganzaPresetOverlayFlg[idx] = true;
+}
+
+
+
+//
+// throw away the changes in the overlay, going back to the entries in program memory
+//
+void extravaganzaRevertOverlay()
+{
+  memset(extravaganzaPaletteOverlayFlg, 0, sizeof(extravaganzaPaletteOverlayFlg));
+  memset(extravaganzaPresetOverlayFlg, 0, sizeof(extravaganzaPresetOverlayFlg));
 }
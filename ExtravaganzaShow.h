@@ -0,0 +1,61 @@
+#pragma once
+
+//      ******************************************************************
+//      *                                                                *
+//      *                       Extravaganza Show                        *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Generated by tools/ExtravaganzaCompiler.cpp from tools/ExtravaganzaShow.txt
+// Do not edit this file, edit the show description and compile it again.  Extravaganza.h builds
+// the program memory palette, presets and program from these lists, and checks them as it compiles.
+//
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//                                          Extravaganza Palette and Presets                                          //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+enum PaletteColor {paletteMistyBlue, palettePureGreen, paletteMellowYellllllow, palettePogchamp, palettePinkForAllGenders, paletteRazzleDazzle, paletteSoftBlue};
+
+#define EXTRAVAGANZA_PALETTE(ENTRY) \
+  ENTRY(71, 158, 239) \
+  ENTRY(0, 255, 0) \
+  ENTRY(255, 255, 0) \
+  ENTRY(108, 249, 89) \
+  ENTRY(188, 42, 167) \
+  ENTRY(3, 121, 198) \
+  ENTRY(0, 207, 180)
+
+enum VelocityPreset {presetOff, presetDizzyUp, presetBlaster, presetTrippingBalls, presetMoreBallTripping, presetChiaroscuro, presetReversedChiaroscuro, presetCruuuising, presetReverseCruuuising};
+
+#define EXTRAVAGANZA_VELOCITY_PRESETS(ENTRY) \
+  ENTRY(0.0, 0.0) \
+  ENTRY(-10.0, 10.0) \
+  ENTRY(15.0, 20.0) \
+  ENTRY(20.0, -20.0) \
+  ENTRY(-20.0, 20.0) \
+  ENTRY(30.0, -30.0) \
+  ENTRY(-30.0, 30.0) \
+  ENTRY(30.0, 15.0) \
+  ENTRY(10.0, 20.0)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                                    //
+//                                             Extravaganza Show Program                                              //
+//                                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define EXTRAVAGANZA_PROGRAM \
+  STEP(paletteMistyBlue, presetChiaroscuro, 5000, 1500),                 /* 0 */ \
+  STEP(palettePureGreen, presetCruuuising, 5000, 1500),                  /* 5 */ \
+  STEP(paletteMellowYellllllow, presetCruuuising, 5000, 1500),           /* 10 */ \
+  STEP(palettePogchamp, presetReversedChiaroscuro, 2500, 500),           /* 15 */ \
+  STEP(paletteMellowYellllllow, presetCruuuising, 5000, 1500),           /* 20 */ \
+  STEP(palettePureGreen, presetCruuuising, 5000, 1500),                  /* 25 */ \
+  STEP(paletteMistyBlue, presetChiaroscuro, 5000, 750),                  /* 30 */ \
+  STEP(palettePureGreen, presetReverseCruuuising, 5000, 1500),           /* 35 */ \
+  STEP(palettePogchamp, presetReversedChiaroscuro, 2500, 500),           /* 40 */ \
+  END()                                                                  /* 45 */
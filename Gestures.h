@@ -0,0 +1,206 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Gestures Seen by the Ultrasonic                *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// A small state machine watches each ultrasonic sample as it is measured and recognizes two
+// gestures:
+//
+//   A hand wave: something comes close to the sensor and goes away again quickly, while the
+//   space beyond it is clear or well behind the hand.
+//
+//   A step in, step back: a visitor standing still steps toward the sculpture and then back to
+//   about where they were.
+//
+// The raw samples are used rather than the filtered distance, the median filter would remove a
+// quick wave completely.  It runs in the main loop and only needs a few bytes of RAM.
+//
+
+//
+// gesture events
+//
+enum GestureEvent {gestureNone, gestureWave, gestureStepInStepBack};
+
+//
+// gesture constants, you may tune these
+//
+const unsigned int GESTURE_WAVE_NEAR_MM = 300;           // a hand must come closer than this
+const unsigned int GESTURE_WAVE_MAX_MS = 800;            // and go away again within this
+const unsigned int GESTURE_STEP_MIN_MM = 250;            // a step in must be at least this far
+const unsigned int GESTURE_STEP_RETURN_MM = 120;         // the step back must return this close to the start
+const unsigned int GESTURE_STEP_MAX_MS = 2500;           // the step in and back must take less than this
+const byte GESTURE_BASELINE_SHIFT = 2;                  // the standing distance follows each sample by 1/4
+
+//
+// states of the gesture recognizer
+//
+enum GestureState {gestureWaitingState, gestureHandNearState, gestureSteppedInState};
+
+//
+// function prototypes
+//
+void gestureInitialize();
+byte gestureCheck();
+byte gestureProcessSample(unsigned int distanceInMM, unsigned long sampleTimeMS);
+
+
+// ---------------------------------------------------------------------------------
+//                                 Gesture Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the gesture recognizer
+//
+byte gestureState;
+byte gestureSampleCount;                        // next ultrasonic sample to look at
+unsigned int gestureBaselineMM;                 // where the visitor is standing, 0 if nobody
+unsigned long gestureStartTimeMS;
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the gesture recognizer, starting with the next sample measured
+//
+void gestureInitialize()
+{
+  gestureState = gestureWaitingState;
+  gestureBaselineMM = 0;
+  gestureSampleCount = ultrasonicGetSampleCount();
+}
+
+
+
+//
+// check for a gesture in the samples measured since the last check, call this often from the
+// main loop
+//  Exit:  gesture event returned, gestureNone if none
+//
+byte gestureCheck()
+{
+  byte sampleCount;
+  byte event;
+  unsigned long sampleTimeMS;
+
+  //
+  // if the samples have been missed, skip to the oldest one still in the ring
+  //
+  sampleCount = ultrasonicGetSampleCount();
+  if ((byte) (sampleCount - gestureSampleCount) > ULTRASONIC_SAMPLE_RING_SIZE)
+    gestureSampleCount = sampleCount - ULTRASONIC_SAMPLE_RING_SIZE;
+
+  //
+  // process each new sample, returning the first gesture found
+  //
+  while (gestureSampleCount != sampleCount)
+  {
+    sampleTimeMS = millis() - (unsigned long) (byte) (sampleCount - 1 - gestureSampleCount) * ultrasonicRangingPeriodMS;
+    event = gestureProcessSample(ultrasonicGetSample(gestureSampleCount), sampleTimeMS);
+    gestureSampleCount++;
+
+    if (event != gestureNone)
+      return(event);
+  }
+
+  return(gestureNone);
+}
+
+
+
+//
+// run the gesture state machine on one sample
+//  Enter: distanceInMM = distance measured, 0 if no echo
+//         sampleTimeMS = time of the sample
+//  Exit:  gesture event returned, gestureNone if none
+//
+byte gestureProcessSample(unsigned int distanceInMM, unsigned long sampleTimeMS)
+{
+  unsigned long elapsedMS;
+
+  elapsedMS = sampleTimeMS - gestureStartTimeMS;
+
+  switch(gestureState)
+  {
+    case gestureWaitingState:
+    {
+      //
+      // a hand close to the sensor with nobody, or nobody close, behind it
+      //
+      if ((distanceInMM != 0) && (distanceInMM < GESTURE_WAVE_NEAR_MM) &&
+          ((gestureBaselineMM == 0) || (gestureBaselineMM > 2 * GESTURE_WAVE_NEAR_MM)))
+      {
+        gestureState = gestureHandNearState;
+        gestureStartTimeMS = sampleTimeMS;
+        return(gestureNone);
+      }
+
+      //
+      // a visitor stepping toward the sculpture
+      //
+      if ((distanceInMM != 0) && (gestureBaselineMM != 0) && (distanceInMM + GESTURE_STEP_MIN_MM < gestureBaselineMM))
+      {
+        gestureState = gestureSteppedInState;
+        gestureStartTimeMS = sampleTimeMS;
+        return(gestureNone);
+      }
+
+      //
+      // otherwise follow where the visitor is standing
+      //
+      if (distanceInMM == 0)
+        gestureBaselineMM = 0;
+      else if (gestureBaselineMM == 0)
+        gestureBaselineMM = distanceInMM;
+      else
+        gestureBaselineMM = gestureBaselineMM - (gestureBaselineMM >> GESTURE_BASELINE_SHIFT) + (distanceInMM >> GESTURE_BASELINE_SHIFT);
+      return(gestureNone);
+    }
+
+    case gestureHandNearState:
+    {
+      //
+      // wait for the hand to go away, if it stays too long it is a visitor, not a wave
+      //
+      if (elapsedMS > GESTURE_WAVE_MAX_MS)
+      {
+        gestureState = gestureWaitingState;
+        gestureBaselineMM = distanceInMM;
+        return(gestureNone);
+      }
+
+      if ((distanceInMM == 0) || (distanceInMM > GESTURE_WAVE_NEAR_MM + GESTURE_WAVE_NEAR_MM / 2))
+      {
+        gestureState = gestureWaitingState;
+        return(gestureWave);
+      }
+      return(gestureNone);
+    }
+
+    case gestureSteppedInState:
+    {
+      //
+      // wait for the visitor to step back to where they were standing
+      //
+      if ((elapsedMS > GESTURE_STEP_MAX_MS) || (distanceInMM == 0))
+      {
+        gestureState = gestureWaitingState;
+        gestureBaselineMM = distanceInMM;
+        return(gestureNone);
+      }
+
+      if (distanceInMM + GESTURE_STEP_RETURN_MM >= gestureBaselineMM)
+      {
+        gestureState = gestureWaitingState;
+        return(gestureStepInStepBack);
+      }
+      return(gestureNone);
+    }
+  }
+
+  gestureState = gestureWaitingState;
+  return(gestureNone);
+}
+
+
+// -------------------------------------- End --------------------------------------
@@ -25,14 +25,24 @@
 #include <Wire.h>
 #include <EEPROM.h>
 #include "ConstantAndDataTypes.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include "Scheduler.h"
+#include "Coroutines.h"
 #include "Buttons.h"
 #include "RtcAndLcd.h"
 #include "Backlight.h"
 #include "Motors.h"
 #include "Ultrasonic.h"
+#include "Gestures.h"
+#include "Analytics.h"
+#include "MotionQueue.h"
+#include "Telemetry.h"
 #include "Architecture.h"
 #include "Extravaganza.h"
 #include "Play.h"
+#include "Checkpoint.h"
+#include "Console.h"
 
 // ---------------------------------------------------------------------------------
 //                              Hardware and software setup
@@ -48,56 +58,76 @@ void setup()
   pinMode(TEST_D9_PIN, OUTPUT);            // configure the Test and LED output bits
   pinMode(LED_PIN, OUTPUT);
 
+  Serial.begin(115200);                     // serial port for diagnostics and commands
+
   //
-  // initialize software modules
+  // the first stage starts the hardware that moves the sculpture and the background process
+  // that drives it, and restores the mode and place in the show saved before the power was
+  // turned off
   //
-  LCDInitialise();                          // initialize the LCD hardware and functions
+#if TRACE_ENABLED
+  traceInitialize();                        // start the trace of events, before the events it traces
+#endif
   motorInitialise();                        // initialize the motor hardware and functions
   diskVelocitiesInitialize();               // initialize functions used to transition between disk velocities
   backlightInitialize();                    // initialize the backlight LEDs
+  motionQueueInitialize();                  // initialize the queue of motion segments run in the background
   //strobeInitialize();                       // initialize the strobe LED functions
   buttonsInitialize();                      // initialize the buttons hardware and functions
-  RTCInitialise();                          // initialize I2C communication with the real time clock
   ultrasonicInitialize();                   // initialize the ultrasonic hardware and functions
+  telemetryInitialize();                    // initialize the telemetry sent on the serial port
+  consoleInitialize();                      // initialize the command console on the serial port
+#if PROFILER_ENABLED
+  profileInitialize();                      // clear the profile, timed with Timer5 started by the ultrasonics
+#endif
   backgroundProcessingInitialize();         // initialize background processing to run every 10ms
-
-  LCDClearDisplay();                        // start with the LCD display blank
+  tasksInitialize();                        // add the tasks run by the main loop
+  RTCInitialise();                          // initialize I2C communication with the real time clock
+  sculptureMode = checkpointRestore();      // start in the mode saved in the RTC, or the Action mode
 
   //
-  // set the LCD contrast using the value saved in EEPROM, read the value from the EEPROM,
-  //  if it has not ever been set choose a default value
+  // enable interrupts to start background processing
   //
-  contrastValue = getContrastByteFromEEPROM();
-  LCDSetContrast(contrastValue);
-
+  sei();
 
   //
-  // update the display, including the sculputer's name
+  // flash the LEDs showing it is ready, before the mode starts so the show's first color isn't
+  // spoiled
   //
-  timeDisplayCount = 0;
-  LCDPrintCenteredString(SCULPTURE_LCD_NAME, 0);
+#if BLINK_AFTER_DOWNLOADING
+  backlightSetColor(70, 70, 70);
+  delay(50);
+  backlightSetColor(0, 0, 0);
+#endif
 
   //
-  // start with the sculpture in the Action mode (NEED TO CHANGE THIS BACK LATER)
+  // start the mode, a show queues its first steps and the disks start turning without waiting
+  // for the second stage
   //
-  setSculptureMode(actionMode);
-
+  modeTask();
 
+  //
+  // the second stage sets up the LCD and restores the audience statistics.  It takes a few
+  // milliseconds, the mode task holds back the modes that draw on the LCD or show the statistics
+  // until it is done.
+  //
+  LCDInitialise();                          // initialize the LCD hardware and functions
+  LCDClearDisplay();                        // start with the LCD display blank
 
   //
-  // enable interrupts to start background processing
+  // set the LCD contrast using the value saved in EEPROM, read the value from the EEPROM,
+  //  if it has not ever been set choose a default value
   //
-  sei();
+  contrastValue = getContrastByteFromEEPROM();
+  LCDSetContrast(contrastValue);
 
+  analyticsInitialize();                    // restore the audience statistics saved in EEPROM
 
   //
-  // flash the LEDs showing it is ready
+  // update the display, including the sculputer's name and the mode
   //
-#if BLINK_AFTER_DOWNLOADING
-  backlightSetColor(70, 70, 70);
-  delay(50);
-  backlightSetColor(0, 0, 0);
-#endif
+  displayModeName(sculptureMode);
+  modeDisplayReadyFlg = true;               // let the mode draw on the LCD
 }
 
 
@@ -106,41 +136,11 @@ void setup()
 // ---------------------------------------------------------------------------------
 
 //
-// main loop, select the display show based on the User Mode Setting
+// main loop, the scheduler runs the tasks, including the task that runs the mode the sculpture
+// is set to
 //
 void loop() {
-  //
-  // execute the mode that the sculpture is set to
-  //
-  switch (sculptureMode) {
-
-    case actionMode:
-      showActionMode();
-      stopBetweenModes();
-      break;
-
-    case lightMode:
-      showLightsMode();
-      stopBetweenModes();
-      break;
-
-    case playMode:
-      showPlayMode();
-      stopBetweenModes();
-      break;
-
-    case meterStickMode:
-      showMeterStickMode();
-      break;
-
-    case setContrastMode:
-      showSetContrastMode();
-      break;
-
-    case setTimeMode:
-      showSetTimeMode();
-      break;
-  }
+  schedulerRun();
 }
 
 
@@ -0,0 +1,240 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                      Motion Segment Queue                      *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The motion queue holds a short list of motion/colour segments that are executed back to back
+// by the Timer3 background process.  Each segment carries the absolute time it is scheduled to
+// start, so the show never waits for the main loop to notice that a transition has ended and
+// late starts never accumulate.  The main loop only needs to keep the queue topped up.
+//
+// The queue is lock free: only the main loop writes motionQueueHead and only the background
+// process writes motionQueueTail.  Both are single bytes so they are read and written atomically.
+//
+
+//
+// a segment of motion, the disks and backlight transition to these values over durationMS
+//
+typedef struct {
+  float outerDiskVelocityInRPM;
+  float innerDiskVelocityInRPM;
+  byte red;
+  byte green;
+  byte blue;
+  unsigned long startTimeMS;                    // time (from millis()) the segment is scheduled to start
+  unsigned int durationMS;
+  byte tag;                                     // caller's identifier, such as a table index
+} MOTION_SEGMENT;
+
+
+//
+// queue size, this must be a power of 2
+//
+const byte MOTION_QUEUE_SIZE = 8;
+const byte MOTION_QUEUE_INDEX_MASK = MOTION_QUEUE_SIZE - 1;
+
+//
+// function prototypes
+//
+void motionQueueInitialize();
+void motionQueueStart();
+void motionQueueStop();
+byte motionQueueSpace();
+bool motionQueueAdd(MOTION_SEGMENT *segment);
+byte motionQueueCurrentTag();
+void motionQueueExecute();
+
+
+// ---------------------------------------------------------------------------------
+//                               Motion Queue Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the motion queue
+//
+MOTION_SEGMENT motionQueueSegments[MOTION_QUEUE_SIZE];
+volatile byte motionQueueHead;                  // next free entry, only written by the main loop
+volatile byte motionQueueTail;                  // next entry to execute, only written by the ISR
+volatile bool motionQueueRunningFlg;
+volatile bool motionQueueSegmentActiveFlg;
+volatile byte motionQueueCurrentSegmentTag;
+unsigned long motionQueueSegmentFinishTimeMS;
+unsigned int motionQueueUnderrunCount;
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the motion queue
+//
+void motionQueueInitialize()
+{
+  motionQueueRunningFlg = false;
+  motionQueueSegmentActiveFlg = false;
+  motionQueueHead = 0;
+  motionQueueTail = 0;
+  motionQueueUnderrunCount = 0;
+}
+
+
+
+//
+// start executing segments as they are added to the queue, the queue starts empty
+//
+void motionQueueStart()
+{
+  motionQueueStop();
+  motionQueueRunningFlg = true;
+}
+
+
+
+//
+// stop executing segments and discard any that are queued, the transitions already
+// started continue on to their final values
+//
+void motionQueueStop()
+{
+  //
+  // once the running flag is clear the ISR no longer touches the queue, so it is
+  // safe for the main loop to reset the tail
+  //
+  motionQueueRunningFlg = false;
+  motionQueueSegmentActiveFlg = false;
+  motionQueueTail = motionQueueHead;
+}
+
+
+
+//
+// get the number of free entries in the queue
+//  Exit:  number of segments that can be added without the queue overflowing
+//
+byte motionQueueSpace()
+{
+  return((MOTION_QUEUE_SIZE - 1) - ((motionQueueHead - motionQueueTail) & MOTION_QUEUE_INDEX_MASK));
+}
+
+
+
+//
+// add a segment to the end of the queue
+//  Enter:  segment -> segment to copy into the queue
+//  Exit:   true returned if added, false returned if the queue is full
+//
+bool motionQueueAdd(MOTION_SEGMENT *segment)
+{
+  byte head;
+
+  if (motionQueueSpace() == 0)
+    return(false);
+
+  //
+  // fill in the entry before advancing the head so the ISR never sees a partial segment
+  //
+  head = motionQueueHead;
+  motionQueueSegments[head] = *segment;
+  motionQueueHead = (head + 1) & MOTION_QUEUE_INDEX_MASK;
+  return(true);
+}
+
+
+
+//
+// get the tag of the segment currently being executed
+//
+byte motionQueueCurrentTag()
+{
+  return(motionQueueCurrentSegmentTag);
+}
+
+
+
+//
+// start the next segment at its scheduled time, this is called from the Timer3 ISR every
+// 10ms before the backlight and disk transitions are updated
+//
+void motionQueueExecute()
+{
+  unsigned long currentTime;
+  byte tail;
+  MOTION_SEGMENT *segment;
+
+  if (!motionQueueRunningFlg)
+    return;
+
+  //
+  // check if the current segment is still executing
+  //
+  currentTime = millis();
+  if (motionQueueSegmentActiveFlg && ((long) (currentTime - motionQueueSegmentFinishTimeMS) < 0))
+    return;
+
+  //
+  // start segments until one is found that is still in progress, any whose time has already
+  // passed (because the main loop fell behind) are completed at once so the show catches up
+  //
+  while (true)
+  {
+    //
+    // check for an empty queue, the main loop did not keep up so hold the last values
+    //
+    tail = motionQueueTail;
+    if (tail == motionQueueHead)
+    {
+      if (motionQueueSegmentActiveFlg)
+      {
+        motionQueueUnderrunCount++;
+        motionQueueSegmentActiveFlg = false;
+      }
+      return;
+    }
+
+    //
+    // check if it is time to start the next segment
+    //
+    segment = &motionQueueSegments[tail];
+    if ((long) (currentTime - segment->startTimeMS) < 0)
+      return;
+
+    //
+    // complete the finishing transitions so the segment starts exactly from their final values,
+    // the first segment starts from whatever the backlight is showing, such as the last mode's
+    // color part way through a transition
+    //
+    backlightTransition();
+    diskVelocitiesTransition();
+    if (!motionQueueSegmentActiveFlg)
+      backlightStartFromCurrentColor();
+
+    //
+    // start the segment from its scheduled time rather than from now
+    //
+    diskVelocitiesStartTransitionAt(
+      segment->outerDiskVelocityInRPM,
+      segment->innerDiskVelocityInRPM,
+      segment->durationMS,
+      segment->startTimeMS);
+
+    backlightStartTransitionAt(
+      segment->red,
+      segment->green,
+      segment->blue,
+      segment->durationMS,
+      segment->startTimeMS);
+
+    motionQueueCurrentSegmentTag = segment->tag;
+    motionQueueSegmentFinishTimeMS = segment->startTimeMS + segment->durationMS;
+    motionQueueSegmentActiveFlg = true;
+
+    motionQueueTail = (tail + 1) & MOTION_QUEUE_INDEX_MASK;
+    schedulerRaiseEvent(SCHEDULER_EVENT_MOTION);      // there is room in the queue for more
+
+    if ((long) (currentTime - motionQueueSegmentFinishTimeMS) < 0)
+      return;
+  }
+}
+
+
+// -------------------------------------- End --------------------------------------
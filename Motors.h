@@ -10,6 +10,7 @@
 //
 void diskVelocitiesInitialize(void);
 void diskVelocitiesStartTransition(float outerDiskVelocityInRPM, float innerDiskVelocityInRPM, unsigned long TransitionDurationMS);
+void diskVelocitiesStartTransitionAt(float outerDiskVelocityInRPM, float innerDiskVelocityInRPM, unsigned long TransitionDurationMS, unsigned long startTimeMS);
 bool diskVelocitiesTransitionIsFinished();
 void diskVelocitiesTransition();
 void diskVelocitiesSet(float outerDiskVelocityInRPM, float innerDiskVelocityInRPM);
@@ -17,6 +18,7 @@ void motorInitialise(void);
 void motorSetSpeedAndDirection1(int desiredMotorSpeedInRPM, int desiredDirection);
 void motorProportionalIntegralControl1();
 void motorZeroIntegralTerms();
+void motorSetGains(int kp, int ki);
 int motorReadRPM1();
 void motorSetPWMPower1(int motorPWM, int motorDirection);
 void motorSetSpeedAndDirection2(int desiredMotorSpeedInRPM, int desiredDirection);
@@ -25,6 +27,10 @@ int motorReadRPM2();
 void motorSetPWMPower2(int motorPWM, int motorDirection);
 void motorTachometer1ISR();
 void motorTachometer2ISR();
+#if TRACE_ENABLED
+void motorCheckForFaults();
+void motorCheckMotorForFaults(byte motor, int desiredRPM, int measuredRPM, int motorPWM);
+#endif
 
 // ---------------------------------------------------------------------------------
 //                         Outer & Inner Rotating Disk Functions
@@ -77,13 +83,25 @@ void diskVelocitiesInitialize(void)
 //
 void diskVelocitiesStartTransition(float outerDiskVelocityInRPM, float innerDiskVelocityInRPM, unsigned long TransitionDurationMS)
 {
-  unsigned long startTimeMS;
+  diskVelocitiesStartTransitionAt(outerDiskVelocityInRPM, innerDiskVelocityInRPM, TransitionDurationMS, millis());
+}
+
+
+
+//
+// start a transition from the current disk velocities to a new ones, timed from a given start time
+// rather than from now, so that back to back transitions can be chained without any gaps
+//   Enter: outerDiskVelocityInRPM = discVelocities to transition to for the outer disk in RPM, negative value goes counter counter-clockwise
+//          innerDiskVelocityInRPM = discVelocities to transition to for the inner disk in RPM, negative value goes counter counter-clockwise
+//          TransitionDurationMS = number of milliseconds for the transition (1 - 60000)
+//          startTimeMS = time in milliseconds (from millis()) that the transition is considered to have started
+//
+void diskVelocitiesStartTransitionAt(float outerDiskVelocityInRPM, float innerDiskVelocityInRPM, unsigned long TransitionDurationMS, unsigned long startTimeMS)
+{
   unsigned long finishTimeMS;
 
   diskVelocitiesTransitionCompleteFlg = true;
 
-  startTimeMS = millis();
-  
   finishTimeMS = startTimeMS + (unsigned long) TransitionDurationMS;
   if (finishTimeMS < startTimeMS)
     finishTimeMS = startTimeMS;
@@ -114,6 +132,8 @@ void diskVelocitiesStartTransition(float outerDiskVelocityInRPM, float innerDisk
       innerDiskVelocityInRPM = -MINIMUM_VELOCITY_IN_RPM;
   }
 
+  TRACE(traceDiskTransition, min(TransitionDurationMS / 100, 255UL), outerDiskVelocityInRPM * 10, innerDiskVelocityInRPM * 10);
+
   //
   // remember what the final velocities will be
   //
@@ -231,6 +251,7 @@ void diskVelocitiesTransition()
     //
     diskVelocitiesSet(diskVelocitiesTransitionFinalSpeedOuter, diskVelocitiesTransitionFinalSpeedInner);
     diskVelocitiesTransitionCompleteFlg = true;
+    schedulerRaiseEvent(SCHEDULER_EVENT_MOTION);
     return;
   }
 
@@ -299,11 +320,19 @@ int motorDesiredSpeedInRPM1;
 int motorDesiredDirection1;
 int motorMeasuredRPM1;
 int motorIntegratedSpeedError1;
+int motorPWM1;                                  // PWM last written to the motor, for the telemetry
 
 int motorDesiredSpeedInRPM2;
 int motorDesiredDirection2;
 int motorMeasuredRPM2;
 int motorIntegratedSpeedError2;
+int motorPWM2;
+
+//
+// gains of the PI loops, they start as the constants but can be tuned from the serial console
+//
+int motorKP;                                    // proportional gain x 10
+int motorKI;                                    // integral divisor, at least 1
 
 
 //
@@ -351,6 +380,9 @@ void motorInitialise(void)
   motorDesiredDirection2 = DIRECTION_CW;
   motorIntegratedSpeedError2 = 0L;
 
+  motorKP = MOTOR_KP_PROP_CONTROL;
+  motorKI = MOTOR_KI_PROP_INT_CONTROL;
+
 
   //
   // change the prescaler for timer 1 (used by the motor PWM) to increase the PWM frequency
@@ -411,14 +443,15 @@ void motorProportionalIntegralControl1()
   //
   // compute power to motor
   //
-  motorPower = (speedError * MOTOR_KP_PROP_CONTROL) / 10;
-  motorPower += (motorIntegratedSpeedError1 / MOTOR_KI_PROP_INT_CONTROL);
+  motorPower = (speedError * motorKP) / 10;
+  motorPower += (motorIntegratedSpeedError1 / motorKI);
 
     
   //
   // output power and direction to motor
   //
   motorSetPWMPower1(motorPower, motorDesiredDirection1);
+  TRACE(tracePIOutput1, motorPWM1, measuredMotorRPM, speedError);
 }
 
 
@@ -427,7 +460,26 @@ void motorZeroIntegralTerms()
   motorIntegratedSpeedError1 = 0;
   motorIntegratedSpeedError2 = 0;
 }
-  
+
+
+
+//
+// set the gains of both PI loops, interrupts are held off so the background process never
+// servos with one gain changed and not the other
+//  Enter: kp = proportional gain x 10
+//         ki = integral divisor, must be at least 1
+//
+void motorSetGains(int kp, int ki)
+{
+  byte oldSREG;
+
+  oldSREG = SREG;
+  cli();
+  motorKP = kp;
+  motorKI = ki;
+  SREG = oldSREG;
+}
+
 
 
 //
@@ -488,6 +540,7 @@ void motorSetPWMPower1(int motorPWM, int motorDirection)
   //
   // output power and direction to motor
   //
+  motorPWM1 = motorPWM;
   digitalWrite(MOTOR_DIRECTION_1_PIN, motorDirection);
   analogWrite(MOTOR_PWM_1_PIN, 255 - motorPWM);          // PWM signal inverted so subtract from 255
 }
@@ -537,14 +590,15 @@ void motorProportionalIntegralControl2()
   //
   // compute power to motor
   //
-  motorPower = (speedError * MOTOR_KP_PROP_CONTROL) / 10;
-  motorPower += (motorIntegratedSpeedError2 / MOTOR_KI_PROP_INT_CONTROL);
+  motorPower = (speedError * motorKP) / 10;
+  motorPower += (motorIntegratedSpeedError2 / motorKI);
 
     
   //
   // output power and direction to motor
   //
   motorSetPWMPower2(motorPower, motorDesiredDirection2);
+  TRACE(tracePIOutput2, motorPWM2, measuredMotorRPM, speedError);
 }
 
 
@@ -607,6 +661,7 @@ void motorSetPWMPower2(int motorPWM, int motorDirection)
   //
   // output power and direction to motor
   //
+  motorPWM2 = motorPWM;
   digitalWrite(MOTOR_DIRECTION_2_PIN, motorDirection);
   analogWrite(MOTOR_PWM_2_PIN, 255 - motorPWM);          // PWM signal inverted so subtract from 255
 }
@@ -620,9 +675,15 @@ void motorTachometer1ISR()
 {
   unsigned long newTime;
 
+  PROFILE_BEGIN(profileTachometer1ISR);
   newTime = micros();
   motorTachMicrosecondsBetweenLines1 = newTime - motorTachTimeOfLastMeasurement1;
   motorTachTimeOfLastMeasurement1 = newTime;
+#if TRACE_ENABLED
+  if (traceTachEdgesFlg)
+    TRACE(traceTachEdge1, 0, min(motorTachMicrosecondsBetweenLines1, 0xffffUL), 0);
+#endif
+  PROFILE_END(profileTachometer1ISR);
 }
 
 
@@ -634,8 +695,73 @@ void motorTachometer2ISR()
 {
   unsigned long newTime;
 
+  PROFILE_BEGIN(profileTachometer2ISR);
   newTime = micros();  
   motorTachMicrosecondsBetweenLines2 = newTime - motorTachTimeOfLastMeasurement2;
   motorTachTimeOfLastMeasurement2 = newTime;
+#if TRACE_ENABLED
+  if (traceTachEdgesFlg)
+    TRACE(traceTachEdge2, 0, min(motorTachMicrosecondsBetweenLines2, 0xffffUL), 0);
+#endif
+  PROFILE_END(profileTachometer2ISR);
 }
 
+
+
+
+#if TRACE_ENABLED
+//
+// constants used to find motor faults, a stall must last MOTOR_STALL_TICKS passes of the PI
+// loop and a jerk is a change in speed from one pass to the next far larger than any transition
+// asks for
+//
+const byte MOTOR_STALL_TICKS = 100;
+const int MOTOR_JERK_RPM = 1000;
+
+//
+// global variables used to find motor faults, index 0 for motor 1
+//
+byte motorStallTicks[2];
+int motorLastMeasuredRPM[2];
+
+//
+// check both motors for a stall or jerk, freezing the trace if one is found, called by the
+// background process after the PI loops
+//
+void motorCheckForFaults()
+{
+  motorCheckMotorForFaults(0, motorDesiredSpeedInRPM1, motorMeasuredRPM1, motorPWM1);
+  motorCheckMotorForFaults(1, motorDesiredSpeedInRPM2, motorMeasuredRPM2, motorPWM2);
+}
+
+
+
+//
+// check one motor for a stall or jerk
+//  Enter: motor = 0 for motor 1, 1 for motor 2
+//         desiredRPM = speed the PI loop is servoing to
+//         measuredRPM = speed measured by the tachometer
+//         motorPWM = PWM the PI loop has set
+//
+void motorCheckMotorForFaults(byte motor, int desiredRPM, int measuredRPM, int motorPWM)
+{
+  //
+  // a stalled motor is driven as hard as it can be but turns at less than half the speed wanted
+  //
+  if ((motorPWM == MOTOR_MAX_PWM) && (measuredRPM < desiredRPM / 2))
+  {
+    if (motorStallTicks[motor] < MOTOR_STALL_TICKS)
+    {
+      motorStallTicks[motor]++;
+      if (motorStallTicks[motor] == MOTOR_STALL_TICKS)
+        TRACE_FAULT(traceFaultStall, motor + 1, measuredRPM);
+    }
+  }
+  else
+    motorStallTicks[motor] = 0;
+
+  if (abs(measuredRPM - motorLastMeasuredRPM[motor]) > MOTOR_JERK_RPM)
+    TRACE_FAULT(traceFaultJerk, motor + 1, measuredRPM - motorLastMeasuredRPM[motor]);
+  motorLastMeasuredRPM[motor] = measuredRPM;
+}
+#endif
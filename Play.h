@@ -12,23 +12,33 @@
 //
 // You can program the motor speed and colors that are created based on the distance detected by the ultrasonic sensor.
 //
-// You can make the light sculpture more reactive by decreasing PERIOD_OF_ULTRASONIC_MEASUREMENTS_MS in Ultrasonic.h,
-// or smoother by increasing PERIOD_OF_ULTRASONIC_MEASUREMENTS_MS.
+// You can make the light sculpture more reactive by decreasing kPlayTransitionDurationInMS below,
+// or smoother by increasing it.  The distance itself is measured in the background every
+// ULTRASONIC_DEFAULT_RANGING_PERIOD_MS (see Ultrasonic.h) and filtered to remove stray echoes.
 //
 // Your Kinetic Sculpture must interact using disc motion and backlight displays.
 //
 // Play should run whenever it detects something and base its response on how close the detected object is.
 //
+// A hand wave or a step in and back again (see Gestures.h) plays a special color and motion for a moment.
+//
+
+//
+// you may update this to make the transitions quicker or smoother, a new distance is acted on
+// as soon as it is measured, the transition then takes this long to reach the new motion
+//
+const int kPlayTransitionDurationInMS = 1000;
 
 //
-// you may update this to make the transitions more or less responsive
+// the motion is changed each time the visitor moves this many cm, you may update this
 //
-const int kPeriodOfUltrasonicMeasurementsInMS = 2000; // update this but make it a multiple of 100 ms
+const int cmPerBand = 5; 
 
 //
-// this is the number of cm per index as it transitions, you may update this
+// the distance must move this far past the edge of the current index before changing to a new
+// one, this keeps a visitor standing on an edge from flapping between the two
 //
-const int cmPerIndex = 5; 
+const int kPlayHysteresisInCM = 2;
 
 //
 // you may change this if your sculpture has an object closer than 2.5 meters to it
@@ -36,94 +46,344 @@ const int cmPerIndex = 5;
 //
 const byte kMaxDistanceToUserInCM = 250;
 
+//
+// the response to a visitor is given by a curve of control points, the motion and color between
+// two points is blended from them.  Velocities are in 1/16ths of an RPM.
+//
+const int PLAY_VELOCITY_UNITS_PER_RPM = 16;
+#define PLAY_RPM(rpm) ((int) ((rpm) * PLAY_VELOCITY_UNITS_PER_RPM))
+
+typedef struct {
+  byte distanceInCM;
+  int discVelocities[2];
+  byte rgb[3];
+} PlayResponsePoint;
+
+//
+// you may change this curve, the points must be in order of increasing distance.  Closer than
+// the first point uses the first point and farther than the last uses the last.  Like the show,
+// the curve is written once here, one POINT(distance, velocities, color) per line, and used to
+// build both the program memory curve and the compile time checks below.  The closest point is
+// as fast as the motors can go.
+//
+#define PLAY_RESPONSE_CURVE(POINT) \
+  POINT( 10, {PLAY_RPM(-60.0),  PLAY_RPM(60.0)},  rgbPogchamp) \
+  POINT( 50, {PLAY_RPM(-30.0),  PLAY_RPM(30.0)},  rgbPinkForAllGenders) \
+  POINT(100, {PLAY_RPM(30.0),   PLAY_RPM(15.0)},  rgbMellowYellllllow) \
+  POINT(175, {PLAY_RPM(15.0),   PLAY_RPM(20.0)},  rgbPureGreen) \
+  POINT(250, {PLAY_RPM(-10.0),  PLAY_RPM(10.0)},  rgbmistyBlue)
+
+const PlayResponsePoint PROGMEM PlayResponseCurve[] = {
+  PLAY_RESPONSE_CURVE(EXTRAVAGANZA_ENTRY)
+};
+
+const byte PlayResponseCurveLength = sizeof(PlayResponseCurve) / sizeof(PlayResponsePoint);
+
+//
+// a copy of the curve that only exists while compiling, used to check its velocities against
+// the same motor model as the show and that its points are in order
+//
+constexpr PlayResponsePoint PlayResponseCurveCheck[] = {
+  PLAY_RESPONSE_CURVE(EXTRAVAGANZA_ENTRY)
+};
+
+
+//
+// check the velocities of the curve's points from idx to its end
+//
+constexpr bool playCheckResponseVelocities(int idx)
+{
+  return((idx >= PlayResponseCurveLength) ||
+    (extravaganzaCheckVelocity((float) PlayResponseCurveCheck[idx].discVelocities[front] / PLAY_VELOCITY_UNITS_PER_RPM) &&
+     extravaganzaCheckVelocity((float) PlayResponseCurveCheck[idx].discVelocities[back] / PLAY_VELOCITY_UNITS_PER_RPM) &&
+     playCheckResponseVelocities(idx + 1)));
+}
+
+
+//
+// check that the curve's points from idx to its end are in order of increasing distance
+//
+constexpr bool playCheckResponseOrder(int idx)
+{
+  return((idx >= PlayResponseCurveLength) ||
+    ((PlayResponseCurveCheck[idx].distanceInCM > PlayResponseCurveCheck[idx - 1].distanceInCM) &&
+     playCheckResponseOrder(idx + 1)));
+}
+
+
+static_assert(playCheckResponseVelocities(0),
+  "PlayResponseCurve velocity is faster than the motors can reach (MOTOR_MAX_SPEED_IN_RPM)");
+static_assert(playCheckResponseOrder(1),
+  "PlayResponseCurve points must be in order of increasing distance");
+
+//
+// the show's palette color and velocity preset (see tools/ExtravaganzaShow.txt) played when a
+// gesture is seen, so they are held to the same motor model as the show, you may change these.
+// The transition and post transition durations set how long the gesture's effect lasts.
+//
+typedef struct {
+  byte paletteColor;
+  byte velocityPreset;
+  unsigned int transitionDurationMS;
+  unsigned int postTransitionDurationMS;
+} PlayGestureEffect;
+
+const PlayGestureEffect PROGMEM PlayGestureEffects[] = {
+  {palettePogchamp,  presetReversedChiaroscuro, 2500, 500},   // gestureWave
+  {paletteMistyBlue, presetChiaroscuro,         5000, 750}    // gestureStepInStepBack
+};
+
 //
 // function prototypes
 //
 void showPlayMode();
+unsigned long playStartGestureEffect(byte gesture);
+int playDistanceToBand(byte distance, int currentBand);
+void playStartTransitionToDistance(byte distance);
+byte playFindResponsePoint(byte distance);
+int playInterpolate(int value0, int value1, unsigned int fraction);
 
 // ---------------------------------------------------------------------------------
 //                                The Play Mode
 // ---------------------------------------------------------------------------------
 
 //
-// run the Play mode, return when no longer in this mode
+// global variables used by the Play mode
+//
+unsigned long playLastDistanceTime;
+int playBand;                                   // distance band responded to, -1 to retarget
+byte playGesture;
+unsigned long playGestureEffectFinishTimeMS;
+
+// ---------------------------------------------------------------------------------
+
+//
+// run the Play mode.  The distance is checked each time the background ranging measures a new
+// one, and the disks and backlight are turned toward the response for the new distance straight
+// away, from whatever they are doing at the time.  The distance used is where the visitor is
+// predicted to be when the transition finishes, so a visitor walking up is met by the motion
+// rather than followed by it.
 //
 void showPlayMode()
 {
+  COROUTINE *co = &modeCoroutine;
+  byte thisDistance;
+  int newBand;
+
+  CO_BEGIN(co);
+  gestureInitialize();
+  playGesture = gestureNone;
+  playBand = -1;
+
   while (true)
   {
     //
-    // take a measurement to determine distance
+    // play a gesture's effect for a while in place of the distance response, another gesture
+    // while it plays starts it over
     //
-    ultrasonicStartMeasurement();
-    while (ultrasonicIsFinished() == false)
+    while (playGesture != gestureNone)
     {
-      //
-      // check for button presses...
-      //
-      executeTasks();
-
-      //
-      // return if no longer in this mode
-      //
-      if (sculptureMode != playMode)
-        return;
+      playGestureEffectFinishTimeMS = playStartGestureEffect(playGesture);
+
+      CO_AWAIT(co, ((playGesture = gestureCheck()) != gestureNone) ||
+        ((long) (millis() - playGestureEffectFinishTimeMS) >= 0));
+
+      playBand = -1;
     }
 
     //
-    // get measurement from ultrasonic
+    // retarget the transitions in progress if the distance has moved to a new band
     //
-    byte thisDistance = constrain(ultrasonicGetDistanceInCM(), 0, kMaxDistanceToUserInCM); // constrain to a byte
+    playLastDistanceTime = ultrasonicGetFilteredDistanceTimeMS();
+    thisDistance = constrain(ultrasonicGetPredictedDistanceInCM(kPlayTransitionDurationInMS), 0, kMaxDistanceToUserInCM); // constrain to a byte
 
-    byte idx = 0;
+    newBand = playDistanceToBand(thisDistance, playBand);
+    if (newBand != playBand)
+    {
+      playBand = newBand;
+      playStartTransitionToDistance(thisDistance);
+    }
 
     //
-    // interpolate the correct distance entry (unless the mesaurement is invalid)
+    // wait for a new filtered distance or a gesture, measurements are made continuously in the
+    // background
     //
-    if (thisDistance != 0) idx = thisDistance / cmPerIndex % ExtravaganzaTableLength;
+    CO_AWAIT(co, ((playGesture = gestureCheck()) != gestureNone) ||
+      (ultrasonicGetFilteredDistanceTimeMS() != playLastDistanceTime));
+  }
+  CO_END(co);
+}
 
-    //
-    // get the disk velocities from the table and transition from the current velocities
-    //   to new velocities over the given duration period
-    //
-    diskVelocitiesStartTransition(
-      pgm_read_float(&ExtravaganzaTable[idx].discVelocities[front]),
-      pgm_read_float(&ExtravaganzaTable[idx].discVelocities[back]),
-      kPeriodOfUltrasonicMeasurementsInMS);
 
-    //
-    // get the backlight color from the table and transition from the current RGB values
-    //   to new values over the given duration period
-    //
-    backlightStartTransition(
-      pgm_read_byte(&ExtravaganzaTable[idx].rgb[red]),
-      pgm_read_byte(&ExtravaganzaTable[idx].rgb[green]),
-      pgm_read_byte(&ExtravaganzaTable[idx].rgb[blue]),
-      kPeriodOfUltrasonicMeasurementsInMS);
 
-    //
-    // update the LCD display with the table entry number currently being executed
-    //
-    LCDSetCursorXY(26, 3);
-    LCDPrintUnsignedIntWithPadding(idx, 3, ' ');
+//
+// find the distance band, staying in the current band until the distance is well past its edges
+//  Enter: distance = distance to the visitor in CM, 0 if nothing is seen
+//         currentBand = band in use now, -1 if none
+//  Exit:  band returned
+//
+int playDistanceToBand(byte distance, int currentBand)
+{
+  //
+  // nothing seen is the band past the farthest distance
+  //
+  if (distance == 0)
+    return(kMaxDistanceToUserInCM / cmPerBand + 1);
 
+  //
+  // hold the current band while the distance is near it
+  //
+  if ((currentBand >= 0) &&
+      (distance >= currentBand * cmPerBand - kPlayHysteresisInCM) &&
+      (distance < (currentBand + 1) * cmPerBand + kPlayHysteresisInCM))
+    return(currentBand);
 
-    //
-    // execute other task while waiting for transition to complete
-    //
-    while (diskVelocitiesTransitionIsFinished() == false)
-    {
-      //
-      // check for button presses...
-      //
-      executeTasks();
-
-      //
-      // return if no longer in this mode
-      //
-      if (sculptureMode != playMode)
-        return;
-    }
+  return(distance / cmPerBand);
+}
+
+
+
+//
+// turn the disks and backlight toward the response for a distance, starting from their present
+// motion and color
+//  Enter: distance = distance to the visitor in CM, 0 if nothing is seen
+//
+void playStartTransitionToDistance(byte distance)
+{
+  byte pointIdx;
+  const PlayResponsePoint *point0;
+  const PlayResponsePoint *point1;
+  byte distance0;
+  byte distance1;
+  unsigned int fraction;
+  int velocities[2];
+  byte rgb[3];
+
+  //
+  // nothing seen responds the same as the farthest distance
+  //
+  if (distance == 0)
+    distance = kMaxDistanceToUserInCM;
+
+  //
+  // find the control points on either side of the distance and how far it is between them,
+  // as a fraction in 1/256ths
+  //
+  pointIdx = playFindResponsePoint(distance);
+  point0 = &PlayResponseCurve[pointIdx];
+  point1 = &PlayResponseCurve[min(pointIdx + 1, PlayResponseCurveLength - 1)];
+  distance0 = pgm_read_byte(&point0->distanceInCM);
+  distance1 = pgm_read_byte(&point1->distanceInCM);
+
+  if ((distance <= distance0) || (distance1 <= distance0))
+    fraction = 0;
+  else if (distance >= distance1)
+    fraction = 256;
+  else
+    fraction = ((unsigned int) (distance - distance0) << 8) / (distance1 - distance0);
+
+  //
+  // blend the velocities and colors of the two points
+  //
+  for (byte i = 0; i < 2; i++)
+    velocities[i] = playInterpolate((int) pgm_read_word(&point0->discVelocities[i]), (int) pgm_read_word(&point1->discVelocities[i]), fraction);
+
+  for (byte i = 0; i < 3; i++)
+    rgb[i] = playInterpolate(pgm_read_byte(&point0->rgb[i]), pgm_read_byte(&point1->rgb[i]), fraction);
+
+  //
+  // transition from the current velocities to the new velocities over the given duration period
+  //
+  diskVelocitiesStartTransition(
+    (float) velocities[front] / PLAY_VELOCITY_UNITS_PER_RPM,
+    (float) velocities[back] / PLAY_VELOCITY_UNITS_PER_RPM,
+    kPlayTransitionDurationInMS);
+
+  //
+  // transition from the current RGB values to new values over the given duration period
+  //
+  backlightRetargetTransition(rgb[red], rgb[green], rgb[blue], kPlayTransitionDurationInMS);
+
+  //
+  // update the LCD display with the distance currently being responded to
+  //
+  LCDSetCursorXY(26, 3);
+  LCDPrintUnsignedIntWithPadding(distance, 3, ' ');
+}
+
+
+
+//
+// turn the disks and backlight toward a gesture's palette color and velocity preset, starting
+// from their present motion and color
+//  Enter: gesture = gestureWave or gestureStepInStepBack
+//  Exit:  time (from millis()) that the effect's post transition period ends
+//
+unsigned long playStartGestureEffect(byte gesture)
+{
+  const PlayGestureEffect *effect;
+  byte red;
+  byte green;
+  byte blue;
+  float outerVelocity;
+  float innerVelocity;
+  unsigned int transitionDurationMS;
+
+  effect = &PlayGestureEffects[gesture - gestureWave];
+  extravaganzaGetPaletteColor(pgm_read_byte(&effect->paletteColor), &red, &green, &blue);
+  extravaganzaGetVelocityPreset(pgm_read_byte(&effect->velocityPreset), &outerVelocity, &innerVelocity);
+  transitionDurationMS = pgm_read_word(&effect->transitionDurationMS);
+
+  diskVelocitiesStartTransition(outerVelocity, innerVelocity, transitionDurationMS);
+  backlightRetargetTransition(red, green, blue, transitionDurationMS);
+
+  //
+  // update the LCD display with the velocity preset currently being played
+  //
+  LCDSetCursorXY(26, 3);
+  LCDPrintString("P");
+  LCDPrintUnsignedIntWithPadding(pgm_read_byte(&effect->velocityPreset), 2, ' ');
+
+  return(millis() + transitionDurationMS + pgm_read_word(&effect->postTransitionDurationMS));
+}
+
+
+
+//
+// binary search the response curve for the last control point at or before a distance
+//  Enter: distance = distance to the visitor in CM
+//  Exit:  index of the control point returned, 0 if the distance is before the first point
+//
+byte playFindResponsePoint(byte distance)
+{
+  byte low;
+  byte high;
+  byte middle;
+
+  low = 0;
+  high = PlayResponseCurveLength - 1;
+  while (low < high)
+  {
+    middle = (low + high + 1) / 2;
+    if (pgm_read_byte(&PlayResponseCurve[middle].distanceInCM) <= distance)
+      low = middle;
+    else
+      high = middle - 1;
   }
+
+  return(low);
 }
 
+
+
+//
+// blend between two values
+//  Enter: value0 = value at a fraction of 0
+//         value1 = value at a fraction of 256
+//         fraction = 0 to 256
+//  Exit:  blended value returned
+//
+int playInterpolate(int value0, int value1, unsigned int fraction)
+{
+  return(value0 + (int) (((long) (value1 - value0) * fraction) >> 8));
+}
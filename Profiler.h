@@ -0,0 +1,235 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                        Hot Path Profiler                       *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The profiler times regions of code, such as the interrupt service routines and the tasks run
+// by the main loop.  A region is marked with PROFILE_BEGIN() and PROFILE_END(), each reads the
+// free running Timer5 count (0.5us per count, set up by ultrasonicInitialize()) and the time
+// between them is added to the region's minimum, maximum, mean and a histogram with a bin for
+// each power of 2.  A region must take less than 32ms, the time for Timer5 to count around.
+//
+// The results are shown on a page of the Diagnostics mode and written to the serial port when
+// the mode is entered.  Set PROFILER_ENABLED to false to compile the profiler out, the macros
+// then generate no code at all.
+//
+#define PROFILER_ENABLED false
+
+//
+// the regions that are timed, the main loop's tasks are timed by the scheduler in the order
+// they are added by tasksInitialize().  The button delay is the time from the background
+// interrupt queuing a button event to the buttons task taking it from the queue.
+//
+enum ProfileRegions {profileTimer3ISR, profileMotorControl, profileTachometer1ISR, profileTachometer2ISR,
+                     profileEchoISR, profileLCDPrint, profileButtonDelay, profileButtonsTask, profileModeTask, profileAnalyticsTask,
+                     profileTimeDisplayTask, profileCheckpointTask, profileTelemetryTask, profileConsoleTask,
+                     profileRegionCount};
+
+const byte PROFILE_FIRST_TASK_REGION = profileButtonsTask;
+
+#if PROFILER_ENABLED
+
+#define PROFILE_BEGIN(region) profileStartCount[region] = profileReadTimer()
+#define PROFILE_END(region) profileRecord(region, profileReadTimer() - profileStartCount[region])
+
+//
+// number of histogram bins, bin n counts the times of 2^n to 2^(n+1) - 1 Timer5 counts
+//
+const byte PROFILE_HISTOGRAM_BINS = 16;
+
+//
+// the statistics kept for a region, times are in Timer5 counts
+//
+typedef struct {
+  unsigned int minCounts;
+  unsigned int maxCounts;
+  unsigned long totalCounts;
+  unsigned long sampleCount;
+  unsigned int histogram[PROFILE_HISTOGRAM_BINS];
+} PROFILE_REGION;
+
+//
+// names of the regions, short enough to fit on the LCD
+//
+const char *ProfileRegionNames[profileRegionCount] = {
+  "TIMER3 ISR", "MOTOR PI", "TACH 1 ISR", "TACH 2 ISR", "ECHO ISR", "LCD PRINT",
+  "BUTTON DELAY", "BUTTONS TASK", "MODE TASK", "ANALYTICS", "TIME DISPLAY", "CHECKPOINT", "TELEMETRY", "CONSOLE"
+};
+
+//
+// function prototypes
+//
+void profileInitialize();
+unsigned int profileReadTimer();
+void profileRecord(byte region, unsigned int elapsedCounts);
+void profileGetRegion(byte region, PROFILE_REGION *copy);
+unsigned int profileCountsToMicroseconds(unsigned long counts);
+void profileSerialDump();
+
+
+// ---------------------------------------------------------------------------------
+//                                Profiler Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the profiler
+//
+PROFILE_REGION profileRegions[profileRegionCount];
+volatile unsigned int profileStartCount[profileRegionCount];
+
+// ---------------------------------------------------------------------------------
+
+//
+// clear the statistics of all the regions
+//
+void profileInitialize()
+{
+  byte oldSREG;
+
+  oldSREG = SREG;
+  cli();
+  memset(profileRegions, 0, sizeof(profileRegions));
+  for (byte i = 0; i < profileRegionCount; i++)
+    profileRegions[i].minCounts = 0xffff;
+  SREG = oldSREG;
+}
+
+
+
+//
+// read the Timer5 count, an interrupt that reads the timer between the two bytes would spoil
+// the high byte so interrupts are held off
+//  Exit:  count in 0.5us units returned
+//
+unsigned int profileReadTimer()
+{
+  byte oldSREG;
+  unsigned int count;
+
+  oldSREG = SREG;
+  cli();
+  count = TCNT5;
+  SREG = oldSREG;
+  return(count);
+}
+
+
+
+//
+// add the time of one pass through a region to its statistics
+//  Enter: region = region timed
+//         elapsedCounts = Timer5 counts from the start to the end of the region
+//
+void profileRecord(byte region, unsigned int elapsedCounts)
+{
+  PROFILE_REGION *stats;
+  byte bin;
+  unsigned int counts;
+
+  stats = &profileRegions[region];
+  if (elapsedCounts < stats->minCounts)
+    stats->minCounts = elapsedCounts;
+  if (elapsedCounts > stats->maxCounts)
+    stats->maxCounts = elapsedCounts;
+  stats->totalCounts += elapsedCounts;
+  stats->sampleCount++;
+
+  //
+  // the bin is the position of the highest bit that is set, the counts stop at their limit
+  //
+  bin = 0;
+  for (counts = elapsedCounts >> 1; counts != 0; counts >>= 1)
+    bin++;
+
+  if (stats->histogram[bin] != 0xffff)
+    stats->histogram[bin]++;
+}
+
+
+
+//
+// copy a region's statistics, interrupts are held off so a region timed by an interrupt is not
+// changed part way through
+//  Enter: region = region to copy
+//         copy -> where to put the statistics
+//
+void profileGetRegion(byte region, PROFILE_REGION *copy)
+{
+  byte oldSREG;
+
+  oldSREG = SREG;
+  cli();
+  *copy = profileRegions[region];
+  SREG = oldSREG;
+}
+
+
+
+//
+// convert Timer5 counts to microseconds
+//  Enter: counts = number of 0.5us counts
+//  Exit:  microseconds returned
+//
+unsigned int profileCountsToMicroseconds(unsigned long counts)
+{
+  return(counts / 2);
+}
+
+
+
+//
+// write the statistics of all the regions to the serial port
+//
+void profileSerialDump()
+{
+  PROFILE_REGION stats;
+
+  Serial.println(F("Profile (region, passes, min us, mean us, max us):"));
+  for (byte region = 0; region < profileRegionCount; region++)
+  {
+    profileGetRegion(region, &stats);
+    Serial.print(ProfileRegionNames[region]);
+    Serial.print(F(", "));
+    Serial.print(stats.sampleCount);
+    if (stats.sampleCount == 0)
+    {
+      Serial.println();
+      continue;
+    }
+
+    Serial.print(F(", "));
+    Serial.print(profileCountsToMicroseconds(stats.minCounts));
+    Serial.print(F(", "));
+    Serial.print(profileCountsToMicroseconds(stats.totalCounts / stats.sampleCount));
+    Serial.print(F(", "));
+    Serial.println(profileCountsToMicroseconds(stats.maxCounts));
+
+    //
+    // the histogram, each bin is shown by the microseconds it starts at
+    //
+    Serial.print(F("  histogram (from us:passes)"));
+    for (byte bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+    {
+      if (stats.histogram[bin] == 0)
+        continue;
+
+      Serial.print(' ');
+      Serial.print(profileCountsToMicroseconds(1UL << bin));
+      Serial.print(':');
+      Serial.print(stats.histogram[bin]);
+    }
+    Serial.println();
+  }
+}
+
+#else
+
+#define PROFILE_BEGIN(region)
+#define PROFILE_END(region)
+
+#endif
+
+
+// -------------------------------------- End --------------------------------------
@@ -15,6 +15,8 @@ void RTCInitialise();
 void RTCSetTimeAndDate(byte year, byte month, byte dayOfMonth, byte dayOfWeek, byte hour, byte minute, byte second);
 void RTCGetTime(byte *hour, byte *minute, byte *second);
 void RTCGetTimeAndDate(byte *year, byte *month, byte *dayOfMonth, byte *dayOfWeek, byte *hour, byte *minute, byte *second);
+void RTCWriteNVRAM(byte address, byte *data, byte count);
+bool RTCReadNVRAM(byte address, byte *data, byte count);
 byte RTC_DecToBCD(byte val);
 byte RTC_BCDToDec(byte val);
 
@@ -149,6 +151,9 @@ void reverseRTCTime(int minutesBackward)
 // constants for the RTC
 //
 #define DS1307_I2C_ADDRESS 0x68
+#define DS1307_NVRAM_REGISTER 0x08              // first register of the battery backed RAM
+#define DS1307_NVRAM_SIZE 56
+#define RTC_NVRAM_CHUNK_SIZE 30                 // the Wire library buffers 32 bytes, including the register pointer
 
 
 // ---------------------------------------------------------------------------------
@@ -225,6 +230,72 @@ void RTCGetTimeAndDate(byte *year, byte *month, byte *dayOfMonth, byte *dayOfWee
 }
 
 
+//
+// write to the real time clock's battery backed RAM, it keeps its values while the power is off
+// and unlike the EEPROM it doesn't wear out
+//  Enter: address = offset in the RAM, 0 - 55
+//         data -> bytes to write
+//         count = number of bytes to write
+//
+void RTCWriteNVRAM(byte address, byte *data, byte count)
+{
+  byte chunkSize;
+
+  while (count > 0)
+  {
+    chunkSize = count;
+    if (chunkSize > RTC_NVRAM_CHUNK_SIZE)
+      chunkSize = RTC_NVRAM_CHUNK_SIZE;
+
+    Wire.beginTransmission(DS1307_I2C_ADDRESS);                 // open I2C line in write mode
+    Wire.write((byte) (DS1307_NVRAM_REGISTER + address));        // set the register pointer
+    for (byte i = 0; i < chunkSize; i++)
+      Wire.write(data[i]);
+    Wire.endTransmission();                                      // end write mode
+
+    address += chunkSize;
+    data += chunkSize;
+    count -= chunkSize;
+  }
+}
+
+
+
+//
+// read from the real time clock's battery backed RAM
+//  Enter: address = offset in the RAM, 0 - 55
+//         data -> where to put the bytes read
+//         count = number of bytes to read
+//  Exit:  true returned on success, false if the clock didn't answer
+//
+bool RTCReadNVRAM(byte address, byte *data, byte count)
+{
+  byte chunkSize;
+
+  while (count > 0)
+  {
+    chunkSize = count;
+    if (chunkSize > RTC_NVRAM_CHUNK_SIZE)
+      chunkSize = RTC_NVRAM_CHUNK_SIZE;
+
+    Wire.beginTransmission(DS1307_I2C_ADDRESS);                 // open I2C line in write mode
+    Wire.write((byte) (DS1307_NVRAM_REGISTER + address));        // set the register pointer
+    if (Wire.endTransmission() != 0)
+      return(false);
+
+    if (Wire.requestFrom(DS1307_I2C_ADDRESS, chunkSize) != chunkSize)
+      return(false);
+    for (byte i = 0; i < chunkSize; i++)
+      data[i] = Wire.read();
+
+    address += chunkSize;
+    data += chunkSize;
+    count -= chunkSize;
+  }
+  return(true);
+}
+
+
 //
 // Convert normal decimal numbers to binary coded decimal
 //
@@ -564,6 +635,8 @@ void LCDPrintCenteredString(char *s, int lineNumber)
   int padding;
   int paddingCount;
   
+  PROFILE_BEGIN(profileLCDPrint);
+
   //
   // move cursor to the beginning of the line
   //
@@ -602,6 +675,8 @@ void LCDPrintCenteredString(char *s, int lineNumber)
     LCDWriteData(0x00);
     paddingCount--;
   }
+
+  PROFILE_END(profileLCDPrint);
 }
 
 
@@ -0,0 +1,154 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Cooperative Task Scheduler                   *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The main loop is a small cooperative scheduler.  Each task is a function that does a little
+// work and returns right away, it must never wait.  A task runs when its period has passed, or
+// as soon as one of the events it waits for is raised.
+//
+// Events are raised by the background interrupts, for example when a button event is queued or
+// a new distance is measured, so the main loop reacts within a pass of the scheduler rather
+// than on the next 20ms poll.
+//
+
+//
+// events that wake tasks, one bit each
+//
+const byte SCHEDULER_EVENT_BUTTON = 0x01;       // a button event has been queued
+const byte SCHEDULER_EVENT_DISTANCE = 0x02;     // a new filtered distance has been measured
+const byte SCHEDULER_EVENT_MOTION = 0x04;       // a transition or motion segment has finished
+const byte SCHEDULER_EVENT_TELEMETRY = 0x08;    // a telemetry frame is ready to send
+
+//
+// most tasks that can be added
+//
+const byte SCHEDULER_MAX_TASKS = 7;
+
+#if PROFILER_ENABLED
+static_assert(PROFILE_FIRST_TASK_REGION + SCHEDULER_MAX_TASKS <= profileRegionCount,
+  "each task needs a profile region");
+#endif
+
+//
+// a task, it runs every periodMS (0 for never) and when any of its wakeEvents are raised
+//
+typedef struct {
+  void (*taskFunction)(void);
+  unsigned int periodMS;
+  byte wakeEvents;
+  unsigned long lastRunTimeMS;
+} SCHEDULER_TASK;
+
+//
+// function prototypes
+//
+void schedulerInitialize();
+bool schedulerAddTask(void (*taskFunction)(void), unsigned int periodMS, byte wakeEvents);
+void schedulerRaiseEvent(byte events);
+void schedulerRun();
+
+
+// ---------------------------------------------------------------------------------
+//                                Scheduler Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the scheduler
+//
+SCHEDULER_TASK schedulerTasks[SCHEDULER_MAX_TASKS];
+byte schedulerTaskCount;
+volatile byte schedulerPendingEvents;           // raised by the interrupts, cleared by schedulerRun()
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the scheduler with no tasks
+//
+void schedulerInitialize()
+{
+  schedulerTaskCount = 0;
+  schedulerPendingEvents = 0;
+}
+
+
+
+//
+// add a task to the scheduler, tasks run in the order they are added
+//  Enter: taskFunction -> function to run
+//         periodMS = how often to run the task, 0 to only run it for events
+//         wakeEvents = events that run the task as soon as they are raised
+//  Exit:  true returned on success, false if there are too many tasks
+//
+bool schedulerAddTask(void (*taskFunction)(void), unsigned int periodMS, byte wakeEvents)
+{
+  SCHEDULER_TASK *task;
+
+  if (schedulerTaskCount >= SCHEDULER_MAX_TASKS)
+    return(false);
+
+  task = &schedulerTasks[schedulerTaskCount];
+  task->taskFunction = taskFunction;
+  task->periodMS = periodMS;
+  task->wakeEvents = wakeEvents;
+  task->lastRunTimeMS = millis();
+  schedulerTaskCount++;
+  return(true);
+}
+
+
+
+//
+// raise events, waking the tasks that wait for them, this may be called from an interrupt
+//  Enter: events = one or more SCHEDULER_EVENT_ bits
+//
+void schedulerRaiseEvent(byte events)
+{
+  byte oldSREG;
+
+  oldSREG = SREG;
+  cli();
+  schedulerPendingEvents |= events;
+  SREG = oldSREG;
+}
+
+
+
+//
+// run each task that is due or has been woken, call this over and over from loop()
+//
+void schedulerRun()
+{
+  byte events;
+  unsigned long currentTime;
+  SCHEDULER_TASK *task;
+
+  //
+  // take the events raised since the last pass, any raised while the tasks run are seen on
+  // the next pass
+  //
+  cli();
+  events = schedulerPendingEvents;
+  schedulerPendingEvents = 0;
+  sei();
+
+  for (byte i = 0; i < schedulerTaskCount; i++)
+  {
+    task = &schedulerTasks[i];
+    currentTime = millis();
+
+    if ((events & task->wakeEvents) ||
+        ((task->periodMS != 0) && ((currentTime - task->lastRunTimeMS) >= task->periodMS)))
+    {
+      task->lastRunTimeMS = currentTime;
+      PROFILE_BEGIN(PROFILE_FIRST_TASK_REGION + i);
+      task->taskFunction();
+      PROFILE_END(PROFILE_FIRST_TASK_REGION + i);
+    }
+  }
+}
+
+
+// -------------------------------------- End --------------------------------------
@@ -0,0 +1,340 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                    Binary Telemetry Stream                     *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The telemetry shows what the motors and backlight are doing while the sculpture runs.  Every
+// tick of the background process (up to 100 times a second) a frame is captured: the desired
+// and measured speed, PWM and integrator of each motor, the progress of the disk and backlight
+// transitions, the backlight color and the visitor's distance.
+//
+// The frame has a CRC-16 added and is COBS encoded so it contains no zero bytes, then a zero is
+// added to mark its end.  A receiver that starts part way through, or that sees the text written
+// by the Diagnostics mode mixed in, finds the start of the next frame at the next zero and
+// throws away anything whose CRC doesn't match.  tools/TelemetryDecoder.cpp turns the stream
+// into CSV.
+//
+// The background process encodes each frame into one of two buffers.  The telemetry task hands
+// the other buffer to the serial port only as fast as there is room in its transmit buffer, the
+// port's transmit interrupt then sends it, so neither the background process nor the main loop
+// ever waits on the serial port.  If both buffers are full the frame is dropped and counted, the
+// frame's sequence number shows the receiver where frames are missing.
+//
+
+//
+// set to true to start sending the telemetry when the power is turned on
+//
+#define TELEMETRY_AT_POWER_UP false
+
+//
+// telemetry constants
+//
+const byte TELEMETRY_FRAME_MOTION = 1;          // type of the frame below
+const byte TELEMETRY_PERIOD_TICKS = 1;          // 10ms ticks between frames, 1 for 100 frames a second
+
+//
+// the frame sent, multi-byte values are little endian
+//
+typedef struct {
+  byte frameType;                               // TELEMETRY_FRAME_MOTION
+  byte sequence;                                // counts up by one for each frame, including those dropped
+  unsigned long timeMS;
+  int desiredRPM1;                              // motor RPM, positive is counter-clockwise
+  int measuredRPM1;
+  byte pwm1;
+  int integrator1;
+  int desiredRPM2;
+  int measuredRPM2;
+  byte pwm2;
+  int integrator2;
+  byte diskTransitionProgress;                  // 0 to 255 as the transition runs, 255 when complete
+  byte backlightTransitionProgress;
+  byte red;
+  byte green;
+  byte blue;
+  unsigned int distanceInMM;                    // filtered distance to the visitor, 0 if nobody is seen
+} TELEMETRY_FRAME;
+
+//
+// size of an encoded frame: the frame and CRC, a COBS code byte and the zero that ends it
+//
+const byte TELEMETRY_ENCODED_SIZE = sizeof(TELEMETRY_FRAME) + 2 + 1 + 1;
+
+static_assert(sizeof(TELEMETRY_FRAME) + 2 < 254, "a COBS encoded frame can have only one code byte");
+
+//
+// function prototypes
+//
+void telemetryInitialize();
+void telemetryEnable(bool enableFlg);
+bool telemetryIsEnabled();
+void telemetryCapture();
+void telemetryTask();
+byte telemetryTransitionProgress(unsigned long startTimeMS, unsigned long durationMS, bool completeFlg);
+unsigned int telemetryCRC16Update(unsigned int crc, byte data);
+byte telemetryCOBSEncode(byte *source, byte length, byte *destination);
+
+
+// ---------------------------------------------------------------------------------
+//                                Telemetry Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the telemetry, the buffers are filled by the background process
+// and emptied by the telemetry task
+//
+volatile bool telemetryEnabledFlg;
+byte telemetryTickCount;
+byte telemetrySequence;
+byte telemetryBuffers[2][TELEMETRY_ENCODED_SIZE];
+volatile byte telemetryBufferLength[2];        // length of the frame in each buffer, 0 if free
+byte telemetryFillBuffer;                       // next buffer filled by the background process
+byte telemetrySendBuffer;                       // next buffer sent by the telemetry task
+byte telemetrySendIndex;                        // bytes of the send buffer already sent
+volatile unsigned int telemetryDroppedCount;
+
+// ---------------------------------------------------------------------------------
+
+//
+// initialize the telemetry with both buffers free
+//
+void telemetryInitialize()
+{
+  telemetryTickCount = 0;
+  telemetrySequence = 0;
+  telemetryBufferLength[0] = 0;
+  telemetryBufferLength[1] = 0;
+  telemetryFillBuffer = 0;
+  telemetrySendBuffer = 0;
+  telemetrySendIndex = 0;
+  telemetryDroppedCount = 0;
+  telemetryEnabledFlg = TELEMETRY_AT_POWER_UP;
+}
+
+
+
+//
+// start or stop sending the telemetry, a frame part way through being sent is finished
+//  Enter: enableFlg = true to send the telemetry
+//
+void telemetryEnable(bool enableFlg)
+{
+  telemetryEnabledFlg = enableFlg;
+}
+
+
+
+//
+// check if the telemetry is being sent
+//  Exit:  true returned if it is
+//
+bool telemetryIsEnabled()
+{
+  return(telemetryEnabledFlg);
+}
+
+
+
+//
+// capture a frame and encode it into the free buffer, called by the background process after
+// the motors have been servoed
+//
+void telemetryCapture()
+{
+  TELEMETRY_FRAME frame;
+  byte rawFrame[sizeof(TELEMETRY_FRAME) + 2];
+  byte *buffer;
+  byte length;
+  unsigned int crc;
+
+  if (!telemetryEnabledFlg)
+    return;
+
+  telemetryTickCount++;
+  if (telemetryTickCount < TELEMETRY_PERIOD_TICKS)
+    return;
+  telemetryTickCount = 0;
+
+  //
+  // drop the frame if the telemetry task hasn't finished sending the buffer
+  //
+  if (telemetryBufferLength[telemetryFillBuffer] != 0)
+  {
+    telemetrySequence++;
+    telemetryDroppedCount++;
+    return;
+  }
+
+  //
+  // capture the frame
+  //
+  frame.frameType = TELEMETRY_FRAME_MOTION;
+  frame.sequence = telemetrySequence++;
+  frame.timeMS = millis();
+
+  frame.desiredRPM1 = motorDesiredDirection1 == DIRECTION_CCW ? motorDesiredSpeedInRPM1 : -motorDesiredSpeedInRPM1;
+  frame.measuredRPM1 = motorMeasuredRPM1;
+  frame.pwm1 = motorPWM1;
+  frame.integrator1 = motorIntegratedSpeedError1;
+
+  frame.desiredRPM2 = motorDesiredDirection2 == DIRECTION_CCW ? motorDesiredSpeedInRPM2 : -motorDesiredSpeedInRPM2;
+  frame.measuredRPM2 = motorMeasuredRPM2;
+  frame.pwm2 = motorPWM2;
+  frame.integrator2 = motorIntegratedSpeedError2;
+
+  frame.diskTransitionProgress = telemetryTransitionProgress(diskVelocitiesTransitionStartTimeMS,
+    diskVelocitiesTransitionDurationMS, diskVelocitiesTransitionCompleteFlg);
+  frame.backlightTransitionProgress = telemetryTransitionProgress(backlightTransitionStartTimeMS,
+    backlighttransitionDurationMS, backlightTransitionCompleteFlg);
+
+  frame.red = backlightCurrentRed;
+  frame.green = backlightCurrentGreen;
+  frame.blue = backlightCurrentBlue;
+  frame.distanceInMM = ultrasonicGetFilteredDistanceInMM();
+
+  //
+  // add the CRC, then encode the frame into the buffer ending it with a zero
+  //
+  memcpy(rawFrame, &frame, sizeof(frame));
+  crc = 0xffff;
+  for (byte i = 0; i < sizeof(frame); i++)
+    crc = telemetryCRC16Update(crc, rawFrame[i]);
+  rawFrame[sizeof(frame)] = crc & 0xff;
+  rawFrame[sizeof(frame) + 1] = crc >> 8;
+
+  buffer = telemetryBuffers[telemetryFillBuffer];
+  length = telemetryCOBSEncode(rawFrame, sizeof(rawFrame), buffer);
+  buffer[length++] = 0;
+
+  //
+  // hand the buffer to the telemetry task
+  //
+  telemetryBufferLength[telemetryFillBuffer] = length;
+  telemetryFillBuffer ^= 1;
+  schedulerRaiseEvent(SCHEDULER_EVENT_TELEMETRY);
+}
+
+
+
+//
+// send the encoded frames to the serial port, writing no more than there is room for in its
+// transmit buffer so this never waits, run by the scheduler
+//
+void telemetryTask()
+{
+  byte length;
+  int count;
+
+  while (true)
+  {
+    length = telemetryBufferLength[telemetrySendBuffer];
+    if (length == 0)
+      return;
+
+    count = length - telemetrySendIndex;
+    if (count > Serial.availableForWrite())
+      count = Serial.availableForWrite();
+    if (count <= 0)
+      return;
+
+    Serial.write(&telemetryBuffers[telemetrySendBuffer][telemetrySendIndex], count);
+    telemetrySendIndex += count;
+    if (telemetrySendIndex < length)
+      return;
+
+    //
+    // the whole frame has been sent, free the buffer for the background process
+    //
+    telemetrySendIndex = 0;
+    telemetryBufferLength[telemetrySendBuffer] = 0;
+    telemetrySendBuffer ^= 1;
+  }
+}
+
+
+
+//
+// find how far a transition has run
+//  Enter: startTimeMS = time the transition starts, it may not have started yet
+//         durationMS = length of the transition
+//         completeFlg = true if the transition is complete
+//  Exit:  0 at the start to 255 when complete returned
+//
+byte telemetryTransitionProgress(unsigned long startTimeMS, unsigned long durationMS, bool completeFlg)
+{
+  long elapsedMS;
+
+  if (completeFlg || (durationMS == 0))
+    return(255);
+
+  elapsedMS = millis() - startTimeMS;
+  if (elapsedMS <= 0)
+    return(0);
+  if ((unsigned long) elapsedMS >= durationMS)
+    return(255);
+
+  return(((unsigned long) elapsedMS * 255UL) / durationMS);
+}
+
+
+
+//
+// add a byte to a CRC-16/CCITT (polynomial 0x1021, start with 0xffff), computed a byte at a
+// time without a table
+//  Enter: crc = CRC of the bytes so far
+//         data = byte to add
+//  Exit:  new CRC returned
+//
+unsigned int telemetryCRC16Update(unsigned int crc, byte data)
+{
+  crc = (crc >> 8) | (crc << 8);
+  crc ^= data;
+  crc ^= (crc & 0xff) >> 4;
+  crc ^= crc << 12;
+  crc ^= (crc & 0xff) << 5;
+  return(crc);
+}
+
+
+
+//
+// COBS encode bytes, replacing each zero with the count of bytes to the next one so the result
+// has no zeros.  The bytes must be shorter than 254.
+//  Enter: source -> bytes to encode
+//         length = number of bytes
+//         destination -> where to put the encoded bytes, length + 1 long
+//  Exit:  length of the encoded bytes returned
+//
+byte telemetryCOBSEncode(byte *source, byte length, byte *destination)
+{
+  byte codeIndex;
+  byte outIndex;
+  byte code;
+
+  codeIndex = 0;
+  outIndex = 1;
+  code = 1;
+
+  for (byte i = 0; i < length; i++)
+  {
+    if (source[i] == 0)
+    {
+      destination[codeIndex] = code;
+      codeIndex = outIndex++;
+      code = 1;
+    }
+    else
+    {
+      destination[outIndex++] = source[i];
+      code++;
+    }
+  }
+
+  destination[codeIndex] = code;
+  return(outIndex);
+}
+
+
+// -------------------------------------- End --------------------------------------
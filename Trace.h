@@ -0,0 +1,293 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                      Circular Event Trace                      *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The trace keeps the most recent events in a ring of small records, so when a disk stalls or
+// jerks what led up to it can be pieced together afterwards.  The events traced are the PI
+// loop outputs, the starts of the disk and backlight transitions, mode changes, button events,
+// echo results and, when turned on, the tachometer edges.  Each record is stamped with the low
+// 16 bits of the free running Timer5 count (0.5us per count).  The PI loops add a record every
+// 10ms, so no two records are further apart than the 32ms it takes the count to go around and
+// tools/TraceTimeline.cpp can rebuild the full time from it.  The trace is paused while it is
+// written to the serial port, which takes longer than that, so a resync record holding the full
+// time from micros() is added just before and just after the pause.
+//
+// TRACE() adds a record, it holds interrupts off for the few instructions it takes so it can be
+// used from any interrupt.  When a fault is found, such as a motor that is stalled or whose
+// speed jumps, or a background pass that runs late, TRACE_FAULT() adds a fault record and the
+// trace freezes after a quarter of the ring more, keeping what happened before and just after.
+// The frozen trace is written to the serial port when the Diagnostics mode is entered and is
+// kept until the Diagnostics mode is left.
+//
+// The tachometer edges come thousands of times a second and fill the ring in a few tens of
+// milliseconds, so they are only traced when traceTachEdgesFlg is set.
+//
+// Set TRACE_ENABLED to false to compile the trace out, the macros then generate no code at all.
+//
+#define TRACE_ENABLED true
+
+//
+// the events traced, what the arg and values hold is given for each
+//
+enum TraceTypes {
+  traceNone,
+  traceTachEdge1,               // arg: -, value1: microseconds between lines (0xffff if longer)
+  traceTachEdge2,
+  tracePIOutput1,               // arg: PWM, value1: measured motor RPM, value2: speed error
+  tracePIOutput2,
+  traceDiskTransition,          // arg: duration in 100ms (255 if longer), value1/2: outer/inner disk RPM x 10
+  traceBacklightTransition,     // arg: red, value1: green << 8 | blue, value2: duration in ms (32767 if longer)
+  traceModeChange,              // arg: mode started
+  traceButtonEvent,             // arg: button, value1: event
+  traceEcho,                    // arg: sensor, value1: distance in mm (0 if no echo), value2: filtered distance
+  traceFault,                   // arg: TraceFaults, value1/2: depend on the fault
+  traceResync                   // arg: -, value1/2: low/high 16 bits of micros()
+};
+
+//
+// the faults that freeze the trace
+//
+enum TraceFaults {
+  traceFaultStall = 1,          // value1: motor, value2: measured motor RPM
+  traceFaultJerk,               // value1: motor, value2: change in measured motor RPM
+  traceFaultOverrun             // value1: ticks late, value2: pass time in Timer3 counts
+};
+
+#if TRACE_ENABLED
+
+#define TRACE(type, arg, value1, value2) traceAppend(type, arg, value1, value2)
+#define TRACE_FAULT(fault, value1, value2) traceFreeze(fault, value1, value2)
+
+//
+// a trace record, multi-byte values are little endian
+//
+typedef struct {
+  unsigned int timeCount;                       // low 16 bits of Timer5, 0.5us per count
+  byte type;
+  byte arg;
+  int value1;
+  int value2;
+} TRACE_RECORD;
+
+//
+// trace constants, the number of records must be a power of 2
+//
+const byte TRACE_RECORD_COUNT = 128;
+const byte TRACE_RECORDS_AFTER_FAULT = TRACE_RECORD_COUNT / 4;
+const unsigned int TRACE_RUNNING = 0xffff;      // traceRecordsLeft while not frozen
+
+//
+// function prototypes
+//
+void traceInitialize();
+void traceAppend(byte type, byte arg, int value1, int value2);
+void traceFreeze(byte fault, int value1, int value2);
+bool traceIsFrozen();
+byte traceGetFault();
+void traceRearm();
+void traceResyncTime();
+void traceSerialDump();
+
+
+// ---------------------------------------------------------------------------------
+//                                  Trace Functions
+// ---------------------------------------------------------------------------------
+
+//
+// global variables used by the trace
+//
+TRACE_RECORD traceRecords[TRACE_RECORD_COUNT];
+volatile byte traceHead;                        // index of the next record written
+volatile bool traceWrappedFlg;                  // true once the ring has been filled
+volatile unsigned int traceRecordsLeft;         // records until frozen, TRACE_RUNNING if no fault
+volatile byte traceFaultCode;                   // first fault since rearmed, 0 if none
+volatile bool traceDumpingFlg;                  // true while the trace is written to the serial port
+bool traceTachEdgesFlg;
+
+// ---------------------------------------------------------------------------------
+
+//
+// start the trace with an empty ring
+//
+void traceInitialize()
+{
+  traceTachEdgesFlg = false;
+  traceRearm();
+}
+
+
+
+//
+// add a record to the trace, this may be called from an interrupt
+//  Enter: type = TraceTypes event
+//         arg, value1, value2 = what happened, see TraceTypes
+//
+void traceAppend(byte type, byte arg, int value1, int value2)
+{
+  byte oldSREG;
+  TRACE_RECORD *record;
+
+  oldSREG = SREG;
+  cli();
+  if ((traceRecordsLeft != 0) && !traceDumpingFlg)
+  {
+    record = &traceRecords[traceHead];
+    record->timeCount = TCNT5;
+    record->type = type;
+    record->arg = arg;
+    record->value1 = value1;
+    record->value2 = value2;
+
+    traceHead = (traceHead + 1) & (TRACE_RECORD_COUNT - 1);
+    if (traceHead == 0)
+      traceWrappedFlg = true;
+
+    if (traceRecordsLeft != TRACE_RUNNING)
+      traceRecordsLeft--;
+  }
+  SREG = oldSREG;
+}
+
+
+
+//
+// record a fault and freeze the trace once the records after it have been added, a fault
+// found after the first is traced but doesn't move when the trace freezes
+//  Enter: fault = TraceFaults fault
+//         value1, value2 = details, see TraceFaults
+//
+void traceFreeze(byte fault, int value1, int value2)
+{
+  byte oldSREG;
+
+  traceAppend(traceFault, fault, value1, value2);
+
+  oldSREG = SREG;
+  cli();
+  if (traceFaultCode == 0)
+  {
+    traceFaultCode = fault;
+    traceRecordsLeft = TRACE_RECORDS_AFTER_FAULT;
+  }
+  SREG = oldSREG;
+}
+
+
+
+//
+// check if the trace has been frozen by a fault
+//  Exit:  true returned if frozen, or about to be
+//
+bool traceIsFrozen()
+{
+  return(traceRecordsLeft != TRACE_RUNNING);
+}
+
+
+
+//
+// get the fault that froze the trace
+//  Exit:  TraceFaults fault returned, 0 if none
+//
+byte traceGetFault()
+{
+  return(traceFaultCode);
+}
+
+
+
+//
+// empty the trace and start it running again
+//
+void traceRearm()
+{
+  byte oldSREG;
+
+  oldSREG = SREG;
+  cli();
+  traceHead = 0;
+  traceWrappedFlg = false;
+  traceFaultCode = 0;
+  traceRecordsLeft = TRACE_RUNNING;
+  traceDumpingFlg = false;
+  SREG = oldSREG;
+}
+
+
+
+//
+// add a record holding the full time, so the time of the records around a gap of more than
+// one turn of the Timer5 count can be rebuilt
+//
+void traceResyncTime()
+{
+  unsigned long currentTime;
+
+  currentTime = micros();
+  traceAppend(traceResync, 0, (int) (currentTime & 0xffff), (int) (currentTime >> 16));
+}
+
+
+
+//
+// write the trace to the serial port, oldest record first, as lines that
+// tools/TraceTimeline.cpp reads:
+//
+//   TRACE BEGIN records fault
+//   TRACE ttttyyaavvvvwwww           one for each record, its bytes in hex
+//   TRACE END
+//
+// The trace is paused while it is written so the records don't change underneath it, a fault
+// found meanwhile still freezes it once it carries on.  The pause is bracketed by resync
+// records so the records added after it can be timed.
+//
+void traceSerialDump()
+{
+  byte first;
+  byte count;
+  byte *bytes;
+
+  traceResyncTime();
+
+  cli();
+  traceDumpingFlg = true;
+  sei();
+
+  first = traceWrappedFlg ? traceHead : 0;
+  count = traceWrappedFlg ? TRACE_RECORD_COUNT : traceHead;
+
+  Serial.print(F("TRACE BEGIN "));
+  Serial.print(count);
+  Serial.print(' ');
+  Serial.println(traceFaultCode);
+
+  for (byte i = 0; i < count; i++)
+  {
+    bytes = (byte *) &traceRecords[(first + i) & (TRACE_RECORD_COUNT - 1)];
+    Serial.print(F("TRACE "));
+    for (byte j = 0; j < sizeof(TRACE_RECORD); j++)
+    {
+      if (bytes[j] < 0x10)
+        Serial.print('0');
+      Serial.print(bytes[j], HEX);
+    }
+    Serial.println();
+  }
+  Serial.println(F("TRACE END"));
+
+  traceDumpingFlg = false;
+  traceResyncTime();
+}
+
+#else
+
+#define TRACE(type, arg, value1, value2)
+#define TRACE_FAULT(fault, value1, value2)
+
+#endif
+
+
+// -------------------------------------- End --------------------------------------
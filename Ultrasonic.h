@@ -1,4 +1,3 @@
-
 //      ******************************************************************
 //      *                                                                *
 //      *                   Ultrasonic Hardware Control                  *
@@ -12,17 +11,140 @@
 // measurement constants
 //
 const long ULTRASONIC_TIMEOUT_PERIOD = 60000;
-const byte kMinDistanceInCM = 3;
+const int kMinDistanceInMM = 30;
+
+//
+// Timer5 runs free with a prescaler of 8, giving a count every 0.5us.  The trigger pulse is
+// 20 counts (10us) plus the time to enter the compare interrupt.
+//
+const unsigned int ULTRASONIC_TRIGGER_PULSE_COUNTS = 20;
+
+//
+// distance conversion constants, the distance is: (echoCounts * scale) / 65536 + offset.  The
+// speed of sound in meters per second is 331.3 + 0.606 * degreesC, with the round trip and 0.5us
+// counts this gives a Q16 scale of 16.384 times the speed of sound
+//
+const float ULTRASONIC_SPEED_OF_SOUND_AT_0C = 331.3;
+const float ULTRASONIC_SPEED_OF_SOUND_PER_DEGREE_C = 0.606;
+const float ULTRASONIC_SCALE_Q16_PER_SPEED_OF_SOUND = 16.384;
+const int ULTRASONIC_DEFAULT_TEMPERATURE_C = 20;
+const byte ULTRASONIC_CALIBRATION_SIGNATURE = 0xa5;
+
+//
+// to calibrate, place a flat target at these distances from the sensor in Meter Stick mode and
+// press Up for the near one and Down for the far one
+//
+const int ULTRASONIC_CALIBRATION_NEAR_MM = 500;
+const int ULTRASONIC_CALIBRATION_FAR_MM = 2000;
+
+//
+// the calibration saved in EEPROM
+//
+typedef struct {
+  byte signature;                               // ULTRASONIC_CALIBRATION_SIGNATURE when valid
+  unsigned long scaleQ16;                       // scale at the calibration temperature
+  int offsetInMM;
+  int temperatureC;                             // temperature when calibrated
+} ULTRASONIC_CALIBRATION;
+const byte ULTRASONIC_ECHO_PORTE_BIT = 5;               // D3 = PE5 = INT5
+
+//
+// the ultrasonic sensors, sensor 0 is the standard one with its trigger on D4 and its echo on D3
+// (INT5).  Larger installations may add sensors with triggers on port A and echoes on D66 - D69
+// (PK4 - PK7), these use the pin change interrupt.  Set ULTRASONIC_SENSOR_COUNT to the number
+// installed, and each sensor's bearing to the direction it faces, in degrees with 0 straight out
+// from the front of the sculpture and positive to the right.
+//
+const byte ULTRASONIC_SENSOR_COUNT = 1;
+const byte ULTRASONIC_ECHO_ON_INT5 = 0xff;
+
+typedef struct {
+  volatile uint8_t *triggerPort;
+  byte triggerBit;
+  byte triggerPin;
+  byte echoPin;
+  byte echoPortKBit;                            // bit on port K, or ULTRASONIC_ECHO_ON_INT5
+  int bearingInDegrees;
+} ULTRASONIC_SENSOR;
+
+const ULTRASONIC_SENSOR UltrasonicSensors[] = {
+  {&PORTG, 5, ULTRASONIC_TRIGGER_PIN, ULTRASONIC_ECHO_PIN, ULTRASONIC_ECHO_ON_INT5,   0},    // D4, D3
+  {&PORTA, 0, 22,                     66,                  4,                       -45},    // D22 = PA0, D66 = PK4
+  {&PORTA, 1, 23,                     67,                  5,                        45},    // D23 = PA1, D67 = PK5
+  {&PORTA, 2, 24,                     68,                  6,                       -90},    // D24 = PA2, D68 = PK6
+  {&PORTA, 3, 25,                     69,                  7,                        90}     // D25 = PA3, D69 = PK7
+};
+
+static_assert(ULTRASONIC_SENSOR_COUNT <= sizeof(UltrasonicSensors) / sizeof(ULTRASONIC_SENSOR),
+  "ULTRASONIC_SENSOR_COUNT is more than the sensors in UltrasonicSensors[]");
+
+//
+// sensors are fired one at a time, the next one is not fired until the last one's echo has been
+// received (or timed out) and this guard time has passed, so no two sensors ever hear each
+// other's sound
+//
+const int ULTRASONIC_GUARD_MS = 20;
+
+//
+// sensors seeing distances within this of the nearest are taken to be seeing the same visitor
+//
+const int ULTRASONIC_FUSION_TOLERANCE_MM = 150;
+
+//
+// background ranging constants
+//
+const int ULTRASONIC_MIN_RANGING_PERIOD_MS = 60;        // each sensor needs at least 60ms between measurements
+const int ULTRASONIC_DEFAULT_RANGING_PERIOD_MS = 100;
+const byte ULTRASONIC_SAMPLE_RING_SIZE = 8;              // must be a power of 2
+const byte ULTRASONIC_MEDIAN_SAMPLES = 5;                // must be odd and no more than the ring size
+const byte ULTRASONIC_FILTER_SHIFT = 2;                  // exponential filter weight of 1/4 for each new sample
+const byte ULTRASONIC_FILTER_FRACTION_BITS = 4;
+
+//
+// approach tracker constants, an alpha-beta filter follows the visitor's distance and speed.
+// The gains are fractions in 1/256ths, higher gains follow faster but pass more noise.
+//
+const byte ULTRASONIC_TRACKER_FRACTION_BITS = 8;
+const int ULTRASONIC_TRACKER_ALPHA = 128;                // 0.5
+const int ULTRASONIC_TRACKER_BETA = 26;                  // 0.1
+const int ULTRASONIC_TRACKER_MAX_SPEED = 5 << ULTRASONIC_TRACKER_FRACTION_BITS;  // 5 mm/ms, faster is a bad sample
 
 //
 // function prototypes
 //
 void showMeterStickMode();
 void ultrasonicInitialize();                     // initializes the ultrasonic
-void ultrasonicStartMeasurement();               // starts an ultrasonic measurement
+void ultrasonicStartMeasurement(byte sensor);    // starts an ultrasonic measurement
 bool ultrasonicIsFinished();                     // returns true when measurement is done, otherwise false
 int ultrasonicGetDistanceInCM();                 // returns the measurement distance in CM
+int ultrasonicGetDistanceInMM();                 // returns the measurement distance in MM
+int ultrasonicConvertEchoToMM(unsigned long echoCounts);
+unsigned long ultrasonicScaleForTemperature(int temperatureC);
+void ultrasonicLoadCalibration();
+bool ultrasonicCalibrate(unsigned long nearEchoCounts, unsigned long farEchoCounts);
+void ultrasonicSaveCalibration();
+void ultrasonicSetOffset(int offsetInMM);
+void ultrasonicSetTemperature(int temperatureC);
+void ultrasonicUpdateScale();
+unsigned long ultrasonicReadTimer();
 void ultrasonicEchoISR();                        // Interrupt Service Routine to make measurements
+void ultrasonicEchoEdge(bool echoHighFlg, unsigned long count);
+void ultrasonicSetRangingPeriod(int periodMS);   // sets how often background measurements are made
+int ultrasonicGetFilteredDistanceInCM();         // returns the filtered distance in CM, 0 if nothing seen
+int ultrasonicGetFilteredDistanceInMM();         // returns the filtered distance in MM, 0 if nothing seen
+unsigned long ultrasonicGetFilteredDistanceTimeMS(); // returns the time of the last filtered distance
+unsigned long ultrasonicGetFilteredEchoCounts(); // returns the filtered distance as an echo width
+void ultrasonicTrackerUpdate(unsigned int distanceInMM);
+int ultrasonicGetPredictedDistanceInCM(unsigned int aheadMS); // returns where the visitor will be
+int ultrasonicGetPredictedDistanceInMM(unsigned int aheadMS);
+int ultrasonicGetApproachSpeedInMMPerS();        // returns how fast the visitor is coming closer
+void ultrasonicBackgroundRanging();              // makes measurements in the background, called every 10ms
+void ultrasonicFilterSample(byte sensor, unsigned int distanceInMM);
+void ultrasonicFuseSensors();
+int ultrasonicGetBearingInDegrees();             // returns the direction of the nearest visitor
+unsigned int ultrasonicMedianOfRecentSamples(byte sensor);
+byte ultrasonicGetSampleCount();                 // returns the number of samples measured, counting up from 0 to 255 and around
+unsigned int ultrasonicGetSample(byte sampleNumber);
 
 
 
@@ -38,7 +160,10 @@ void ultrasonicEchoISR();                        // Interrupt Service Routine to
 // The transducer needs a high level trigger signal of at least 10us to start
 // a measurement.
 //
-// The Echo pin falls low when an echo is detected.
+// The Echo pin rises when the sound burst is sent and falls low when an echo is
+// detected, so the width of the echo pulse is the round trip time.  Both edges are
+// timestamped with Timer5, which avoids the 4us resolution of micros() and the
+// delay between the trigger and the burst.
 //
 // A minimum of 60ms is recommend from the start of one measurment until the
 // start of the next one.
@@ -50,8 +175,60 @@ void ultrasonicEchoISR();                        // Interrupt Service Routine to
 //
 byte nextRed, nextBlue, nextGreen;
 unsigned long ultrasonicStartTime;
-unsigned long ultrasonicEchoTime;
-bool ultrasonicMeasurementCompleteFlg;
+volatile unsigned long ultrasonicEchoCounts;     // width of the echo pulse in 0.5us counts
+volatile unsigned long ultrasonicEchoRiseCount;
+volatile bool ultrasonicEchoStartedFlg;
+volatile bool ultrasonicMeasurementCompleteFlg;
+volatile unsigned int ultrasonicTimerOverflowCount;
+volatile byte ultrasonicActiveSensor;            // sensor being measured
+volatile byte ultrasonicPortKEchoes;             // port K echo pins at the last pin change
+
+
+//
+// global variables used to convert echo widths to distances
+//
+ULTRASONIC_CALIBRATION ultrasonicCalibration;
+int ultrasonicTemperatureC;
+unsigned long ultrasonicScaleQ16;               // calibrated scale corrected for the temperature
+int ultrasonicOffsetInMM;
+
+
+//
+// the samples and filter of each sensor, the samples are distances in millimeters, with 0
+// meaning that no echo was received
+//
+typedef struct {
+  unsigned int sampleRing[ULTRASONIC_SAMPLE_RING_SIZE];
+  byte sampleRingIdx;                           // counts every sample, the ring entry is this masked
+  int elapsedMS;                                // time since the sensor was last fired
+  unsigned int medianInMM;
+  bool filterResetFlg;
+  unsigned long filteredDistance;               // fixed point with ULTRASONIC_FILTER_FRACTION_BITS
+  int filteredDistanceInMM;
+} ULTRASONIC_SENSOR_STATE;
+
+
+//
+// global variables used by the background ranging, the filtered distance and bearing are of
+// the nearest visitor seen by any of the sensors
+//
+int ultrasonicRangingPeriodMS;
+int ultrasonicGuardElapsedMS;
+bool ultrasonicRangingInProgressFlg;
+ULTRASONIC_SENSOR_STATE ultrasonicSensorStates[ULTRASONIC_SENSOR_COUNT];
+int ultrasonicFilteredDistanceInMM;
+int ultrasonicBearingInDegrees;
+unsigned long ultrasonicFilteredDistanceTimeMS;
+
+
+//
+// global variables used by the approach tracker, the distance is in 1/256ths of a mm and the
+// velocity in 1/256ths of a mm per ms, positive going away from the sensor
+//
+bool ultrasonicTrackerValidFlg;
+long ultrasonicTrackerDistance;
+long ultrasonicTrackerVelocity;
+unsigned long ultrasonicTrackerTimeMS;
 
 // ---------------------------------------------------------------------------------
 
@@ -61,40 +238,136 @@ bool ultrasonicMeasurementCompleteFlg;
 void ultrasonicInitialize(void)
 {  
   //
-  // setup the IO pins
+  // setup the IO pins, starting with the triggers off
   //
-  pinMode(ULTRASONIC_TRIGGER_PIN, OUTPUT);
-  pinMode(ULTRASONIC_ECHO_PIN, INPUT);
+  for (byte sensor = 0; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+  {
+    pinMode(UltrasonicSensors[sensor].triggerPin, OUTPUT);
+    pinMode(UltrasonicSensors[sensor].echoPin, INPUT);
+    digitalWrite(UltrasonicSensors[sensor].triggerPin, 0);
+  }
 
   //
-  // start with the trigger off
+  // get the distance calibration from EEPROM
   //
-  digitalWrite(ULTRASONIC_TRIGGER_PIN, 0);
+  ultrasonicLoadCalibration();
 
   //
-  // attach the echo pin to an interrupt service routine
+  // setup Timer5 to count freely at 2Mhz, the overflow interrupt extends the count to 32 bits
+  // and the compare A interrupt ends the trigger pulse
   //
-  attachInterrupt(1, ultrasonicEchoISR, FALLING);    // interrupt 1 = D3 = echo signal from ultrasonic
+  cli();
+  TCCR5A = 0;                                     // normal mode, no outputs
+  TCCR5B = (1 << CS51);                           // set the prescaler to divide by 8 giving a 2Mhz count rate
+  TCNT5 = 0;
+  ultrasonicTimerOverflowCount = 0;
+  TIFR5 = (1 << TOV5) | (1 << OCF5A);             // clear any pending interrupts
+  TIMSK5 = (1 << TOIE5);                          // enable the overflow interrupt
+  sei();
+
+  //
+  // attach the echo pin to an interrupt service routine, both edges are needed to measure the
+  // width of the echo pulse
+  //
+  ultrasonicEchoStartedFlg = false;
+  ultrasonicActiveSensor = 0;
+  attachInterrupt(1, ultrasonicEchoISR, CHANGE);    // interrupt 1 = D3 = echo signal from ultrasonic
+
+  //
+  // the added sensors' echoes use the pin change interrupt on port K
+  //
+  for (byte sensor = 1; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+  {
+    PCMSK2 |= (1 << UltrasonicSensors[sensor].echoPortKBit);
+    PCICR |= (1 << PCIE2);
+  }
+  ultrasonicPortKEchoes = PINK;
+
+  //
+  // start the background ranging with an empty set of samples
+  //
+  ultrasonicRangingPeriodMS = ULTRASONIC_DEFAULT_RANGING_PERIOD_MS;
+  ultrasonicGuardElapsedMS = 0;
+  ultrasonicRangingInProgressFlg = false;
+  memset(ultrasonicSensorStates, 0, sizeof(ultrasonicSensorStates));
+  for (byte sensor = 0; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+    ultrasonicSensorStates[sensor].filterResetFlg = true;
+  ultrasonicFilteredDistanceInMM = 0;
+  ultrasonicBearingInDegrees = 0;
+  ultrasonicFilteredDistanceTimeMS = 0;
+  ultrasonicTrackerValidFlg = false;
 }
 
 
 //
-// start an ultrasonic measurement
+// start an ultrasonic measurement, the trigger pulse is ended by the Timer5 compare
+// interrupt so this does not wait
+//  Enter: sensor = sensor to measure with
 //
-void ultrasonicStartMeasurement()
+void ultrasonicStartMeasurement(byte sensor)
 {
   ultrasonicMeasurementCompleteFlg = false;         // indicate that the measurement is not complete
-  digitalWrite(ULTRASONIC_TRIGGER_PIN, 1);          // trigger ultrasonics to start a measurement
+  ultrasonicEchoStartedFlg = false;
+  ultrasonicActiveSensor = sensor;
   ultrasonicStartTime = micros();                   // record the time when the measurement was started
-  delayMicroseconds(50);                            // delay while trigger signal is on
-  digitalWrite(ULTRASONIC_TRIGGER_PIN, 0);          // turn trigger off
+
+  cli();
+  *UltrasonicSensors[sensor].triggerPort |= (1 << UltrasonicSensors[sensor].triggerBit);  // trigger ultrasonics to start a measurement
+  OCR5A = TCNT5 + ULTRASONIC_TRIGGER_PULSE_COUNTS;  // schedule the end of the trigger pulse
+  TIFR5 = (1 << OCF5A);
+  TIMSK5 |= (1 << OCIE5A);
+  sei();
+}
+
+
+
+//
+// interrupt service routine to end the ultrasonic trigger pulse
+//
+ISR(TIMER5_COMPA_vect)
+{
+  *UltrasonicSensors[ultrasonicActiveSensor].triggerPort &= ~(1 << UltrasonicSensors[ultrasonicActiveSensor].triggerBit);  // turn trigger off
+  TIMSK5 &= ~(1 << OCIE5A);
+}
+
+
+
+//
+// interrupt service routine to extend Timer5 to 32 bits
+//
+ISR(TIMER5_OVF_vect)
+{
+  ultrasonicTimerOverflowCount++;
+}
+
+
+
+//
+// read the 32 bit Timer5 count, this must be called with interrupts disabled
+//  Exit:  count in 0.5us units returned
+//
+unsigned long ultrasonicReadTimer()
+{
+  unsigned int count;
+  unsigned int overflowCount;
+
+  count = TCNT5;
+  overflowCount = ultrasonicTimerOverflowCount;
+
+  //
+  // check for an overflow that has happened but not yet been counted by its interrupt
+  //
+  if ((TIFR5 & (1 << TOV5)) && (count < 0x8000))
+    overflowCount++;
+
+  return(((unsigned long) overflowCount << 16) | count);
 }
 
 
 
 //
 // check if the ultrasonic measurement has finished
-//  Exit:  true returned if finished, false returned if not finished
+//  Exit:  true returned if finished, else false
 //
 bool ultrasonicIsFinished()
 {
@@ -109,8 +382,8 @@ bool ultrasonicIsFinished()
   //
   if ((micros() - ultrasonicStartTime) > ULTRASONIC_TIMEOUT_PERIOD)
   {
+    ultrasonicEchoCounts = 0L;
     ultrasonicMeasurementCompleteFlg = true;
-    ultrasonicEchoTime = 0L;
     return(true);
   }
 
@@ -127,43 +400,712 @@ bool ultrasonicIsFinished()
 //
 int ultrasonicGetDistanceInCM()
 {
-  int distanceInCM;
+  return((ultrasonicGetDistanceInMM() + 5) / 10);
+}
+
+
 
+//
+// get the results of the last ultrasonic measurement
+//  Exit:  distance in millimeters returned, 0 returned if no echo
+//
+int ultrasonicGetDistanceInMM()
+{
   ultrasonicMeasurementCompleteFlg = false;
+  return(ultrasonicConvertEchoToMM(ultrasonicEchoCounts));
+}
+
+
+
+//
+// convert the width of an echo pulse to a distance
+//  Enter: echoCounts = width of the echo pulse in 0.5us counts
+//  Exit:  distance in millimeters returned, 0 returned if no echo
+//
+int ultrasonicConvertEchoToMM(unsigned long echoCounts)
+{
+  int distanceInMM;
 
   //
   // check if the measurement timed out, if so return 0
   //
-  if (ultrasonicEchoTime == 0)
+  if (echoCounts == 0)
     return(0);
 
   //
-  // compute the distance to the object in CM
+  // compute the distance to the object in MM
   //
-  //distanceInCM = ((ultrasonicEchoTime - 950L) / 58L);
-  distanceInCM = ((ultrasonicEchoTime - 500L) / 58L);
-  distanceInCM = constrain(distanceInCM, kMinDistanceInCM, distanceInCM);
+  distanceInMM = (int) ((echoCounts * ultrasonicScaleQ16) >> 16) + ultrasonicOffsetInMM;
+  distanceInMM = constrain(distanceInMM, kMinDistanceInMM, distanceInMM);
 
   //
   // return the distance
   //
-  return(distanceInCM);
+  return(distanceInMM);
 }
 
 
 //
-// interrupt service routine for the ultrasonic echo
+// interrupt service routine for sensor 0's echo, called on both edges of the echo pulse
 //
 void ultrasonicEchoISR()
 {
-  unsigned long echoTime;
+  if (UltrasonicSensors[ultrasonicActiveSensor].echoPortKBit != ULTRASONIC_ECHO_ON_INT5)
+    return;
+
+  PROFILE_BEGIN(profileEchoISR);
+  ultrasonicEchoEdge(PINE & (1 << ULTRASONIC_ECHO_PORTE_BIT), ultrasonicReadTimer());
+  PROFILE_END(profileEchoISR);
+}
+
+
+
+//
+// interrupt service routine for the added sensors' echoes, called when any port K pin with its
+// pin change interrupt enabled changes
+//
+ISR(PCINT2_vect)
+{
+  unsigned long count;
+  byte echoes;
+  byte echoBit;
+
+  PROFILE_BEGIN(profileEchoISR);
+  count = ultrasonicReadTimer();
+  echoes = PINK;
+
+  //
+  // only the echo of the sensor being measured is used
+  //
+  echoBit = UltrasonicSensors[ultrasonicActiveSensor].echoPortKBit;
+  if ((echoBit != ULTRASONIC_ECHO_ON_INT5) && ((echoes ^ ultrasonicPortKEchoes) & (1 << echoBit)))
+    ultrasonicEchoEdge(echoes & (1 << echoBit), count);
+
+  ultrasonicPortKEchoes = echoes;
+  PROFILE_END(profileEchoISR);
+}
+
+
+
+//
+// time an edge of the echo pulse of the sensor being measured
+//  Enter: echoHighFlg = true for the rising edge, false for the falling edge
+//         count = Timer5 count when the edge happened
+//
+void ultrasonicEchoEdge(bool echoHighFlg, unsigned long count)
+{
+  //
+  // the rising edge starts the echo pulse
+  //
+  if (echoHighFlg)
+  {
+    ultrasonicEchoRiseCount = count;
+    ultrasonicEchoStartedFlg = true;
+    return;
+  }
 
   //
-  // determine how long in microseconds it took to get the echo
+  // the falling edge ends it, ignore it if the rising edge was missed
   //
-  ultrasonicEchoTime = micros() - ultrasonicStartTime;
+  if (!ultrasonicEchoStartedFlg || ultrasonicMeasurementCompleteFlg)
+    return;
+
+  ultrasonicEchoCounts = count - ultrasonicEchoRiseCount;
+  ultrasonicEchoStartedFlg = false;
   ultrasonicMeasurementCompleteFlg = true;         // indicate that the measurement is complete
 }
 
 
+// ---------------------------------------------------------------------------------
+//                           Ultrasonic Distance Calibration
+// ---------------------------------------------------------------------------------
+
+//
+// get the distance calibration from EEPROM, using the nominal speed of sound if the sculpture
+// has never been calibrated
+//
+void ultrasonicLoadCalibration()
+{
+  EEPROM.get(EEPROM_ULTRASONIC_CALIBRATION_ADDRESS, ultrasonicCalibration);
+
+  if (ultrasonicCalibration.signature != ULTRASONIC_CALIBRATION_SIGNATURE)
+  {
+    ultrasonicCalibration.scaleQ16 = ultrasonicScaleForTemperature(ULTRASONIC_DEFAULT_TEMPERATURE_C);
+    ultrasonicCalibration.offsetInMM = 0;
+    ultrasonicCalibration.temperatureC = ULTRASONIC_DEFAULT_TEMPERATURE_C;
+  }
+
+  ultrasonicTemperatureC = ultrasonicCalibration.temperatureC;
+  ultrasonicUpdateScale();
+}
+
+
+
+//
+// fit the distance conversion to measurements of targets at the two calibration distances and
+// save it in EEPROM
+//  Enter: nearEchoCounts = echo width measured with a target at ULTRASONIC_CALIBRATION_NEAR_MM
+//         farEchoCounts = echo width measured with a target at ULTRASONIC_CALIBRATION_FAR_MM
+//  Exit:  true returned if calibrated, false if the measurements do not make sense
+//
+bool ultrasonicCalibrate(unsigned long nearEchoCounts, unsigned long farEchoCounts)
+{
+  unsigned long scaleQ16;
+
+  //
+  // check that the far target is farther than the near one
+  //
+  if ((nearEchoCounts == 0) || (farEchoCounts <= nearEchoCounts))
+    return(false);
+
+  //
+  // fit the line through the two points
+  //
+  scaleQ16 = ((unsigned long) (ULTRASONIC_CALIBRATION_FAR_MM - ULTRASONIC_CALIBRATION_NEAR_MM) << 16) /
+    (farEchoCounts - nearEchoCounts);
+
+  //
+  // reject a scale more than 25% from the nominal speed of sound
+  //
+  if ((scaleQ16 < ultrasonicScaleForTemperature(ultrasonicTemperatureC) * 3 / 4) ||
+      (scaleQ16 > ultrasonicScaleForTemperature(ultrasonicTemperatureC) * 5 / 4))
+    return(false);
+
+  //
+  // save the calibration, it applies at the current temperature
+  //
+  ultrasonicCalibration.scaleQ16 = scaleQ16;
+  ultrasonicCalibration.offsetInMM = ULTRASONIC_CALIBRATION_NEAR_MM - (int) ((nearEchoCounts * scaleQ16) >> 16);
+  ultrasonicCalibration.temperatureC = ultrasonicTemperatureC;
+  ultrasonicSaveCalibration();
+
+  ultrasonicUpdateScale();
+  return(true);
+}
+
+
+
+//
+// save the distance calibration in EEPROM, it is used from then on when the power is turned on
+//
+void ultrasonicSaveCalibration()
+{
+  ultrasonicCalibration.signature = ULTRASONIC_CALIBRATION_SIGNATURE;
+  EEPROM.put(EEPROM_ULTRASONIC_CALIBRATION_ADDRESS, ultrasonicCalibration);
+}
+
+
+
+//
+// set the offset added to each distance, it is not saved in EEPROM until
+// ultrasonicSaveCalibration() is called
+//  Enter: offsetInMM = millimeters added to the distance computed from the echo width
+//
+void ultrasonicSetOffset(int offsetInMM)
+{
+  ultrasonicCalibration.offsetInMM = offsetInMM;
+  ultrasonicUpdateScale();
+}
+
+
+
+//
+// set the air temperature, the distance conversion is corrected for the change in the speed
+// of sound since the sensor was calibrated.  If never set, the calibration temperature is used.
+//  Enter: temperatureC = air temperature in degrees C
+//
+void ultrasonicSetTemperature(int temperatureC)
+{
+  ultrasonicTemperatureC = temperatureC;
+  ultrasonicUpdateScale();
+}
+
+
+
+//
+// compute the scale used to convert echo widths to distances from the calibration and the
+// current temperature, this is done once here so the conversion of each sample is a multiply
+//
+void ultrasonicUpdateScale()
+{
+  unsigned long scaleQ16;
+
+  scaleQ16 = (float) ultrasonicCalibration.scaleQ16 *
+    ((float) ultrasonicScaleForTemperature(ultrasonicTemperatureC) /
+     (float) ultrasonicScaleForTemperature(ultrasonicCalibration.temperatureC)) + 0.5;
+
+  //
+  // the background ranging uses these from the ISR
+  //
+  cli();
+  ultrasonicScaleQ16 = scaleQ16;
+  ultrasonicOffsetInMM = ultrasonicCalibration.offsetInMM;
+  sei();
+}
+
+
+
+//
+// compute the nominal scale from the speed of sound
+//  Enter: temperatureC = air temperature in degrees C
+//  Exit:  Q16 millimeters per 0.5us count of the echo width
+//
+unsigned long ultrasonicScaleForTemperature(int temperatureC)
+{
+  return((ULTRASONIC_SPEED_OF_SOUND_AT_0C + ULTRASONIC_SPEED_OF_SOUND_PER_DEGREE_C * temperatureC) *
+    ULTRASONIC_SCALE_Q16_PER_SPEED_OF_SOUND + 0.5);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                           Background Ultrasonic Ranging
+// ---------------------------------------------------------------------------------
+
+//
+// set how often measurements are made in the background
+//  Enter: periodMS = milliseconds between the start of each measurement (60 or more)
+//
+void ultrasonicSetRangingPeriod(int periodMS)
+{
+  if (periodMS < ULTRASONIC_MIN_RANGING_PERIOD_MS)
+    periodMS = ULTRASONIC_MIN_RANGING_PERIOD_MS;
+
+  cli();
+  ultrasonicRangingPeriodMS = periodMS;
+  sei();
+}
+
+
+
+//
+// get the most recent filtered distance, this does not wait for a measurement
+//  Exit:  distance in centimeters returned, 0 returned if nothing is in front of the sensor
+//
+int ultrasonicGetFilteredDistanceInCM()
+{
+  return((ultrasonicGetFilteredDistanceInMM() + 5) / 10);
+}
+
+
+
+//
+// get the most recent filtered distance, this does not wait for a measurement
+//  Exit:  distance in millimeters returned, 0 returned if nothing is in front of the sensor
+//
+int ultrasonicGetFilteredDistanceInMM()
+{
+  int distanceInMM;
+
+  cli();
+  distanceInMM = ultrasonicFilteredDistanceInMM;
+  sei();
+  return(distanceInMM);
+}
+
+
+
+//
+// get the time of the most recent filtered distance, a mode can compare this with the time it
+// last read the distance to see if there is a new one
+//  Exit:  time (from millis()) that the filtered distance was last updated, 0 if never
+//
+unsigned long ultrasonicGetFilteredDistanceTimeMS()
+{
+  unsigned long timeMS;
+
+  cli();
+  timeMS = ultrasonicFilteredDistanceTimeMS;
+  sei();
+  return(timeMS);
+}
+
+
+
+//
+// get the most recent filtered distance as the echo width that would measure it, this is used
+// to calibrate the sensor
+//  Exit:  echo width in 0.5us counts returned, 0 returned if nothing is in front of the sensor
+//
+unsigned long ultrasonicGetFilteredEchoCounts()
+{
+  int distanceInMM;
+  unsigned long scaleQ16;
+  int offsetInMM;
+
+  cli();
+  distanceInMM = ultrasonicFilteredDistanceInMM;
+  scaleQ16 = ultrasonicScaleQ16;
+  offsetInMM = ultrasonicOffsetInMM;
+  sei();
+
+  if (distanceInMM == 0)
+    return(0);
+
+  return(((unsigned long) (distanceInMM - offsetInMM) << 16) / scaleQ16);
+}
+
+
+
+//
+// make ultrasonic measurements in the background, called from the Timer3 ISR every 10ms.  The
+// sensors are fired in turn, each one waiting for the last one's echo and a guard time, so the
+// update rate goes up with the number of sensors.  Each sensor's distances are filtered, then the
+// sensors are combined into the nearest visitor.
+//
+void ultrasonicBackgroundRanging()
+{
+  byte sensor;
+  unsigned int distanceInMM;
+
+  for (sensor = 0; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+    ultrasonicSensorStates[sensor].elapsedMS += 10;
+
+  //
+  // check if the measurement in progress has finished
+  //
+  if (ultrasonicRangingInProgressFlg)
+  {
+    if (!ultrasonicIsFinished())
+      return;
+
+    ultrasonicRangingInProgressFlg = false;
+    ultrasonicMeasurementCompleteFlg = false;
+    ultrasonicGuardElapsedMS = 0;
+
+    distanceInMM = ultrasonicConvertEchoToMM(ultrasonicEchoCounts);
+    ultrasonicFilterSample(ultrasonicActiveSensor, distanceInMM);
+    ultrasonicFuseSensors();
+    TRACE(traceEcho, ultrasonicActiveSensor, distanceInMM, ultrasonicFilteredDistanceInMM);
+    ultrasonicFilteredDistanceTimeMS = millis();
+    schedulerRaiseEvent(SCHEDULER_EVENT_DISTANCE);
+    return;
+  }
+
+  //
+  // check if it is time to fire the next sensor
+  //
+  ultrasonicGuardElapsedMS += 10;
+  if (ultrasonicGuardElapsedMS < ULTRASONIC_GUARD_MS)
+    return;
+
+  sensor = ultrasonicActiveSensor + 1;
+  if (sensor >= ULTRASONIC_SENSOR_COUNT)
+    sensor = 0;
+
+  if (ultrasonicSensorStates[sensor].elapsedMS >= ultrasonicRangingPeriodMS)
+  {
+    ultrasonicSensorStates[sensor].elapsedMS = 0;
+    ultrasonicRangingInProgressFlg = true;
+    ultrasonicStartMeasurement(sensor);
+  }
+}
+
+
+
+//
+// add a distance to a sensor's ring of samples, the median of the most recent samples removes
+// the odd missed or stray echo, then an exponential filter smooths the result
+//  Enter: sensor = sensor that measured the distance
+//         distanceInMM = distance, 0 if no echo
+//
+void ultrasonicFilterSample(byte sensor, unsigned int distanceInMM)
+{
+  ULTRASONIC_SENSOR_STATE *state;
+  unsigned int medianDistance;
+
+  state = &ultrasonicSensorStates[sensor];
+
+  //
+  // add the distance to the ring of samples and find the median of the recent ones
+  //
+  state->sampleRing[state->sampleRingIdx & (ULTRASONIC_SAMPLE_RING_SIZE - 1)] = distanceInMM;
+  state->sampleRingIdx++;
+  medianDistance = ultrasonicMedianOfRecentSamples(sensor);
+  state->medianInMM = medianDistance;
+
+  //
+  // update the filtered distance, starting the filter over when nothing has been seen
+  //
+  if (medianDistance == 0)
+  {
+    state->filterResetFlg = true;
+    state->filteredDistanceInMM = 0;
+    return;
+  }
+
+  if (state->filterResetFlg)
+  {
+    state->filteredDistance = (unsigned long) medianDistance << ULTRASONIC_FILTER_FRACTION_BITS;
+    state->filterResetFlg = false;
+  }
+  else
+  {
+    state->filteredDistance = state->filteredDistance -
+      (state->filteredDistance >> ULTRASONIC_FILTER_SHIFT) +
+      (((unsigned long) medianDistance << ULTRASONIC_FILTER_FRACTION_BITS) >> ULTRASONIC_FILTER_SHIFT);
+  }
+
+  state->filteredDistanceInMM = state->filteredDistance >> ULTRASONIC_FILTER_FRACTION_BITS;
+}
+
+
+
+//
+// combine the sensors into the nearest visitor, the bearing is the average of the sensors that
+// see about the same distance as the nearest
+//
+void ultrasonicFuseSensors()
+{
+  int nearestInMM;
+  unsigned int nearestMedianInMM;
+  int distanceInMM;
+  int bearingSum;
+  byte bearingCount;
+  byte sensor;
+
+  //
+  // find the nearest distance seen by any sensor
+  //
+  nearestInMM = 0;
+  nearestMedianInMM = 0;
+  for (sensor = 0; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+  {
+    distanceInMM = ultrasonicSensorStates[sensor].filteredDistanceInMM;
+    if ((distanceInMM != 0) && ((nearestInMM == 0) || (distanceInMM < nearestInMM)))
+      nearestInMM = distanceInMM;
+
+    if ((ultrasonicSensorStates[sensor].medianInMM != 0) &&
+        ((nearestMedianInMM == 0) || (ultrasonicSensorStates[sensor].medianInMM < nearestMedianInMM)))
+      nearestMedianInMM = ultrasonicSensorStates[sensor].medianInMM;
+  }
+
+  //
+  // average the bearings of the sensors seeing the nearest visitor
+  //
+  bearingSum = 0;
+  bearingCount = 0;
+  if (nearestInMM != 0)
+  {
+    for (sensor = 0; sensor < ULTRASONIC_SENSOR_COUNT; sensor++)
+    {
+      distanceInMM = ultrasonicSensorStates[sensor].filteredDistanceInMM;
+      if ((distanceInMM != 0) && (distanceInMM - nearestInMM <= ULTRASONIC_FUSION_TOLERANCE_MM))
+      {
+        bearingSum += UltrasonicSensors[sensor].bearingInDegrees;
+        bearingCount++;
+      }
+    }
+    ultrasonicBearingInDegrees = bearingSum / bearingCount;
+  }
+
+  ultrasonicFilteredDistanceInMM = nearestInMM;
+  ultrasonicTrackerUpdate(nearestMedianInMM);
+}
+
+
+
+//
+// get the direction of the nearest visitor
+//  Exit:  bearing in degrees returned, 0 is straight out from the front, positive to the right
+//
+int ultrasonicGetBearingInDegrees()
+{
+  int bearing;
+
+  cli();
+  bearing = ultrasonicBearingInDegrees;
+  sei();
+  return(bearing);
+}
+
+
+
+//
+// get the number of samples measured by sensor 0, a caller that needs every sample can read the
+// ones it has not yet seen with ultrasonicGetSample() as long as it keeps up with the ring
+//  Exit:  count of samples, this wraps around from 255 to 0
+//
+byte ultrasonicGetSampleCount()
+{
+  return(ultrasonicSensorStates[0].sampleRingIdx);
+}
+
+
+
+//
+// get one of sensor 0's recent unfiltered samples from the ring
+//  Enter: sampleNumber = sample count when the sample was measured, must be one of the last
+//         ULTRASONIC_SAMPLE_RING_SIZE
+//  Exit:  distance in millimeters returned, 0 returned if no echo
+//
+unsigned int ultrasonicGetSample(byte sampleNumber)
+{
+  unsigned int sample;
+
+  cli();
+  sample = ultrasonicSensorStates[0].sampleRing[sampleNumber & (ULTRASONIC_SAMPLE_RING_SIZE - 1)];
+  sei();
+  return(sample);
+}
+
+
+
+//
+// find the median of the most recent samples in a sensor's ring, a sample with no echo counts as
+// farther away than any echo
+//  Enter: sensor = sensor whose samples are used
+//  Exit:  median distance in millimeters returned, 0 returned if it is no echo
+//
+unsigned int ultrasonicMedianOfRecentSamples(byte sensor)
+{
+  unsigned int sortedSamples[ULTRASONIC_MEDIAN_SAMPLES];
+  unsigned int sample;
+  byte ringIdx;
+  byte i;
+  byte j;
+
+  //
+  // insertion sort the most recent samples
+  //
+  ringIdx = ultrasonicSensorStates[sensor].sampleRingIdx;
+  for (i = 0; i < ULTRASONIC_MEDIAN_SAMPLES; i++)
+  {
+    ringIdx = (ringIdx - 1) & (ULTRASONIC_SAMPLE_RING_SIZE - 1);
+    sample = ultrasonicSensorStates[sensor].sampleRing[ringIdx];
+    if (sample == 0)
+      sample = 0xffff;
+
+    for (j = i; (j > 0) && (sortedSamples[j - 1] > sample); j--)
+      sortedSamples[j] = sortedSamples[j - 1];
+    sortedSamples[j] = sample;
+  }
+
+  sample = sortedSamples[ULTRASONIC_MEDIAN_SAMPLES / 2];
+  if (sample == 0xffff)
+    sample = 0;
+  return(sample);
+}
+
+
+// ---------------------------------------------------------------------------------
+//                               Visitor Approach Tracker
+// ---------------------------------------------------------------------------------
+
+//
+// update the approach tracker with a new distance, called by the background ranging.  Each
+// sample corrects the predicted distance by a fraction (alpha) of the error and the velocity by
+// a smaller fraction (beta) of the error divided by the time between the samples.
+//  Enter: distanceInMM = median of the recent samples, 0 if nothing is seen
+//
+void ultrasonicTrackerUpdate(unsigned int distanceInMM)
+{
+  unsigned long currentTime;
+  long elapsedMS;
+  long predictedDistance;
+  long error;
+
+  currentTime = millis();
+
+  //
+  // nothing seen, the next visitor starts the tracker over
+  //
+  if (distanceInMM == 0)
+  {
+    ultrasonicTrackerValidFlg = false;
+    return;
+  }
+
+  //
+  // start tracking a new visitor as standing still
+  //
+  elapsedMS = (long) (currentTime - ultrasonicTrackerTimeMS);
+  if (!ultrasonicTrackerValidFlg || (elapsedMS <= 0))
+  {
+    ultrasonicTrackerDistance = (long) distanceInMM << ULTRASONIC_TRACKER_FRACTION_BITS;
+    ultrasonicTrackerVelocity = 0;
+    ultrasonicTrackerTimeMS = currentTime;
+    ultrasonicTrackerValidFlg = true;
+    return;
+  }
+
+  //
+  // predict where the visitor is now and correct the distance and velocity by the error
+  //
+  predictedDistance = ultrasonicTrackerDistance + ultrasonicTrackerVelocity * elapsedMS;
+  error = ((long) distanceInMM << ULTRASONIC_TRACKER_FRACTION_BITS) - predictedDistance;
+
+  ultrasonicTrackerDistance = predictedDistance + ((error * ULTRASONIC_TRACKER_ALPHA) >> ULTRASONIC_TRACKER_FRACTION_BITS);
+  ultrasonicTrackerVelocity += ((error >> ULTRASONIC_TRACKER_FRACTION_BITS) * ULTRASONIC_TRACKER_BETA) / elapsedMS;
+  ultrasonicTrackerVelocity = constrain(ultrasonicTrackerVelocity, -ULTRASONIC_TRACKER_MAX_SPEED, ULTRASONIC_TRACKER_MAX_SPEED);
+  ultrasonicTrackerTimeMS = currentTime;
+}
+
+
+
+//
+// predict how far away the visitor will be, this hides the time the motors and backlight take
+// to respond by starting them toward where the visitor is going
+//  Enter: aheadMS = how far in the future to predict
+//  Exit:  distance in centimeters returned, 0 returned if nothing is in front of the sensor
+//
+int ultrasonicGetPredictedDistanceInCM(unsigned int aheadMS)
+{
+  return((ultrasonicGetPredictedDistanceInMM(aheadMS) + 5) / 10);
+}
+
+
+
+//
+// predict how far away the visitor will be
+//  Enter: aheadMS = how far in the future to predict
+//  Exit:  distance in millimeters returned, 0 returned if nothing is in front of the sensor
+//
+int ultrasonicGetPredictedDistanceInMM(unsigned int aheadMS)
+{
+  bool validFlg;
+  long distance;
+  long velocity;
+  unsigned long timeMS;
+
+  cli();
+  validFlg = ultrasonicTrackerValidFlg;
+  distance = ultrasonicTrackerDistance;
+  velocity = ultrasonicTrackerVelocity;
+  timeMS = ultrasonicTrackerTimeMS;
+  sei();
+
+  if (!validFlg)
+    return(0);
+
+  //
+  // predict from the time of the last sample, not from now
+  //
+  distance += velocity * (long) ((millis() - timeMS) + aheadMS);
+  distance >>= ULTRASONIC_TRACKER_FRACTION_BITS;
+
+  if (distance < kMinDistanceInMM)
+    distance = kMinDistanceInMM;
+  if (distance > 32767)
+    distance = 32767;
+  return(distance);
+}
+
+
+
+//
+// get how fast the visitor is approaching
+//  Exit:  speed in mm per second returned, positive coming closer, negative going away
+//
+int ultrasonicGetApproachSpeedInMMPerS()
+{
+  long velocity;
+
+  cli();
+  velocity = ultrasonicTrackerValidFlg ? ultrasonicTrackerVelocity : 0;
+  sei();
+
+  return(-((velocity * 1000) >> ULTRASONIC_TRACKER_FRACTION_BITS));
+}
+
+
 // -------------------------------------- End --------------------------------------
@@ -0,0 +1,69 @@
+#!/bin/sh
+
+#       ******************************************************************
+#       *                                                                *
+#       *                  Long Show Build Check (Linux)                 *
+#       *                                                                *
+#       ******************************************************************
+
+#
+# Checks that a long show still builds.  The compile time checks in Extravaganza.h walk the
+# whole show program, and a check that recursed once per instruction went past the compiler's
+# limit on how deep it recurses with a show of a few hundred steps.  This generates a show with
+# the palette and presets of tools/ExtravaganzaShow.txt and many steps, some in REPEATs and
+# RANDOM groups, compiles it with tools/ExtravaganzaCompiler.cpp and then builds the sketch on
+# the PC against it, with the stand-ins in tools/host, in place of ExtravaganzaShow.h.
+#
+# Run:     sh tools/CheckLongShow.sh [STEPS]
+#
+# STEPS is the number of steps in the show, 1000 (about 5K bytes of program) if not given.  Run
+# it from the top of the repository.  The exit status is 0 if the long show builds, 1 if it
+# doesn't.
+#
+
+set -e
+
+STEPS=${1:-1000}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+#
+# the show: the shipped palette and presets, then groups of 12 steps
+#
+{
+  grep '^define' tools/ExtravaganzaShow.txt
+  i=0
+  while [ $i -lt "$STEPS" ]; do
+    echo "step mistyBlue         chiaroscuro          5000 1500"
+    echo "REPEAT 3"
+    echo "  step pureGreen       cruuuising           5000 1500"
+    echo "  step mellowYellllllow cruuuising          5000 1500"
+    echo "LOOP"
+    echo "RANDOM 2"
+    echo "  step pogchamp        reversedChiaroscuro  2500  500"
+    echo "  step pureGreen       reverseCruuuising    5000 1500"
+    echo "step mistyBlue         chiaroscuro          5000  750"
+    echo "step pureGreen         reverseCruuuising    5000 1500"
+    echo "step pogchamp          reversedChiaroscuro  2500  500"
+    echo "step mellowYellllllow  cruuuising           5000 1500"
+    echo "step pureGreen         cruuuising           5000 1500"
+    echo "step mistyBlue         chiaroscuro          5000 1500"
+    i=$((i + 12))
+  done
+  echo "end"
+} > "$WORK/LongShow.txt"
+
+g++ -std=c++11 -O2 -o "$WORK/ExtravaganzaCompiler" tools/ExtravaganzaCompiler.cpp
+"$WORK/ExtravaganzaCompiler" "$WORK/LongShow.txt" -o "$WORK/LongShow.h"
+
+#
+# build the sketch against the long show, the static_asserts in Extravaganza.h are the check
+#
+echo '#include "KineticSculptureExtravaganza.ino"' > "$WORK/LongShow.cpp"
+if g++ -std=gnu++11 -fsyntax-only -w -I tools/host -I . -DEXTRAVAGANZA_SHOW_HEADER="\"$WORK/LongShow.h\"" \
+    "$WORK/LongShow.cpp"; then
+  echo "pass"
+else
+  echo "FAIL"
+  exit 1
+fi
@@ -0,0 +1,311 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                  Serial Console Client (Linux)                 *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Sends commands to the sculpture's serial command console (see Console.h) and shows the
+// replies.  The commands are read one a line from the standard input, or given with -c, so a
+// file of colors and speeds to try can be kept and sent again.  Each command is sent once the
+// reply to the one before has come back, blank lines and lines starting with # are skipped.  It
+// runs on the PC, not on the sculpture, and works the same with a pseudo-terminal standing in
+// for the sculpture's serial port, such as the one SculptureSimulator runs the sketch on.
+//
+// Build:   g++ -std=c++11 -O2 -o ConsoleClient tools/ConsoleClient.cpp
+// Run:     ./ConsoleClient /dev/ttyACM0 < changes.txt
+//          ./ConsoleClient /dev/ttyACM0 -c "mode stop" -c "vel 10 -10 2000"
+//
+// Options:
+//
+//   -c COMMAND             send COMMAND rather than reading the standard input, may be repeated
+//   --baud N               baud rate of the serial port (115200, set by Serial.begin())
+//   --timeout MS           time to wait for each reply (2000)
+//   --wait MS              time to wait after opening the port before the first command, the
+//                          Mega restarts when its USB serial port is opened (2500, use 0 for a
+//                          pseudo-terminal)
+//
+// The exit status is 0 if every command was answered "ok", 1 if any was answered with an error
+// or not answered.  Turn the telemetry off ("set telemetry 0") before sending commands, its
+// binary frames would be mixed in with the replies.
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+//
+// what ended the reply to a command
+//
+enum ReplyResult {replyOK, replyError, replyTimeout};
+
+
+// ---------------------------------------------------------------------------------
+//                                  Serial Port
+// ---------------------------------------------------------------------------------
+
+static speed_t baudToSpeed(long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default: return 0;
+  }
+}
+
+
+//
+// set a serial port to raw 8 bit bytes, the same as TelemetryDecoder
+//
+static bool setupSerialPort(int fd, long baud)
+{
+  struct termios tty;
+
+  if (!isatty(fd))
+    return true;
+
+  speed_t speed = baudToSpeed(baud);
+  if (speed == 0)
+  {
+    std::fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return false;
+  }
+
+  if (tcgetattr(fd, &tty) != 0)
+  {
+    std::fprintf(stderr, "can not read the serial port settings: %s\n", std::strerror(errno));
+    return false;
+  }
+
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0)
+  {
+    std::fprintf(stderr, "can not set the serial port: %s\n", std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+
+static long nowMS()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000L;
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                Commands and Replies
+// ---------------------------------------------------------------------------------
+
+static bool writeAll(int fd, const std::string &text)
+{
+  size_t sent = 0;
+
+  while (sent < text.size())
+  {
+    ssize_t count = write(fd, text.data() + sent, text.size() - sent);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      std::fprintf(stderr, "write error: %s\n", std::strerror(errno));
+      return false;
+    }
+    sent += count;
+  }
+  return true;
+}
+
+
+//
+// read the reply to a command, showing each line of it, until a line that is "ok" or starts
+// with "error:".  Anything before a zero or other unprintable byte is part of a telemetry frame
+// or was spoiled, so it is dropped.
+//
+static ReplyResult readReply(int fd, long timeoutMS)
+{
+  std::string line;
+  long endMS = nowMS() + timeoutMS;
+
+  while (true)
+  {
+    long leftMS = endMS - nowMS();
+    if (leftMS <= 0)
+      return replyTimeout;
+
+    struct pollfd waitFor = {fd, POLLIN, 0};
+    int ready = poll(&waitFor, 1, (int) leftMS);
+    if (ready < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      std::fprintf(stderr, "poll error: %s\n", std::strerror(errno));
+      return replyTimeout;
+    }
+    if (ready == 0)
+      return replyTimeout;
+
+    char buffer[256];
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count <= 0)
+    {
+      if ((count < 0) && (errno == EINTR))
+        continue;
+      return replyTimeout;
+    }
+
+    for (ssize_t i = 0; i < count; i++)
+    {
+      char c = buffer[i];
+      if (c == '\r')
+        continue;
+
+      if (c != '\n')
+      {
+        if ((c < ' ') || (c > '~'))
+          line.clear();
+        else
+          line += c;
+        continue;
+      }
+
+      std::printf("%s\n", line.c_str());
+      if (line == "ok")
+        return replyOK;
+      if (line.compare(0, 6, "error:") == 0)
+        return replyError;
+      line.clear();
+    }
+  }
+}
+
+
+//
+// send a command and wait for its reply
+//  Exit:  false if it wasn't answered "ok"
+//
+static bool sendCommand(int fd, std::string command, long timeoutMS)
+{
+  while (!command.empty() && ((command[command.size() - 1] == '\r') || (command[command.size() - 1] == '\n')))
+    command.erase(command.size() - 1);
+
+  size_t start = command.find_first_not_of(" \t");
+  if ((start == std::string::npos) || (command[start] == '#'))
+    return true;
+
+  std::printf("> %s\n", command.c_str());
+  std::fflush(stdout);
+  if (!writeAll(fd, command + "\n"))
+    return false;
+
+  ReplyResult result = readReply(fd, timeoutMS);
+  if (result == replyTimeout)
+    std::printf("no reply\n");
+  std::fflush(stdout);
+  return result == replyOK;
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: ConsoleClient [options] SERIAL_PORT\n"
+    "  -c COMMAND           send COMMAND rather than reading the standard input\n"
+    "  --baud N             serial port baud rate (115200)\n"
+    "  --timeout MS         time to wait for each reply (2000)\n"
+    "  --wait MS            time to wait before the first command (2500)\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *portName = 0;
+  std::vector<std::string> commands;
+  long baud = 115200;
+  long timeoutMS = 2000;
+  long waitMS = 2500;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if ((arg == "-c") && hasValue)
+      commands.push_back(argv[++i]);
+    else if ((arg == "--baud") && hasValue)
+      baud = std::atol(argv[++i]);
+    else if ((arg == "--timeout") && hasValue)
+      timeoutMS = std::atol(argv[++i]);
+    else if ((arg == "--wait") && hasValue)
+      waitMS = std::atol(argv[++i]);
+    else if ((arg[0] != '-') && !portName)
+      portName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!portName)
+  {
+    printUsage();
+    return 1;
+  }
+
+  int fd = open(portName, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+  {
+    std::fprintf(stderr, "can not open %s: %s\n", portName, std::strerror(errno));
+    return 1;
+  }
+  if (!setupSerialPort(fd, baud))
+    return 1;
+
+  //
+  // let the sculpture start up, then throw away what it wrote meanwhile
+  //
+  if (waitMS > 0)
+    usleep(waitMS * 1000);
+  tcflush(fd, TCIFLUSH);
+
+  bool allOKFlg = true;
+
+  if (!commands.empty())
+  {
+    for (size_t i = 0; i < commands.size(); i++)
+      allOKFlg = sendCommand(fd, commands[i], timeoutMS) && allOKFlg;
+  }
+  else
+  {
+    std::string command;
+    while (std::getline(std::cin, command))
+      allOKFlg = sendCommand(fd, command, timeoutMS) && allOKFlg;
+  }
+
+  close(fd);
+  return allOKFlg ? 0 : 1;
+}
@@ -0,0 +1,968 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                Extravaganza Show Compiler (Linux)              *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Compiles a text description of a show into ExtravaganzaShow.h, the palette, velocity presets
+// and show program played by the Action and Light modes.  Before writing anything it checks the
+// show against a simple model of the motors, and it reports how long the show is and how much
+// flash it uses.  It runs on the PC, not on the sculpture.
+//
+// Build:   g++ -std=c++11 -O2 -o ExtravaganzaCompiler tools/ExtravaganzaCompiler.cpp
+// Run:     ./ExtravaganzaCompiler tools/ExtravaganzaShow.txt -o ExtravaganzaShow.h
+//
+// The exit status is 0 if the show compiled, 1 if any errors were found, so a script can build
+// the shows for many sculptures and stop on the first bad one.
+//
+// Show description, one statement per line, '#' starts a comment, keywords are not case sensitive:
+//
+//   define color NAME RED GREEN BLUE          add a color to the palette (0 - 255)
+//   define preset NAME OUTER_RPM INNER_RPM    add a velocity preset
+//
+//   STEP COLOR PRESET TRANSITION_MS POST_MS    transition to a palette color and preset, then hold
+//   COLOR COLOR                                select a palette color
+//   RGB RED GREEN BLUE                         select a color directly
+//   PRESET PRESET                              select a velocity preset
+//   VELOCITY OUTER_RPM INNER_RPM               select velocities directly
+//   MOVE TRANSITION_MS POST_MS                 transition to the selected color and velocities
+//   REPEAT COUNT ... LOOP                      play the statements between COUNT times
+//   RANDOM COUNT                               play one of the next COUNT statements at random
+//   NAME:                                      a label that can be jumped to
+//   JUMP NAME                                  continue at a label
+//   END                                        start the show over
+//
+// Motor model options (the defaults match ConstantAndDataTypes.h and the DPEA motors):
+//
+//   --gear-reduction N     gear reduction from the motor to the disks (127)
+//   --max-motor-rpm N      fastest motor speed the PI loop can hold at MOTOR_MAX_PWM (7700)
+//   --max-accel N          largest change in disk velocity the motors can follow, RPM per second (25)
+//   --name NAME            name of the sculpture, written into the header comment
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//
+// these must match the show program format in Extravaganza.h
+//
+const int PROGRAM_DURATION_UNIT_MS = 50;
+const int PROGRAM_VELOCITY_UNITS_PER_RPM = 16;
+const int PROGRAM_MAX_REPEAT_DEPTH = 4;
+const int EXTRAVAGANZA_TABLE_ENTRY_BYTES = 15;
+const int PALETTE_ENTRY_BYTES = 3;
+const int PRESET_ENTRY_BYTES = 8;
+
+enum ProgramOpcode {opEnd, opStep, opMove, opColor, opRGB, opPreset, opVelocity, opRepeat, opLoop, opRandom, opJump};
+
+const int ProgramOpcodeLength[] = {1, 5, 3, 2, 4, 2, 5, 2, 1, 2, 3};
+
+//
+// motor model
+//
+struct MotorModel
+{
+  double gearReduction;
+  double maxMotorRPM;
+  double maxAccelRPMPerSecond;
+};
+
+struct PaletteEntry
+{
+  std::string name;
+  int line;
+  int red;
+  int green;
+  int blue;
+};
+
+struct PresetEntry
+{
+  std::string name;
+  int line;
+  double outerRPM;
+  double innerRPM;
+};
+
+struct Statement
+{
+  int opcode;
+  int line;
+  int args[4];
+  double outerRPM;
+  double innerRPM;
+  std::string label;
+  int address;
+};
+
+//
+// everything read from the show description
+//
+struct Show
+{
+  std::vector<PaletteEntry> palette;
+  std::vector<PresetEntry> presets;
+  std::vector<Statement> statements;
+  std::map<std::string, int> labels;            // label name -> index of the statement that follows
+  int errorCount;
+};
+
+
+// ---------------------------------------------------------------------------------
+//                                  Error Reporting
+// ---------------------------------------------------------------------------------
+
+static const char *showFileName = "";
+
+static void reportError(Show &show, int line, const std::string &message)
+{
+  std::fprintf(stderr, "%s:%d: error: %s\n", showFileName, line, message.c_str());
+  show.errorCount++;
+}
+
+
+static void reportWarning(int line, const std::string &message)
+{
+  std::fprintf(stderr, "%s:%d: warning: %s\n", showFileName, line, message.c_str());
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                      Parsing
+// ---------------------------------------------------------------------------------
+
+static std::string lowerCase(const std::string &s)
+{
+  std::string result = s;
+  for (size_t i = 0; i < result.size(); i++)
+    result[i] = (char) std::tolower((unsigned char) result[i]);
+  return result;
+}
+
+
+static bool parseInteger(const std::string &s, int *value)
+{
+  char *end;
+  long result = std::strtol(s.c_str(), &end, 10);
+  if (s.empty() || (*end != 0))
+    return false;
+  *value = (int) result;
+  return true;
+}
+
+
+static bool parseNumber(const std::string &s, double *value)
+{
+  char *end;
+  double result = std::strtod(s.c_str(), &end);
+  if (s.empty() || (*end != 0))
+    return false;
+  *value = result;
+  return true;
+}
+
+
+static int findPalette(const Show &show, const std::string &name)
+{
+  for (size_t i = 0; i < show.palette.size(); i++)
+    if (show.palette[i].name == name)
+      return (int) i;
+  return -1;
+}
+
+
+static int findPreset(const Show &show, const std::string &name)
+{
+  for (size_t i = 0; i < show.presets.size(); i++)
+    if (show.presets[i].name == name)
+      return (int) i;
+  return -1;
+}
+
+
+//
+// check that a value fits in a byte operand
+//
+static bool checkByte(Show &show, int line, int value, const char *what)
+{
+  if ((value < 0) || (value > 255))
+  {
+    reportError(show, line, std::string(what) + " must be 0 - 255");
+    return false;
+  }
+  return true;
+}
+
+
+//
+// check that a duration can be stored in 50ms units in a byte operand
+//
+static bool checkDuration(Show &show, int line, int durationMS)
+{
+  if ((durationMS < 0) || (durationMS > 255 * PROGRAM_DURATION_UNIT_MS))
+  {
+    reportError(show, line, "durations must be 0 - 12750 ms");
+    return false;
+  }
+  if (durationMS % PROGRAM_DURATION_UNIT_MS != 0)
+  {
+    reportError(show, line, "durations must be a multiple of 50 ms");
+    return false;
+  }
+  return true;
+}
+
+
+//
+// parse one statement of the show description
+//
+static void parseLine(Show &show, int line, const std::vector<std::string> &tokens)
+{
+  Statement statement;
+  std::string keyword = lowerCase(tokens[0]);
+  size_t argumentCount = tokens.size() - 1;
+  int value = 0;
+
+  std::memset(statement.args, 0, sizeof(statement.args));
+  statement.line = line;
+  statement.outerRPM = 0;
+  statement.innerRPM = 0;
+  statement.address = 0;
+
+  //
+  // labels
+  //
+  if ((tokens.size() == 1) && (keyword.size() > 1) && (keyword[keyword.size() - 1] == ':'))
+  {
+    std::string name = tokens[0].substr(0, tokens[0].size() - 1);
+    if (show.labels.count(name))
+      reportError(show, line, "label '" + name + "' is already defined");
+    show.labels[name] = (int) show.statements.size();
+    return;
+  }
+
+  //
+  // palette and preset definitions
+  //
+  if (keyword == "define")
+  {
+    std::string kind = (argumentCount >= 1) ? lowerCase(tokens[1]) : "";
+
+    if ((kind == "color") && (argumentCount == 5))
+    {
+      PaletteEntry entry;
+      entry.name = tokens[2];
+      entry.line = line;
+      if (findPalette(show, entry.name) >= 0)
+        reportError(show, line, "color '" + entry.name + "' is already defined");
+      if (!parseInteger(tokens[3], &entry.red) || !parseInteger(tokens[4], &entry.green) ||
+          !parseInteger(tokens[5], &entry.blue))
+      {
+        reportError(show, line, "color values must be whole numbers");
+        return;
+      }
+      checkByte(show, line, entry.red, "red");
+      checkByte(show, line, entry.green, "green");
+      checkByte(show, line, entry.blue, "blue");
+      show.palette.push_back(entry);
+      return;
+    }
+
+    if ((kind == "preset") && (argumentCount == 4))
+    {
+      PresetEntry entry;
+      entry.name = tokens[2];
+      entry.line = line;
+      if (findPreset(show, entry.name) >= 0)
+        reportError(show, line, "preset '" + entry.name + "' is already defined");
+      if (!parseNumber(tokens[3], &entry.outerRPM) || !parseNumber(tokens[4], &entry.innerRPM))
+      {
+        reportError(show, line, "preset velocities must be numbers");
+        return;
+      }
+      show.presets.push_back(entry);
+      return;
+    }
+
+    reportError(show, line, "expected 'define color NAME R G B' or 'define preset NAME OUTER INNER'");
+    return;
+  }
+
+  //
+  // program statements
+  //
+  if ((keyword == "step") && (argumentCount == 4))
+  {
+    statement.opcode = opStep;
+    statement.args[0] = findPalette(show, tokens[1]);
+    statement.args[1] = findPreset(show, tokens[2]);
+    if (statement.args[0] < 0)
+      reportError(show, line, "unknown color '" + tokens[1] + "'");
+    if (statement.args[1] < 0)
+      reportError(show, line, "unknown preset '" + tokens[2] + "'");
+    if (!parseInteger(tokens[3], &statement.args[2]) || !parseInteger(tokens[4], &statement.args[3]))
+      reportError(show, line, "durations must be whole numbers of ms");
+    checkDuration(show, line, statement.args[2]);
+    checkDuration(show, line, statement.args[3]);
+  }
+
+  else if ((keyword == "move") && (argumentCount == 2))
+  {
+    statement.opcode = opMove;
+    if (!parseInteger(tokens[1], &statement.args[2]) || !parseInteger(tokens[2], &statement.args[3]))
+      reportError(show, line, "durations must be whole numbers of ms");
+    checkDuration(show, line, statement.args[2]);
+    checkDuration(show, line, statement.args[3]);
+  }
+
+  else if ((keyword == "color") && (argumentCount == 1))
+  {
+    statement.opcode = opColor;
+    statement.args[0] = findPalette(show, tokens[1]);
+    if (statement.args[0] < 0)
+      reportError(show, line, "unknown color '" + tokens[1] + "'");
+  }
+
+  else if ((keyword == "rgb") && (argumentCount == 3))
+  {
+    statement.opcode = opRGB;
+    for (int i = 0; i < 3; i++)
+    {
+      if (!parseInteger(tokens[i + 1], &statement.args[i]))
+        reportError(show, line, "color values must be whole numbers");
+      checkByte(show, line, statement.args[i], "color values");
+    }
+  }
+
+  else if ((keyword == "preset") && (argumentCount == 1))
+  {
+    statement.opcode = opPreset;
+    statement.args[1] = findPreset(show, tokens[1]);
+    if (statement.args[1] < 0)
+      reportError(show, line, "unknown preset '" + tokens[1] + "'");
+  }
+
+  else if ((keyword == "velocity") && (argumentCount == 2))
+  {
+    statement.opcode = opVelocity;
+    if (!parseNumber(tokens[1], &statement.outerRPM) || !parseNumber(tokens[2], &statement.innerRPM))
+      reportError(show, line, "velocities must be numbers");
+  }
+
+  else if ((keyword == "repeat") && (argumentCount == 1))
+  {
+    statement.opcode = opRepeat;
+    if (!parseInteger(tokens[1], &value) || (value < 1) || (value > 255))
+      reportError(show, line, "repeat count must be 1 - 255");
+    statement.args[0] = value;
+  }
+
+  else if ((keyword == "loop") && (argumentCount == 0))
+    statement.opcode = opLoop;
+
+  else if ((keyword == "random") && (argumentCount == 1))
+  {
+    statement.opcode = opRandom;
+    if (!parseInteger(tokens[1], &value) || (value < 1) || (value > 255))
+      reportError(show, line, "random count must be 1 - 255");
+    statement.args[0] = value;
+  }
+
+  else if ((keyword == "jump") && (argumentCount == 1))
+  {
+    statement.opcode = opJump;
+    statement.label = tokens[1];
+  }
+
+  else if ((keyword == "end") && (argumentCount == 0))
+    statement.opcode = opEnd;
+
+  else
+  {
+    reportError(show, line, "can not understand '" + tokens[0] + "' with " + std::to_string(argumentCount) + " values");
+    return;
+  }
+
+  show.statements.push_back(statement);
+}
+
+
+//
+// read the show description file
+//
+static bool readShow(const char *fileName, Show &show)
+{
+  std::ifstream file(fileName);
+  std::string text;
+  int line = 0;
+
+  if (!file)
+  {
+    std::fprintf(stderr, "can not open %s\n", fileName);
+    return false;
+  }
+
+  while (std::getline(file, text))
+  {
+    line++;
+    size_t comment = text.find('#');
+    if (comment != std::string::npos)
+      text = text.substr(0, comment);
+
+    std::istringstream words(text);
+    std::vector<std::string> tokens;
+    std::string word;
+    while (words >> word)
+      tokens.push_back(word);
+
+    if (!tokens.empty())
+      parseLine(show, line, tokens);
+  }
+  return true;
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                Assembly and Checks
+// ---------------------------------------------------------------------------------
+
+//
+// give every statement its byte address and resolve the jump labels
+//  Exit:  the length of the program in bytes
+//
+static int assembleShow(Show &show)
+{
+  int address = 0;
+  int repeatDepth = 0;
+
+  for (size_t i = 0; i < show.statements.size(); i++)
+  {
+    show.statements[i].address = address;
+    address += ProgramOpcodeLength[show.statements[i].opcode];
+  }
+
+  for (size_t i = 0; i < show.statements.size(); i++)
+  {
+    Statement &statement = show.statements[i];
+
+    if (statement.opcode == opJump)
+    {
+      if (!show.labels.count(statement.label))
+        reportError(show, statement.line, "unknown label '" + statement.label + "'");
+      else
+      {
+        size_t target = show.labels[statement.label];
+        statement.args[0] = (target < show.statements.size()) ? show.statements[target].address : 0;
+      }
+    }
+
+    if (statement.opcode == opRandom)
+    {
+      if (i + statement.args[0] >= show.statements.size())
+        reportError(show, statement.line, "random needs " + std::to_string(statement.args[0]) + " statements after it");
+      for (int j = 1; (j <= statement.args[0]) && (i + j < show.statements.size()); j++)
+      {
+        int opcode = show.statements[i + j].opcode;
+        if ((opcode == opRepeat) || (opcode == opRandom))
+          reportError(show, show.statements[i + j].line, "a random choice can not be a repeat or another random");
+      }
+    }
+
+    if (statement.opcode == opRepeat)
+    {
+      repeatDepth++;
+      if (repeatDepth > PROGRAM_MAX_REPEAT_DEPTH)
+        reportError(show, statement.line, "repeats can only be nested 4 deep");
+    }
+
+    if (statement.opcode == opLoop)
+    {
+      if (repeatDepth == 0)
+        reportError(show, statement.line, "loop without a repeat");
+      else
+        repeatDepth--;
+    }
+  }
+
+  if (repeatDepth != 0)
+    reportError(show, show.statements.empty() ? 0 : show.statements.back().line, "repeat without a loop");
+
+  if (address > 32767)
+    reportError(show, 0, "the show program is too long");
+
+  return address;
+}
+
+
+static std::string formatNumber(double value);
+
+
+//
+// check that a velocity can be followed by the motors
+//
+static void checkVelocity(Show &show, int line, double rpm, const MotorModel &motor)
+{
+  double motorRPM = std::fabs(rpm) * motor.gearReduction;
+
+  if (motorRPM > 32767)
+    reportError(show, line, "velocity " + formatNumber(rpm) + " RPM overflows the motor speed (an int) after the gear reduction");
+  else if (motorRPM > motor.maxMotorRPM)
+    reportError(show, line, "velocity " + formatNumber(rpm) + " RPM needs " + std::to_string((int) motorRPM) +
+      " motor RPM, the motors can only reach " + std::to_string((int) motor.maxMotorRPM));
+
+  if (std::fabs(rpm * PROGRAM_VELOCITY_UNITS_PER_RPM) > 32767)
+    reportError(show, line, "velocity " + formatNumber(rpm) + " RPM is too large to store");
+}
+
+
+//
+// the results of playing the show in the model
+//
+struct Playback
+{
+  double lengthMS;
+  bool reachedEnd;
+  int steps;
+};
+
+
+//
+// play the show through the motor model, the same way Extravaganza.h interprets it, checking the
+// acceleration of every transition
+//  Enter:  randomSeed = selects which statement each RANDOM plays
+//          passes = number of times to play through to END
+//
+static Playback playShow(Show &show, const MotorModel &motor, int randomSeed, int passes, bool reportFlg)
+{
+  Playback result = {0, false, 0};
+  std::vector<int> repeatStatement;
+  std::vector<int> repeatCount;
+  double outer = 0, inner = 0;                  // the disks start stopped
+  double selectedOuter = 0, selectedInner = 0;
+  int index = 0;
+  int randomGroupEnd = -1;
+  int randomCalls = 0;
+  int passCount = 0;
+  std::map<int, int> addressToStatement;
+
+  for (size_t i = 0; i < show.statements.size(); i++)
+    addressToStatement[show.statements[i].address] = (int) i;
+
+  for (int count = 0; count < 100000; count++)
+  {
+    if (index >= (int) show.statements.size())
+      index = 0;
+    if (show.statements.empty())
+      break;
+
+    const Statement &statement = show.statements[index];
+    int next = index + 1;
+    if (randomGroupEnd >= 0)
+    {
+      next = randomGroupEnd;
+      randomGroupEnd = -1;
+    }
+
+    switch (statement.opcode)
+    {
+      case opEnd:
+        passCount++;
+        if (passCount == 1)
+          result.reachedEnd = true;
+        if (passCount >= passes)
+          return result;
+        repeatStatement.clear();
+        repeatCount.clear();
+        index = 0;
+        continue;
+
+      case opStep:
+      case opMove:
+      {
+        double transitionMS = statement.args[2];
+        if (statement.opcode == opStep)
+        {
+          selectedOuter = show.presets[statement.args[1]].outerRPM;
+          selectedInner = show.presets[statement.args[1]].innerRPM;
+        }
+
+        double change = std::max(std::fabs(selectedOuter - outer), std::fabs(selectedInner - inner));
+        if (reportFlg && (change > 0))
+        {
+          double accel = (transitionMS > 0) ? change * 1000.0 / transitionMS : INFINITY;
+          if (accel > motor.maxAccelRPMPerSecond)
+          {
+            reportError(show, statement.line, "changing the disks by " + formatNumber(change) + " RPM in " +
+              std::to_string((int) transitionMS) + " ms needs " + formatNumber(accel) +
+              " RPM/s, the motors can only follow " + formatNumber(motor.maxAccelRPMPerSecond) + " RPM/s");
+            reportFlg = false;                  // one acceleration error per playback is enough
+          }
+        }
+
+        outer = selectedOuter;
+        inner = selectedInner;
+        if (passCount == 0)
+        {
+          result.lengthMS += statement.args[2] + statement.args[3];
+          result.steps++;
+        }
+        break;
+      }
+
+      case opPreset:
+        selectedOuter = show.presets[statement.args[1]].outerRPM;
+        selectedInner = show.presets[statement.args[1]].innerRPM;
+        break;
+
+      case opVelocity:
+        selectedOuter = statement.outerRPM;
+        selectedInner = statement.innerRPM;
+        break;
+
+      case opRepeat:
+        if (repeatStatement.size() < (size_t) PROGRAM_MAX_REPEAT_DEPTH)
+        {
+          repeatStatement.push_back(next);
+          repeatCount.push_back(statement.args[0] - 1);
+        }
+        break;
+
+      case opLoop:
+        if (!repeatCount.empty())
+        {
+          if (repeatCount.back() == 0)
+          {
+            repeatCount.pop_back();
+            repeatStatement.pop_back();
+          }
+          else
+          {
+            repeatCount.back()--;
+            next = repeatStatement.back();
+          }
+        }
+        break;
+
+      case opRandom:
+      {
+        int choice = (randomSeed + randomCalls) % statement.args[0];
+        randomCalls++;
+        randomGroupEnd = std::min(index + 1 + statement.args[0], (int) show.statements.size());
+        next = std::min(index + 1 + choice, (int) show.statements.size());
+        break;
+      }
+
+      case opJump:
+        next = addressToStatement.count(statement.args[0]) ? addressToStatement[statement.args[0]] : 0;
+        break;
+    }
+
+    index = next;
+  }
+
+  return result;
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                   Header Output
+// ---------------------------------------------------------------------------------
+
+static std::string enumName(const char *prefix, const std::string &name)
+{
+  std::string result = prefix;
+  for (size_t i = 0; i < name.size(); i++)
+  {
+    char c = name[i];
+    if (!std::isalnum((unsigned char) c))
+      c = '_';
+    if (i == 0)
+      c = (char) std::toupper((unsigned char) c);
+    result += c;
+  }
+  return result;
+}
+
+
+static std::string formatNumber(double value)
+{
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.4g", value);
+  std::string result = buffer;
+  if (result.find_first_of(".e") == std::string::npos)
+    result += ".0";
+  return result;
+}
+
+
+static void writeBanner(std::ostream &out, const char *title)
+{
+  const int width = 116;
+  std::string bar(width + 4, '/');
+  std::string text = title;
+  int left = (width - (int) text.size()) / 2;
+  int right = width - left - (int) text.size();
+
+  out << bar << "\n";
+  out << "//" << std::string(width, ' ') << "//\n";
+  out << "//" << std::string(left, ' ') << text << std::string(right, ' ') << "//\n";
+  out << "//" << std::string(width, ' ') << "//\n";
+  out << bar << "\n\n";
+}
+
+
+//
+// write ExtravaganzaShow.h
+//
+static void writeHeader(std::ostream &out, const Show &show, const std::string &sourceName, const std::string &sculptureName)
+{
+  out << "#pragma once\n\n";
+  out << "//      ******************************************************************\n";
+  out << "//      *                                                                *\n";
+  out << "//      *                       Extravaganza Show                        *\n";
+  out << "//      *                                                                *\n";
+  out << "//      ******************************************************************\n\n";
+  out << "//\n";
+  out << "// Generated by tools/ExtravaganzaCompiler.cpp from " << sourceName;
+  if (!sculptureName.empty())
+    out << " for " << sculptureName;
+  out << "\n// Do not edit this file, edit the show description and compile it again.  Extravaganza.h builds\n";
+  out << "// the program memory palette, presets and program from these lists, and checks them as it compiles.\n//\n\n";
+
+  writeBanner(out, "Extravaganza Palette and Presets");
+
+  out << "enum PaletteColor {";
+  for (size_t i = 0; i < show.palette.size(); i++)
+    out << (i ? ", " : "") << enumName("palette", show.palette[i].name);
+  out << "};\n\n";
+
+  out << "#define EXTRAVAGANZA_PALETTE(ENTRY) \\\n";
+  for (size_t i = 0; i < show.palette.size(); i++)
+    out << "  ENTRY(" << show.palette[i].red << ", " << show.palette[i].green << ", " << show.palette[i].blue << ")"
+        << ((i + 1 < show.palette.size()) ? " \\" : "") << "\n";
+  out << "\n";
+
+  out << "enum VelocityPreset {";
+  for (size_t i = 0; i < show.presets.size(); i++)
+    out << (i ? ", " : "") << enumName("preset", show.presets[i].name);
+  out << "};\n\n";
+
+  out << "#define EXTRAVAGANZA_VELOCITY_PRESETS(ENTRY) \\\n";
+  for (size_t i = 0; i < show.presets.size(); i++)
+    out << "  ENTRY(" << formatNumber(show.presets[i].outerRPM) << ", " << formatNumber(show.presets[i].innerRPM) << ")"
+        << ((i + 1 < show.presets.size()) ? " \\" : "") << "\n";
+  out << "\n";
+
+  writeBanner(out, "Extravaganza Show Program");
+
+  out << "#define EXTRAVAGANZA_PROGRAM \\\n";
+  for (size_t i = 0; i < show.statements.size(); i++)
+  {
+    const Statement &s = show.statements[i];
+    std::ostringstream text;
+
+    switch (s.opcode)
+    {
+      case opEnd:      text << "END()"; break;
+      case opStep:     text << "STEP(" << enumName("palette", show.palette[s.args[0]].name) << ", "
+                            << enumName("preset", show.presets[s.args[1]].name) << ", "
+                            << s.args[2] << ", " << s.args[3] << ")"; break;
+      case opMove:     text << "MOVE(" << s.args[2] << ", " << s.args[3] << ")"; break;
+      case opColor:    text << "COLOR(" << enumName("palette", show.palette[s.args[0]].name) << ")"; break;
+      case opRGB:      text << "RGB(" << s.args[0] << ", " << s.args[1] << ", " << s.args[2] << ")"; break;
+      case opPreset:   text << "PRESET(" << enumName("preset", show.presets[s.args[1]].name) << ")"; break;
+      case opVelocity: text << "VELOCITY(" << formatNumber(s.outerRPM) << ", " << formatNumber(s.innerRPM) << ")"; break;
+      case opRepeat:   text << "REPEAT(" << s.args[0] << ")"; break;
+      case opLoop:     text << "LOOP()"; break;
+      case opRandom:   text << "RANDOM(" << s.args[0] << ")"; break;
+      case opJump:     text << "JUMP(" << s.args[0] << ")"; break;
+    }
+
+    if (i + 1 < show.statements.size())
+      text << ",";
+    std::ostringstream comment;
+    comment << "/* " << s.address;
+    if (s.opcode == opJump)
+      comment << ", to " << s.label;
+    comment << " */";
+    std::string padding(std::max(1, 71 - (int) text.str().size()), ' ');
+    out << "  " << text.str() << padding << comment.str() << ((i + 1 < show.statements.size()) ? " \\" : "") << "\n";
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                       Main
+// ---------------------------------------------------------------------------------
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: ExtravaganzaCompiler [options] SHOW_FILE -o ExtravaganzaShow.h\n"
+    "  --gear-reduction N   gear reduction from the motor to the disks (127)\n"
+    "  --max-motor-rpm N    fastest motor speed the motors can hold (7700)\n"
+    "  --max-accel N        largest disk acceleration in RPM per second (25)\n"
+    "  --name NAME          sculpture name written into the header\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  MotorModel motor = {127, 7700, 25};
+  const char *inputName = 0;
+  const char *outputName = 0;
+  std::string sculptureName;
+  Show show;
+
+  show.errorCount = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if ((arg == "-o") && hasValue)
+      outputName = argv[++i];
+    else if ((arg == "--gear-reduction") && hasValue)
+      motor.gearReduction = std::atof(argv[++i]);
+    else if ((arg == "--max-motor-rpm") && hasValue)
+      motor.maxMotorRPM = std::atof(argv[++i]);
+    else if ((arg == "--max-accel") && hasValue)
+      motor.maxAccelRPMPerSecond = std::atof(argv[++i]);
+    else if ((arg == "--name") && hasValue)
+      sculptureName = argv[++i];
+    else if ((arg[0] != '-') && !inputName)
+      inputName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!inputName)
+  {
+    printUsage();
+    return 1;
+  }
+
+  //
+  // read and assemble the show
+  //
+  showFileName = inputName;
+  if (!readShow(inputName, show))
+    return 1;
+
+  if (show.statements.empty())
+    reportError(show, 0, "the show has no statements");
+  if (show.palette.size() > 255)
+    reportError(show, 0, "the palette can have at most 255 colors");
+  if (show.presets.size() > 255)
+    reportError(show, 0, "there can be at most 255 velocity presets");
+
+  int programBytes = assembleShow(show);
+
+  //
+  // check the velocities against the motor model
+  //
+  for (size_t i = 0; i < show.presets.size(); i++)
+  {
+    checkVelocity(show, show.presets[i].line, show.presets[i].outerRPM, motor);
+    checkVelocity(show, show.presets[i].line, show.presets[i].innerRPM, motor);
+  }
+
+  for (size_t i = 0; i < show.statements.size(); i++)
+  {
+    if (show.statements[i].opcode == opVelocity)
+    {
+      checkVelocity(show, show.statements[i].line, show.statements[i].outerRPM, motor);
+      checkVelocity(show, show.statements[i].line, show.statements[i].innerRPM, motor);
+      if ((std::fabs(show.statements[i].outerRPM * PROGRAM_VELOCITY_UNITS_PER_RPM -
+           std::round(show.statements[i].outerRPM * PROGRAM_VELOCITY_UNITS_PER_RPM)) > 1e-6) ||
+          (std::fabs(show.statements[i].innerRPM * PROGRAM_VELOCITY_UNITS_PER_RPM -
+           std::round(show.statements[i].innerRPM * PROGRAM_VELOCITY_UNITS_PER_RPM)) > 1e-6))
+        reportWarning(show.statements[i].line, "velocity will be rounded to the nearest 1/16 RPM");
+    }
+  }
+
+  if (show.errorCount)
+  {
+    std::fprintf(stderr, "%s: %d error(s), no header written\n", inputName, show.errorCount);
+    return 1;
+  }
+
+  //
+  // play the show through the motor model, once for each way the random choices can go
+  //
+  int randomVariations = 1;
+  for (size_t i = 0; i < show.statements.size(); i++)
+    if (show.statements[i].opcode == opRandom)
+      randomVariations = std::max(randomVariations, show.statements[i].args[0]);
+
+  double shortestMS = 0, longestMS = 0;
+  int steps = 0;
+  bool reachesEnd = true;
+  for (int seed = 0; seed < randomVariations; seed++)
+  {
+    Playback playback = playShow(show, motor, seed, 2, true);
+    if ((seed == 0) || (playback.lengthMS < shortestMS))
+      shortestMS = playback.lengthMS;
+    if ((seed == 0) || (playback.lengthMS > longestMS))
+      longestMS = playback.lengthMS;
+    steps = std::max(steps, playback.steps);
+    reachesEnd = reachesEnd && playback.reachedEnd;
+  }
+
+  if (show.errorCount)
+  {
+    std::fprintf(stderr, "%s: %d error(s), no header written\n", inputName, show.errorCount);
+    return 1;
+  }
+
+  //
+  // write the header
+  //
+  if (outputName)
+  {
+    std::ofstream out(outputName);
+    if (!out)
+    {
+      std::fprintf(stderr, "can not write %s\n", outputName);
+      return 1;
+    }
+    writeHeader(out, show, inputName, sculptureName);
+  }
+  else
+    writeHeader(std::cout, show, inputName, sculptureName);
+
+  //
+  // report the length of the show and its cost in flash
+  //
+  int flashBytes = programBytes + (int) show.palette.size() * PALETTE_ENTRY_BYTES +
+    (int) show.presets.size() * PRESET_ENTRY_BYTES;
+
+  std::fprintf(stderr, "%s%s%s:\n", inputName, sculptureName.empty() ? "" : " for ", sculptureName.c_str());
+  if (!reachesEnd)
+    std::fprintf(stderr, "  show length:   never reaches END, %.1f s before the first pass was cut off\n", longestMS / 1000.0);
+  else if (shortestMS == longestMS)
+    std::fprintf(stderr, "  show length:   %.1f s per pass\n", longestMS / 1000.0);
+  else
+    std::fprintf(stderr, "  show length:   %.1f - %.1f s per pass\n", shortestMS / 1000.0, longestMS / 1000.0);
+  std::fprintf(stderr, "  steps:         %d per pass\n", steps);
+  std::fprintf(stderr, "  flash:         %d bytes (program %d, palette %d, presets %d)\n", flashBytes, programBytes,
+    (int) show.palette.size() * PALETTE_ENTRY_BYTES, (int) show.presets.size() * PRESET_ENTRY_BYTES);
+  std::fprintf(stderr, "  as a table:    %d bytes\n", steps * EXTRAVAGANZA_TABLE_ENTRY_BYTES);
+
+  return 0;
+}
@@ -0,0 +1,265 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                    Gesture Replay (Linux)                      *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Replays traces of ultrasonic echoes through the sculpture's own gesture recognizer (see
+// Gestures.h) and checks the gestures it finds.  The sketch is built for the PC with the
+// stand-ins in tools/host.  Each sample is put in sensor 0's ring of samples, as the background
+// ranging does, and the gestures are then checked for as the Play mode does, so the recognizer
+// sees the raw samples with the times it works out for them.
+//
+// A trace file holds one or more traces:
+//
+//   trace NAME                     start a trace, the recognizer starts over with nobody seen
+//   TIME_MS DISTANCE_MM            a sample, millis() when it was measured and the distance,
+//                                  0 if there was no echo
+//   expect GESTURE ...             the gestures found since the last expect, in order, each
+//                                  "wave" or "step", or "none" if there were none
+//
+// Anything after a # is a comment.  A gesture found but not expected by the end of the trace is
+// a failure too.  tools/GestureTraces.txt has traces of hand waves and of visitors stepping in
+// and back, along with movements that must not be taken for them.
+//
+// Build:   g++ -std=gnu++11 -O2 -I tools/host -I . -o GestureReplay tools/GestureReplay.cpp tools/host/HostArduino.cpp
+// Run:     ./GestureReplay tools/GestureTraces.txt
+//
+// Options:
+//
+//   -v                     show the recognizer's state after every sample
+//
+// The exit status is 0 if every gesture was as expected, 1 if any wasn't or the file has an
+// error.
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "KineticSculptureExtravaganza.ino"
+
+//
+// what is being replayed
+//
+struct Replay
+{
+  std::string traceName;
+  int lineNumber;
+  bool verboseFlg;
+  std::string found;                            // gestures found since the last expect
+  int32_t traceCount;
+  int32_t expectCount;
+  int32_t failureCount;
+};
+
+
+// ---------------------------------------------------------------------------------
+//                                  Replaying
+// ---------------------------------------------------------------------------------
+
+static const char *gestureName(byte event)
+{
+  switch (event)
+  {
+    case gestureWave: return "wave";
+    case gestureStepInStepBack: return "step";
+    default: return "?";
+  }
+}
+
+
+//
+// check that every gesture found in the trace was expected
+//
+static void finishTrace(Replay *replay)
+{
+  if (!replay->traceName.empty() && !replay->found.empty())
+  {
+    replay->failureCount++;
+    std::printf("%s: found%s at the end, not expected\n", replay->traceName.c_str(), replay->found.c_str());
+  }
+  replay->found.clear();
+}
+
+
+//
+// start a trace, with the ranging and recognizer as they are when the Play mode starts
+//
+static void startTrace(Replay *replay, const std::string &name)
+{
+  finishTrace(replay);
+  replay->traceName = name;
+  replay->traceCount++;
+  ultrasonicInitialize();
+  gestureInitialize();
+}
+
+
+//
+// measure a sample, as the background ranging does when an echo comes back, then look for
+// gestures as the Play mode does
+//
+static void replaySample(Replay *replay, uint32_t timeMS, unsigned int distanceInMM)
+{
+  byte event;
+
+  hostMillis = timeMS;
+  ultrasonicFilterSample(0, distanceInMM);
+
+  while ((event = gestureCheck()) != gestureNone)
+  {
+    replay->found += std::string(" ") + gestureName(event);
+    if (replay->verboseFlg)
+      std::printf("  %8" PRIu32 " ms  %5u mm  %s\n", timeMS, distanceInMM, gestureName(event));
+  }
+
+  if (replay->verboseFlg)
+    std::printf("  %8" PRIu32 " ms  %5u mm  state %d  standing at %u mm\n",
+      timeMS, distanceInMM, gestureState, gestureBaselineMM);
+}
+
+
+//
+// check the gestures found against an expectation
+//  Enter:  words = the line after "expect"
+//  Exit:   false if the line isn't an expectation
+//
+static bool checkExpectation(Replay *replay, std::istringstream &words)
+{
+  std::string expected;
+  std::string word;
+
+  while (words >> word)
+  {
+    if ((word != "wave") && (word != "step") && (word != "none"))
+      return false;
+    if (word != "none")
+      expected += " " + word;
+  }
+
+  replay->expectCount++;
+  if (replay->found != expected)
+  {
+    replay->failureCount++;
+    std::printf("%s, line %d: found%s, expected%s\n", replay->traceName.c_str(), replay->lineNumber,
+      replay->found.empty() ? " none" : replay->found.c_str(), expected.empty() ? " none" : expected.c_str());
+  }
+  replay->found.clear();
+  return true;
+}
+
+
+//
+// replay a file of traces
+//  Exit:  false if the file can't be read or has an error
+//
+static bool replayFile(Replay *replay, std::istream &input)
+{
+  std::string line;
+
+  while (std::getline(input, line))
+  {
+    replay->lineNumber++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream words(line);
+    std::string first;
+    if (!(words >> first))
+      continue;
+
+    if (first == "trace")
+    {
+      std::string name;
+      std::getline(words >> std::ws, name);
+      startTrace(replay, name);
+      continue;
+    }
+
+    if (replay->traceName.empty())
+    {
+      std::fprintf(stderr, "line %d: a trace must be started first\n", replay->lineNumber);
+      return false;
+    }
+
+    if (first == "expect")
+    {
+      if (!checkExpectation(replay, words))
+      {
+        std::fprintf(stderr, "line %d: bad expectation\n", replay->lineNumber);
+        return false;
+      }
+      continue;
+    }
+
+    char *end;
+    uint32_t timeMS = std::strtoul(first.c_str(), &end, 10);
+    unsigned int distanceInMM;
+    if ((*end != 0) || !(words >> distanceInMM))
+    {
+      std::fprintf(stderr, "line %d: expected a time and distance\n", replay->lineNumber);
+      return false;
+    }
+    replaySample(replay, timeMS, distanceInMM);
+  }
+
+  finishTrace(replay);
+  return true;
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: GestureReplay [options] TRACE_FILE\n"
+    "  -v                   show the recognizer's state after every sample\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *fileName = 0;
+  Replay replay = {};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "-v")
+      replay.verboseFlg = true;
+    else if ((arg[0] != '-') && !fileName)
+      fileName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!fileName)
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::ifstream input(fileName);
+  if (!input)
+  {
+    std::fprintf(stderr, "can not open %s\n", fileName);
+    return 1;
+  }
+
+  hostSerialOutput = 0;
+  if (!replayFile(&replay, input))
+    return 1;
+
+  std::printf("%d traces, %d expectations, %d failed\n", (int) replay.traceCount,
+    (int) replay.expectCount, (int) replay.failureCount);
+  return (replay.failureCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                  Show Schedule Drift Test (Linux)              *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Plays the Action mode's show for a simulated day and checks that it never drifts from its
+// timeline.  The sketch is built for the PC with the stand-ins in tools/host, and the test moves
+// the clock itself, running the 10ms background process on each tick and holding up the main
+// loop now and then, as the LCD and the other modes do on the sculpture.  The clock starts so
+// that millis() wraps around part way through.
+//
+// Every segment the motion queue (see MotionQueue.h) starts is checked to be scheduled exactly
+// where the one before it ended, counted from the start of the show, and to be started no more
+// than a tick after that time.  So the show's position at the end of the day is still
+// exactly the sum of the segments played, with no drift however late the main loop was.
+//
+// Build:   g++ -std=gnu++11 -O2 -I tools/host -I . -o ScheduleDriftTest tools/ScheduleDriftTest.cpp tools/host/HostArduino.cpp
+// Run:     ./ScheduleDriftTest
+//
+// Options:
+//
+//   --hours N              hours to play the show for (24)
+//   --start MS             value of millis() when the show starts (12 hours before it wraps)
+//   --stall MS             longest time the main loop is held up (500)
+//   --seed N               seed for the times the main loop is held up (1)
+//
+// The exit status is 0 if the show kept to its timeline, 1 if it didn't.
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "KineticSculptureExtravaganza.ino"
+
+const uint32_t TICK_MS = 10;                 // period of the background process
+
+//
+// what has been seen of the show
+//
+struct DriftCheck
+{
+  uint32_t showStartMS;                         // millis() when the show started
+  uint64_t playedMS;                            // sum of the durations of the segments started
+  uint32_t segmentCount;
+  uint32_t failureCount;
+  uint32_t maxLateMS;                           // most a segment started after its scheduled time
+  bool wrappedFlg;                              // true once millis() has wrapped around
+};
+
+
+// ---------------------------------------------------------------------------------
+//                                   Checks
+// ---------------------------------------------------------------------------------
+
+static void reportFailure(DriftCheck *check, const char *what, uint32_t value, uint32_t expected)
+{
+  check->failureCount++;
+  if (check->failureCount <= 10)
+    std::printf("segment %" PRIu32 " at %" PRIu32 " ms: %s %" PRIu32 ", expected %" PRIu32 "\n",
+      check->segmentCount, (uint32_t) millis(), what, value, expected);
+}
+
+
+//
+// check the segments the background process has just started
+//  Enter:  firstIdx = queue index of the first segment started
+//          endIdx = queue index after the last one started
+//
+static void checkStartedSegments(DriftCheck *check, byte firstIdx, byte endIdx)
+{
+  for (byte idx = firstIdx; idx != endIdx; idx = (idx + 1) & MOTION_QUEUE_INDEX_MASK)
+  {
+    MOTION_SEGMENT *segment = &motionQueueSegments[idx];
+    uint32_t scheduledMS = check->showStartMS + (uint32_t) check->playedMS;
+    uint32_t lateMS = millis() - segment->startTimeMS;
+
+    //
+    // the segment must start where the last ended, and on the first tick at or after that
+    // time, it is started from its scheduled time so being up to a tick late doesn't matter
+    //
+    if (segment->startTimeMS != scheduledMS)
+      reportFailure(check, "scheduled at", segment->startTimeMS, scheduledMS);
+    else if (lateMS > TICK_MS)
+      reportFailure(check, "started late by", lateMS, 0);
+
+    if ((lateMS <= TICK_MS) && (lateMS > check->maxLateMS))
+      check->maxLateMS = lateMS;
+
+    check->playedMS += segment->durationMS;
+    check->segmentCount++;
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                 Simulation
+// ---------------------------------------------------------------------------------
+
+//
+// play the show, moving the clock one tick at a time
+//  Enter:  hours = how long to play for
+//          startMS = millis() when the sculpture starts up
+//          maxStallMS = longest time the main loop is held up
+//
+static bool runShow(uint32_t hours, uint32_t startMS, uint32_t maxStallMS)
+{
+  DriftCheck check = {};
+  uint64_t tickCount = hours * 3600ULL * (1000 / TICK_MS);
+  uint32_t stallTicks = 0;
+
+  hostMillis = startMS;
+  setup();
+  if (sculptureMode != actionMode)
+  {
+    std::printf("the sculpture didn't start in the Action mode\n");
+    return false;
+  }
+  check.showStartMS = extravaganzaShowStartTimeMS;
+
+  for (uint64_t tick = 0; tick < tickCount; tick++)
+  {
+    byte firstIdx = motionQueueTail;
+
+    hostMillis += TICK_MS;
+    if (hostMillis < TICK_MS)
+      check.wrappedFlg = true;
+    TIMER3_COMPA_vect();
+    checkStartedSegments(&check, firstIdx, motionQueueTail);
+
+    //
+    // run the main loop, unless it is being held up
+    //
+    if (stallTicks > 0)
+    {
+      stallTicks--;
+      continue;
+    }
+    loop();
+    if ((maxStallMS >= TICK_MS) && (std::rand() % 100 == 0))
+      stallTicks = std::rand() % (maxStallMS / TICK_MS + 1);
+  }
+
+  //
+  // the drift is how far the end of the last segment started is from the sum of the segments
+  // played, this is exact as the sum is kept without wrapping around
+  //
+  uint32_t elapsedMS = hostMillis - check.showStartMS;
+  int32_t driftMS = (int32_t) ((uint32_t) (check.showStartMS + check.playedMS) - motionQueueSegmentFinishTimeMS);
+  std::printf("played %" PRIu32 " segments in %.2f hours%s, %" PRId32 " ms of drift\n",
+    check.segmentCount, elapsedMS / 3600000.0, check.wrappedFlg ? " across the millis() wrap" : "", driftMS);
+  std::printf("segments started at most %" PRIu32 " ms after their scheduled time, %u queue underruns\n",
+    check.maxLateMS, (unsigned int) motionQueueUnderrunCount);
+
+  if (check.segmentCount == 0)
+  {
+    std::printf("the show didn't play\n");
+    return false;
+  }
+  if (motionQueueUnderrunCount != 0)
+    return false;
+  if (driftMS != 0)
+    return false;
+  return check.failureCount == 0;
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: ScheduleDriftTest [options]\n"
+    "  --hours N            hours to play the show for (24)\n"
+    "  --start MS           millis() when the show starts (12 hours before it wraps)\n"
+    "  --stall MS           longest time the main loop is held up (500)\n"
+    "  --seed N             seed for the times the main loop is held up (1)\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t hours = 24;
+  uint32_t startMS = 0 - 12 * 3600000U;
+  uint32_t maxStallMS = 500;
+  uint32_t seed = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if ((arg == "--hours") && hasValue)
+      hours = std::strtoul(argv[++i], 0, 10);
+    else if ((arg == "--start") && hasValue)
+      startMS = std::strtoul(argv[++i], 0, 10);
+    else if ((arg == "--stall") && hasValue)
+      maxStallMS = std::strtoul(argv[++i], 0, 10);
+    else if ((arg == "--seed") && hasValue)
+      seed = std::strtoul(argv[++i], 0, 10);
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  hostSerialOutput = 0;
+  std::srand(seed);
+
+  bool passedFlg = runShow(hours, startMS, maxStallMS);
+  std::printf("%s\n", passedFlg ? "pass" : "FAIL");
+  return passedFlg ? 0 : 1;
+}
@@ -0,0 +1,224 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Sculpture Simulator (Linux)                  *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Runs the sketch on the PC, in real time, with its serial port on a pseudo-terminal, so the
+// command console (see Console.h) and tools/ConsoleClient.cpp can be tried without the
+// sculpture.  The sketch is built with the stand-ins in tools/host.  The 10ms background process
+// is run every 10ms of real time and the main loop in between, the motors, backlight, LCD and
+// buttons are stand-ins that do nothing, so the disk velocities and color are only what the
+// sketch sets them to.
+//
+// The name of the pseudo-terminal is written on the first line of the standard output, give it
+// to ConsoleClient with "--wait 0", as there is no Mega to restart.  When the simulator stops,
+// after --seconds or when it is interrupted, it writes the mode, disk velocities and color it
+// ended with, so a script can check that the commands sent took effect.  The disks and backlight
+// take 500ms to stop after "mode stop", a "vel" or "rgb" sent before then is overridden:
+//
+//   ./SculptureSimulator --seconds 5 > sim.txt &
+//   sleep 0.5
+//   ./ConsoleClient "$(head -1 sim.txt)" --wait 0 -c "set telemetry 0" -c "mode stop"
+//   sleep 1
+//   ./ConsoleClient "$(head -1 sim.txt)" --wait 0 -c "rgb 10 20 30" -c "vel 5 -5 500"
+//   wait; tail -1 sim.txt
+//
+// Build:   g++ -std=gnu++11 -O2 -I tools/host -I . -o SculptureSimulator tools/SculptureSimulator.cpp tools/host/HostArduino.cpp
+// Run:     ./SculptureSimulator
+//
+// Options:
+//
+//   --seconds N            stop after N seconds (run until interrupted)
+//   --link PATH            also make a symbolic link at PATH to the pseudo-terminal
+//
+// The exit status is 0, or 1 if the pseudo-terminal can't be made.
+//
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "KineticSculptureExtravaganza.ino"
+
+const unsigned int TICK_MS = 10;                // period of the background process
+
+static volatile sig_atomic_t stopFlg = 0;
+
+
+// ---------------------------------------------------------------------------------
+//                               Pseudo-terminal
+// ---------------------------------------------------------------------------------
+
+//
+// make the pseudo-terminal, raw 8 bit bytes the same as the sculpture's serial port
+//  Exit:  file descriptor of the master side returned, -1 on an error
+//
+static int openPseudoTerminal()
+{
+  struct termios tty;
+
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((fd < 0) || (grantpt(fd) != 0) || (unlockpt(fd) != 0))
+  {
+    std::fprintf(stderr, "can not make a pseudo-terminal: %s\n", std::strerror(errno));
+    return -1;
+  }
+
+  if (tcgetattr(fd, &tty) == 0)
+  {
+    cfmakeraw(&tty);
+    tcsetattr(fd, TCSANOW, &tty);
+  }
+
+  //
+  // nothing waits on the pseudo-terminal, what is written with nobody reading it is lost as it
+  // would be on the serial port
+  //
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+
+//
+// pass the characters sent to the pseudo-terminal to the sketch's serial port
+//
+static void receiveCharacters(int fd)
+{
+  char buffer[256];
+
+  ssize_t count = read(fd, buffer, sizeof(buffer));
+  if (count > 0)
+    hostSerialInput(buffer, count);
+}
+
+
+static uint32_t nowMS()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000U + now.tv_nsec / 1000000U;
+}
+
+
+static void stopSignal(int)
+{
+  stopFlg = 1;
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                  Simulation
+// ---------------------------------------------------------------------------------
+
+//
+// run the sketch in real time until stopped
+//  Enter:  fd = master side of the pseudo-terminal
+//          seconds = time to run for, 0 to run until interrupted
+//
+static void runSketch(int fd, uint32_t seconds)
+{
+  uint32_t startMS = nowMS();
+  uint32_t nextTickMS = TICK_MS;
+
+  hostMillis = 0;
+  setup();
+
+  while (!stopFlg)
+  {
+    uint32_t elapsedMS = nowMS() - startMS;
+    if ((seconds != 0) && (elapsedMS >= seconds * 1000U))
+      break;
+
+    //
+    // run the background process for each tick that has come, then the main loop
+    //
+    while ((int32_t) (elapsedMS - nextTickMS) >= 0)
+    {
+      hostMillis = nextTickMS;
+      TIMER3_COMPA_vect();
+      nextTickMS += TICK_MS;
+    }
+    hostMillis = elapsedMS;
+
+    receiveCharacters(fd);
+    loop();
+    usleep(500);
+  }
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: SculptureSimulator [options]\n"
+    "  --seconds N          stop after N seconds (run until interrupted)\n"
+    "  --link PATH          make a symbolic link at PATH to the pseudo-terminal\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  uint32_t seconds = 0;
+  const char *linkName = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if ((arg == "--seconds") && hasValue)
+      seconds = std::strtoul(argv[++i], 0, 10);
+    else if ((arg == "--link") && hasValue)
+      linkName = argv[++i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  int fd = openPseudoTerminal();
+  if (fd < 0)
+    return 1;
+
+  if (linkName)
+  {
+    if (symlink(ptsname(fd), linkName) != 0)
+    {
+      std::fprintf(stderr, "can not make the link %s: %s\n", linkName, std::strerror(errno));
+      return 1;
+    }
+  }
+
+  std::printf("%s\n", ptsname(fd));
+  std::fflush(stdout);
+
+  signal(SIGINT, stopSignal);
+  signal(SIGTERM, stopSignal);
+
+  //
+  // the sketch's serial port writes to the pseudo-terminal
+  //
+  hostSerialOutput = fdopen(dup(fd), "w");
+  setvbuf(hostSerialOutput, 0, _IONBF, 0);
+
+  runSketch(fd, seconds);
+
+  std::printf("mode %s, outer %.1f rpm, inner %.1f rpm, color %d %d %d\n", ConsoleModeNames[sculptureMode],
+    diskVelocitiesTransitionFinalSpeedOuter, diskVelocitiesTransitionFinalSpeedInner,
+    backlightNextRed, backlightNextGreen, backlightNextBlue);
+
+  if (linkName)
+    unlink(linkName);
+  return 0;
+}
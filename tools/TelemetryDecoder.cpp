@@ -0,0 +1,347 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                  Telemetry Stream Decoder (Linux)              *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Decodes the binary telemetry sent by the sculpture (see Telemetry.h) into CSV, one row for
+// each frame, that can be loaded into a spreadsheet or plotted.  It reads from the sculpture's
+// serial port, or from a file the stream was captured into.  Text written by the Diagnostics
+// mode and frames spoiled on the way are skipped, and a summary is written when the input ends
+// or Ctrl-C is pressed.  It runs on the PC, not on the sculpture.
+//
+// Build:   g++ -std=c++11 -O2 -o TelemetryDecoder tools/TelemetryDecoder.cpp
+// Run:     ./TelemetryDecoder /dev/ttyACM0 -o motors.csv
+//          ./TelemetryDecoder captured.bin > motors.csv
+//
+// Options:
+//
+//   -o FILE                write the CSV to FILE rather than the standard output
+//   --baud N               baud rate of the serial port (115200, set by Serial.begin())
+//
+// The columns are the fields of TELEMETRY_FRAME, with the time in milliseconds since the
+// sculpture was turned on and the transition progress as a fraction from 0 to 1.
+//
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+//
+// these must match the frame format in Telemetry.h
+//
+const int TELEMETRY_FRAME_MOTION = 1;
+const int TELEMETRY_FRAME_BYTES = 27;           // sizeof(TELEMETRY_FRAME) on the AVR
+const int TELEMETRY_CRC_BYTES = 2;
+const size_t MAX_ENCODED_BYTES = 254;           // anything longer between zeros is not a frame
+
+//
+// what was seen in the stream
+//
+struct DecodeCounts
+{
+  long frames;
+  long badFrames;                               // wrong length, type or CRC
+  long missingFrames;                           // found from gaps in the sequence numbers
+};
+
+static volatile sig_atomic_t stopFlg = 0;
+
+
+// ---------------------------------------------------------------------------------
+//                                 Frame Decoding
+// ---------------------------------------------------------------------------------
+
+//
+// add a byte to a CRC-16/CCITT, the same as telemetryCRC16Update()
+//
+static unsigned int crc16Update(unsigned int crc, unsigned char data)
+{
+  crc = ((crc >> 8) | (crc << 8)) & 0xffff;
+  crc ^= data;
+  crc ^= (crc & 0xff) >> 4;
+  crc ^= (crc << 12) & 0xffff;
+  crc ^= (crc & 0xff) << 5;
+  return crc;
+}
+
+
+//
+// undo the COBS encoding of the bytes between two zeros
+//  Exit:  false if the bytes are not validly encoded
+//
+static bool cobsDecode(const std::vector<unsigned char> &encoded, std::vector<unsigned char> &decoded)
+{
+  decoded.clear();
+  size_t i = 0;
+  while (i < encoded.size())
+  {
+    unsigned int code = encoded[i++];
+    if ((code == 0) || (i + code - 1 > encoded.size()))
+      return false;
+
+    for (unsigned int j = 1; j < code; j++)
+      decoded.push_back(encoded[i++]);
+
+    if ((code < 0xff) && (i < encoded.size()))
+      decoded.push_back(0);
+  }
+  return true;
+}
+
+
+static int readInt16(const unsigned char *bytes)
+{
+  return (short) (bytes[0] | (bytes[1] << 8));
+}
+
+
+static unsigned int readUInt16(const unsigned char *bytes)
+{
+  return bytes[0] | (bytes[1] << 8);
+}
+
+
+static unsigned long readUInt32(const unsigned char *bytes)
+{
+  return (unsigned long) bytes[0] | ((unsigned long) bytes[1] << 8) |
+    ((unsigned long) bytes[2] << 16) | ((unsigned long) bytes[3] << 24);
+}
+
+
+static void writeCSVHeader(FILE *out)
+{
+  std::fprintf(out, "sequence,time_ms,desired_rpm_1,measured_rpm_1,pwm_1,integrator_1,"
+    "desired_rpm_2,measured_rpm_2,pwm_2,integrator_2,disk_transition,backlight_transition,"
+    "red,green,blue,distance_mm\n");
+}
+
+
+//
+// check a decoded frame and write it as a row of CSV
+//  Exit:  false if the frame is not valid
+//
+static bool writeFrame(FILE *out, const std::vector<unsigned char> &frame, DecodeCounts &counts, int &lastSequence)
+{
+  if (frame.size() != (size_t) (TELEMETRY_FRAME_BYTES + TELEMETRY_CRC_BYTES))
+    return false;
+
+  const unsigned char *f = &frame[0];
+  unsigned int crc = 0xffff;
+  for (int i = 0; i < TELEMETRY_FRAME_BYTES; i++)
+    crc = crc16Update(crc, f[i]);
+  if (crc != readUInt16(f + TELEMETRY_FRAME_BYTES))
+    return false;
+
+  if (f[0] != TELEMETRY_FRAME_MOTION)
+    return false;
+
+  int sequence = f[1];
+  if (lastSequence >= 0)
+    counts.missingFrames += (sequence - lastSequence - 1) & 0xff;
+  lastSequence = sequence;
+
+  std::fprintf(out, "%d,%lu,%d,%d,%u,%d,%d,%d,%u,%d,%.3f,%.3f,%u,%u,%u,%u\n",
+    sequence,
+    readUInt32(f + 2),
+    readInt16(f + 6), readInt16(f + 8), f[10], readInt16(f + 11),
+    readInt16(f + 13), readInt16(f + 15), f[17], readInt16(f + 18),
+    f[20] / 255.0, f[21] / 255.0,
+    f[22], f[23], f[24],
+    readUInt16(f + 25));
+  return true;
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                  Serial Port
+// ---------------------------------------------------------------------------------
+
+static speed_t baudToSpeed(long baud)
+{
+  switch (baud)
+  {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default: return 0;
+  }
+}
+
+
+//
+// set a serial port to raw 8 bit bytes, a file or pipe is left as it is
+//
+static bool setupSerialPort(int fd, long baud)
+{
+  struct termios tty;
+
+  if (!isatty(fd))
+    return true;
+
+  speed_t speed = baudToSpeed(baud);
+  if (speed == 0)
+  {
+    std::fprintf(stderr, "unsupported baud rate %ld\n", baud);
+    return false;
+  }
+
+  if (tcgetattr(fd, &tty) != 0)
+  {
+    std::fprintf(stderr, "can not read the serial port settings: %s\n", std::strerror(errno));
+    return false;
+  }
+
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 1;
+  tty.c_cc[VTIME] = 0;
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0)
+  {
+    std::fprintf(stderr, "can not set the serial port: %s\n", std::strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+
+static void onSignal(int)
+{
+  stopFlg = 1;
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: TelemetryDecoder [options] [SERIAL_PORT_OR_FILE]\n"
+    "  -o FILE              write the CSV to FILE (standard output)\n"
+    "  --baud N             serial port baud rate (115200)\n"
+    "reads the standard input if no port or file is given\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *inputName = 0;
+  const char *outputName = 0;
+  long baud = 115200;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+
+    if ((arg == "-o") && hasValue)
+      outputName = argv[++i];
+    else if ((arg == "--baud") && hasValue)
+      baud = std::atol(argv[++i]);
+    else if ((arg[0] != '-') && !inputName)
+      inputName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  int fd = 0;
+  if (inputName)
+  {
+    fd = open(inputName, O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+      std::fprintf(stderr, "can not open %s: %s\n", inputName, std::strerror(errno));
+      return 1;
+    }
+  }
+  if (!setupSerialPort(fd, baud))
+    return 1;
+
+  FILE *out = stdout;
+  if (outputName)
+  {
+    out = std::fopen(outputName, "w");
+    if (!out)
+    {
+      std::fprintf(stderr, "can not write %s\n", outputName);
+      return 1;
+    }
+  }
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+
+  //
+  // split the stream at the zeros, the bytes before the first zero are part of a frame whose
+  // start was missed so they are thrown away
+  //
+  DecodeCounts counts = {0, 0, 0};
+  int lastSequence = -1;
+  bool synchronizedFlg = false;
+  bool overlongFlg = false;
+  std::vector<unsigned char> encoded;
+  std::vector<unsigned char> decoded;
+  unsigned char buffer[256];
+
+  writeCSVHeader(out);
+
+  while (!stopFlg)
+  {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count == 0)
+      break;
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      std::fprintf(stderr, "read error: %s\n", std::strerror(errno));
+      break;
+    }
+
+    for (ssize_t i = 0; i < count; i++)
+    {
+      if (buffer[i] != 0)
+      {
+        if (encoded.size() < MAX_ENCODED_BYTES)
+          encoded.push_back(buffer[i]);
+        else
+          overlongFlg = true;
+        continue;
+      }
+
+      if (synchronizedFlg && (!encoded.empty() || overlongFlg))
+      {
+        if (!overlongFlg && cobsDecode(encoded, decoded) && writeFrame(out, decoded, counts, lastSequence))
+          counts.frames++;
+        else
+          counts.badFrames++;
+      }
+      synchronizedFlg = true;
+      overlongFlg = false;
+      encoded.clear();
+    }
+    std::fflush(out);
+  }
+
+  if (out != stdout)
+    std::fclose(out);
+
+  std::fprintf(stderr, "%ld frames, %ld bad frames skipped, %ld frames missing\n",
+    counts.frames, counts.badFrames, counts.missingFrames);
+  return 0;
+}
@@ -0,0 +1,354 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   Event Trace Timeline (Linux)                 *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Shows the event trace written by the sculpture (see Trace.h) as a timeline, so what led up
+// to a stall or jerk can be read through in order.  Capture the serial port while entering the
+// Diagnostics mode, then give the capture to this tool, the last trace in it is shown.  It runs
+// on the PC, not on the sculpture.
+//
+// Build:   g++ -std=c++11 -O2 -o TraceTimeline tools/TraceTimeline.cpp
+// Run:     ./TraceTimeline capture.txt
+//          cat /dev/ttyACM0 | ./TraceTimeline
+//
+// Options:
+//
+//   --no-pi                leave out the PI loop records, which come every 10ms
+//
+// The times are in milliseconds from the fault that froze the trace, or from the first record
+// if there wasn't one.  Each event is shown in a column: motor 1 (the outer disk), motor 2 (the
+// inner disk), and everything else.
+//
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//
+// these must match Trace.h
+//
+enum TraceTypes {traceNone, traceTachEdge1, traceTachEdge2, tracePIOutput1, tracePIOutput2, traceDiskTransition,
+                 traceBacklightTransition, traceModeChange, traceButtonEvent, traceEcho, traceFault, traceResync};
+
+const int TRACE_RECORD_BYTES = 8;
+const double TIMER5_MS_PER_COUNT = 0.0005;
+
+enum TraceFaults {traceFaultStall = 1, traceFaultJerk, traceFaultOverrun};
+
+static const char *FaultNames[] = {"none", "STALL", "JERK", "LATE PASS"};
+
+//
+// these must match Architecture.h and Buttons.h
+//
+static const char *ModeNames[] = {"Action", "Light", "Play", "Meter Stick", "Set Contrast", "Set Time",
+                                  "Diagnostics", "Stopped"};
+static const char *ButtonNames[] = {"Remote C", "Remote A", "Remote D", "Remote B", "?", "Down", "Mode", "Up"};
+static const char *ButtonEventNames[] = {"none", "pushed", "released", "repeat"};
+
+const int COLUMN_WIDTH = 30;
+
+struct TraceRecord
+{
+  unsigned int timeCount;
+  int type;
+  int arg;
+  int value1;
+  int value2;
+  double timeMS;                                // unwrapped time from the first record
+};
+
+
+// ---------------------------------------------------------------------------------
+//                                 Reading the Trace
+// ---------------------------------------------------------------------------------
+
+static int hexByte(const std::string &text, size_t position)
+{
+  return (int) std::strtol(text.substr(position, 2).c_str(), 0, 16);
+}
+
+
+//
+// read the last trace written to a capture, the serial port's other text is skipped
+//  Exit:  false if no complete trace was found
+//
+static bool readTrace(std::istream &in, std::vector<TraceRecord> &records, int &fault)
+{
+  std::vector<TraceRecord> block;
+  bool inBlockFlg = false;
+  bool foundFlg = false;
+  int blockFault = 0;
+  std::string line;
+
+  while (std::getline(in, line))
+  {
+    while (!line.empty() && ((line[line.size() - 1] == '\r') || (line[line.size() - 1] == '\n')))
+      line.erase(line.size() - 1);
+
+    size_t start = line.find("TRACE ");
+    if (start == std::string::npos)
+      continue;
+    std::string rest = line.substr(start + 6);
+
+    if (rest.compare(0, 6, "BEGIN ") == 0)
+    {
+      int count = 0;
+      std::istringstream(rest.substr(6)) >> count >> blockFault;
+      block.clear();
+      inBlockFlg = true;
+    }
+    else if (rest == "END")
+    {
+      if (inBlockFlg)
+      {
+        records = block;
+        fault = blockFault;
+        foundFlg = true;
+      }
+      inBlockFlg = false;
+    }
+    else if (inBlockFlg)
+    {
+      if (rest.size() != TRACE_RECORD_BYTES * 2)
+      {
+        std::fprintf(stderr, "skipping bad trace line: %s\n", line.c_str());
+        continue;
+      }
+
+      TraceRecord record;
+      record.timeCount = hexByte(rest, 0) | (hexByte(rest, 2) << 8);
+      record.type = hexByte(rest, 4);
+      record.arg = hexByte(rest, 6);
+      record.value1 = (short) (hexByte(rest, 8) | (hexByte(rest, 10) << 8));
+      record.value2 = (short) (hexByte(rest, 12) | (hexByte(rest, 14) << 8));
+      block.push_back(record);
+    }
+  }
+
+  return foundFlg;
+}
+
+
+//
+// full time in a resync record, microseconds from micros()
+//
+static unsigned long resyncMicroseconds(const TraceRecord &record)
+{
+  return (record.value1 & 0xffffUL) | ((record.value2 & 0xffffUL) << 16);
+}
+
+
+//
+// rebuild the full time from the 16 bit Timer5 counts, records are never more than one turn
+// of the count apart, except across a pause while the trace was written out.  A resync record
+// is timed from the one before it with the full time they both hold.
+//
+static void unwrapTimes(std::vector<TraceRecord> &records)
+{
+  double timeMS = 0;
+  int lastResync = -1;
+
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    if ((records[i].type == traceResync) && (lastResync >= 0))
+      timeMS = records[lastResync].timeMS +
+        ((resyncMicroseconds(records[i]) - resyncMicroseconds(records[lastResync])) & 0xffffffffUL) / 1000.0;
+    else if (i != 0)
+      timeMS += ((records[i].timeCount - records[i - 1].timeCount) & 0xffff) * TIMER5_MS_PER_COUNT;
+    records[i].timeMS = timeMS;
+
+    if (records[i].type == traceResync)
+      lastResync = (int) i;
+  }
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                 The Timeline
+// ---------------------------------------------------------------------------------
+
+static std::string format(const char *formatString, ...) __attribute__((format(printf, 1, 2)));
+
+static std::string format(const char *formatString, ...)
+{
+  char buffer[128];
+  va_list args;
+
+  va_start(args, formatString);
+  std::vsnprintf(buffer, sizeof(buffer), formatString, args);
+  va_end(args);
+  return buffer;
+}
+
+
+static const char *nameOf(const char **names, int count, int index)
+{
+  return ((index >= 0) && (index < count)) ? names[index] : "?";
+}
+
+
+//
+// describe a record
+//  Exit:  column it is shown in returned, 0 for motor 1, 1 for motor 2, 2 for the others
+//
+static int describeRecord(const TraceRecord &record, std::string &text)
+{
+  switch (record.type)
+  {
+    case traceTachEdge1:
+    case traceTachEdge2:
+      text = format("tach %u us", (unsigned int) (record.value1 & 0xffff));
+      return record.type == traceTachEdge1 ? 0 : 1;
+
+    case tracePIOutput1:
+    case tracePIOutput2:
+      text = format("pwm %3d rpm %5d err %+d", record.arg, record.value1, record.value2);
+      return record.type == tracePIOutput1 ? 0 : 1;
+
+    case traceDiskTransition:
+      if (record.arg == 255)
+        text = format("disks to %.1f / %.1f RPM over 25.5+ s", record.value1 / 10.0, record.value2 / 10.0);
+      else
+        text = format("disks to %.1f / %.1f RPM over %.1f s", record.value1 / 10.0, record.value2 / 10.0,
+          record.arg / 10.0);
+      return 2;
+
+    case traceBacklightTransition:
+      text = format("backlight to %d,%d,%d over %d ms", record.arg, (record.value1 >> 8) & 0xff,
+        record.value1 & 0xff, record.value2);
+      return 2;
+
+    case traceModeChange:
+      text = format("mode %s", nameOf(ModeNames, 8, record.arg));
+      return 2;
+
+    case traceButtonEvent:
+      text = format("button %s %s", nameOf(ButtonNames, 8, record.arg), nameOf(ButtonEventNames, 4, record.value1));
+      return 2;
+
+    case traceEcho:
+      if (record.value1 == 0)
+        text = format("sensor %d no echo, filtered %d mm", record.arg, record.value2);
+      else
+        text = format("sensor %d %d mm, filtered %d mm", record.arg, record.value1, record.value2);
+      return 2;
+
+    case traceResync:
+      text = format("time resync, %lu us", resyncMicroseconds(record));
+      return 2;
+
+    case traceFault:
+      if (record.arg == traceFaultOverrun)
+      {
+        text = format("*** LATE PASS %d tick, %u us", record.value1, (unsigned int) (record.value2 & 0xffff) * 4);
+        return 2;
+      }
+      if (record.arg == traceFaultStall)
+        text = format("*** STALL at %d rpm", record.value2);
+      else
+        text = format("*** %s %+d rpm", nameOf(FaultNames, 4, record.arg), record.value2);
+      return record.value1 == 2 ? 1 : 0;
+
+    default:
+      text = format("unknown record type %d", record.type);
+      return 2;
+  }
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: TraceTimeline [options] [CAPTURE_FILE]\n"
+    "  --no-pi              leave out the PI loop records\n"
+    "reads the standard input if no file is given\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *inputName = 0;
+  bool showPIFlg = true;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--no-pi")
+      showPIFlg = false;
+    else if ((arg[0] != '-') && !inputName)
+      inputName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  std::vector<TraceRecord> records;
+  int fault = 0;
+  bool foundFlg;
+
+  if (inputName)
+  {
+    std::ifstream in(inputName);
+    if (!in)
+    {
+      std::fprintf(stderr, "can not open %s\n", inputName);
+      return 1;
+    }
+    foundFlg = readTrace(in, records, fault);
+  }
+  else
+    foundFlg = readTrace(std::cin, records, fault);
+
+  if (!foundFlg)
+  {
+    std::fprintf(stderr, "no trace found, it is written when the Diagnostics mode is entered\n");
+    return 1;
+  }
+
+  unwrapTimes(records);
+
+  //
+  // times are shown from the first fault
+  //
+  double zeroMS = 0;
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    if (records[i].type == traceFault)
+    {
+      zeroMS = records[i].timeMS;
+      break;
+    }
+  }
+
+  std::printf("%d records over %.1f ms, %s\n\n", (int) records.size(),
+    records.empty() ? 0.0 : records.back().timeMS, fault ? format("frozen by %s", nameOf(FaultNames, 4, fault)).c_str() :
+    "not frozen");
+  std::printf("%10s  %-*s  %-*s  %s\n", "time ms", COLUMN_WIDTH, "motor 1 (outer)", COLUMN_WIDTH, "motor 2 (inner)",
+    "events");
+
+  for (size_t i = 0; i < records.size(); i++)
+  {
+    const TraceRecord &record = records[i];
+    if (!showPIFlg && ((record.type == tracePIOutput1) || (record.type == tracePIOutput2)))
+      continue;
+
+    std::string text;
+    int column = describeRecord(record, text);
+
+    std::printf("%10.3f  %*s%s\n", record.timeMS - zeroMS, column * (COLUMN_WIDTH + 2), "", text.c_str());
+  }
+
+  return 0;
+}
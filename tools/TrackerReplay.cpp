@@ -0,0 +1,267 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                 Approach Tracker Replay (Linux)                *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Replays traces of ultrasonic distances through the sculpture's own approach tracker (see
+// Ultrasonic.h) and checks what it makes of them.  The sketch is built for the PC with the
+// stand-ins in tools/host.  Each sample goes through the same path as on the sculpture: into
+// sensor 0's ring of samples, whose median throws out the odd missed or stray echo, and then
+// into the alpha-beta tracker, which follows the visitor's distance and approach speed.
+//
+// A trace file holds one or more traces:
+//
+//   trace NAME                     start a trace, the tracker starts over with nothing seen
+//   TIME_MS DISTANCE_MM            a sample, millis() when it was measured and the distance,
+//                                  0 if there was no echo
+//   expect distance MIN MAX        the tracked distance in mm after the sample before it
+//   expect speed MIN MAX           the approach speed in mm/s, positive coming closer
+//   expect ahead MS MIN MAX        the distance in mm predicted MS milliseconds ahead
+//   expect lost                    the tracker has nothing to follow
+//
+// Anything after a # is a comment.  tools/TrackerTraces.txt has traces of a visitor standing,
+// walking up and walking away, with missed and stray echoes mixed in.
+//
+// Build:   g++ -std=gnu++11 -O2 -I tools/host -I . -o TrackerReplay tools/TrackerReplay.cpp tools/host/HostArduino.cpp
+// Run:     ./TrackerReplay tools/TrackerTraces.txt
+//
+// Options:
+//
+//   -v                     show the tracker's estimates after every sample
+//
+// The exit status is 0 if every expectation was met, 1 if any wasn't or the file has an error.
+//
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "KineticSculptureExtravaganza.ino"
+
+//
+// what is being replayed
+//
+struct Replay
+{
+  std::string traceName;
+  int lineNumber;
+  bool sampleSeenFlg;                           // true once the trace has a sample
+  bool verboseFlg;
+  int32_t traceCount;
+  int32_t expectCount;
+  int32_t failureCount;
+};
+
+
+// ---------------------------------------------------------------------------------
+//                                  Replaying
+// ---------------------------------------------------------------------------------
+
+//
+// start a trace, with the ranging and tracker as they are when the sculpture starts up
+//
+static void startTrace(Replay *replay, const std::string &name)
+{
+  replay->traceName = name;
+  replay->sampleSeenFlg = false;
+  replay->traceCount++;
+  ultrasonicInitialize();
+}
+
+
+//
+// measure a sample, as the background ranging does when an echo comes back
+//
+static void replaySample(Replay *replay, uint32_t timeMS, unsigned int distanceInMM)
+{
+  hostMillis = timeMS;
+  ultrasonicFilterSample(0, distanceInMM);
+  ultrasonicFuseSensors();
+  replay->sampleSeenFlg = true;
+
+  if (replay->verboseFlg)
+  {
+    if (ultrasonicTrackerValidFlg)
+      std::printf("  %8" PRIu32 " ms  %5u mm  median %5u mm  tracked %5d mm  %6d mm/s  1s ahead %5d mm\n",
+        timeMS, distanceInMM, ultrasonicSensorStates[0].medianInMM, ultrasonicGetPredictedDistanceInMM(0),
+        ultrasonicGetApproachSpeedInMMPerS(), ultrasonicGetPredictedDistanceInMM(1000));
+    else
+      std::printf("  %8" PRIu32 " ms  %5u mm  median %5u mm  nothing tracked\n",
+        timeMS, distanceInMM, ultrasonicSensorStates[0].medianInMM);
+  }
+}
+
+
+static void reportFailure(Replay *replay, const char *what, long value, long minValue, long maxValue)
+{
+  replay->failureCount++;
+  std::printf("%s, line %d: %s %d, expected %d to %d\n", replay->traceName.c_str(), replay->lineNumber,
+    what, (int) value, (int) minValue, (int) maxValue);
+}
+
+
+//
+// check the tracker against an expectation
+//  Enter:  words = the line after "expect"
+//  Exit:   false if the line isn't an expectation
+//
+static bool checkExpectation(Replay *replay, std::istringstream &words)
+{
+  std::string what;
+  int aheadMS = 0;
+  int minValue = 0;
+  int maxValue = 0;
+
+  words >> what;
+  replay->expectCount++;
+
+  if (what == "lost")
+  {
+    if (ultrasonicTrackerValidFlg)
+    {
+      replay->failureCount++;
+      std::printf("%s, line %d: still tracking at %d mm, expected nothing\n", replay->traceName.c_str(),
+        replay->lineNumber, ultrasonicGetPredictedDistanceInMM(0));
+    }
+    return true;
+  }
+
+  if (what == "ahead")
+    words >> aheadMS;
+  if (!(words >> minValue >> maxValue))
+    return false;
+
+  long value;
+  if (what == "distance")
+    value = ultrasonicGetPredictedDistanceInMM(0);
+  else if (what == "speed")
+    value = ultrasonicGetApproachSpeedInMMPerS();
+  else if (what == "ahead")
+    value = ultrasonicGetPredictedDistanceInMM(aheadMS);
+  else
+    return false;
+
+  if (!ultrasonicTrackerValidFlg)
+  {
+    replay->failureCount++;
+    std::printf("%s, line %d: nothing tracked, expected %s %d to %d\n", replay->traceName.c_str(),
+      replay->lineNumber, what.c_str(), minValue, maxValue);
+  }
+  else if ((value < minValue) || (value > maxValue))
+    reportFailure(replay, what.c_str(), value, minValue, maxValue);
+  return true;
+}
+
+
+//
+// replay a file of traces
+//  Exit:  false if the file can't be read or has an error
+//
+static bool replayFile(Replay *replay, std::istream &input)
+{
+  std::string line;
+
+  while (std::getline(input, line))
+  {
+    replay->lineNumber++;
+    size_t comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream words(line);
+    std::string first;
+    if (!(words >> first))
+      continue;
+
+    if (first == "trace")
+    {
+      std::string name;
+      std::getline(words >> std::ws, name);
+      startTrace(replay, name);
+      continue;
+    }
+
+    if (replay->traceName.empty())
+    {
+      std::fprintf(stderr, "line %d: a trace must be started first\n", replay->lineNumber);
+      return false;
+    }
+
+    if (first == "expect")
+    {
+      if (!replay->sampleSeenFlg || !checkExpectation(replay, words))
+      {
+        std::fprintf(stderr, "line %d: bad expectation\n", replay->lineNumber);
+        return false;
+      }
+      continue;
+    }
+
+    char *end;
+    uint32_t timeMS = std::strtoul(first.c_str(), &end, 10);
+    unsigned int distanceInMM;
+    if ((*end != 0) || !(words >> distanceInMM))
+    {
+      std::fprintf(stderr, "line %d: expected a time and distance\n", replay->lineNumber);
+      return false;
+    }
+    replaySample(replay, timeMS, distanceInMM);
+  }
+  return true;
+}
+
+
+static void printUsage()
+{
+  std::fprintf(stderr,
+    "usage: TrackerReplay [options] TRACE_FILE\n"
+    "  -v                   show the tracker's estimates after every sample\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+  const char *fileName = 0;
+  Replay replay = {};
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "-v")
+      replay.verboseFlg = true;
+    else if ((arg[0] != '-') && !fileName)
+      fileName = argv[i];
+    else
+    {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (!fileName)
+  {
+    printUsage();
+    return 1;
+  }
+
+  std::ifstream input(fileName);
+  if (!input)
+  {
+    std::fprintf(stderr, "can not open %s\n", fileName);
+    return 1;
+  }
+
+  hostSerialOutput = 0;
+  if (!replayFile(&replay, input))
+    return 1;
+
+  std::printf("%d traces, %d of %d expectations met\n", (int) replay.traceCount,
+    (int) (replay.expectCount - replay.failureCount), (int) replay.expectCount);
+  return (replay.failureCount == 0) ? 0 : 1;
+}
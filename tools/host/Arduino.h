@@ -0,0 +1,172 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                  Arduino Host Stand-ins (Linux)                *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Stands in for the Arduino core so the sketch can be built and run on the PC by the host tests
+// in tools/.  Time only moves when the test sets hostMillis, the pins read back what the test
+// puts in hostPinValue[], and the AVR registers are plain variables that nothing acts on.  The
+// interrupt handlers are ordinary functions, so a test runs the 10ms background process by
+// calling TIMER3_COMPA_vect() itself.  What the sketch writes to Serial goes to hostSerialOutput
+// (the standard output, or nowhere if it is null), and what it reads comes from
+// hostSerialInput().
+//
+// The tests include KineticSculptureExtravaganza.ino and are built with this directory ahead of
+// the sketch's, for example:
+//
+//   g++ -std=gnu++11 -O2 -I tools/host -I . -o ScheduleDriftTest tools/ScheduleDriftTest.cpp tools/host/HostArduino.cpp
+//
+// A long is made 32 bits, as it is on the sculpture, so millis() wraps around after 49.7 days
+// and the time arithmetic is the same.  This is done with a #define, so a test must include
+// the standard headers it needs ahead of the sketch.  An int is still 32 bits rather than 16,
+// so the sizes of the structures are not the ones on the sculpture.
+//
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define long int
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define F_CPU 16000000UL
+
+// ---------------------------------------------------------------------------------
+//                              Program Memory
+// ---------------------------------------------------------------------------------
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *) (p))
+#define pgm_read_word(p) (*(const uint16_t *) (p))
+#define pgm_read_dword(p) (*(const uint32_t *) (p))
+#define pgm_read_float(p) (*(const float *) (p))
+#define pgm_read_ptr(p) (*(void * const *) (p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *) (s))
+
+// ---------------------------------------------------------------------------------
+//                                Core Functions
+// ---------------------------------------------------------------------------------
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define MSBFIRST 1
+#define HEX 16
+#define DEC 10
+#define B11111000 0xf8
+
+#define _BV(b) (1 << (b))
+#define bitSet(v, b) ((v) |= (1UL << (b)))
+#define bitClear(v, b) ((v) &= ~(1UL << (b)))
+#define bitRead(v, b) (((v) >> (b)) & 1)
+#define constrain(a, l, h) ((a) < (l) ? (l) : ((a) > (h) ? (h) : (a)))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define abs(x) ((x) > 0 ? (x) : -(x))
+#define digitalPinToInterrupt(p) (p)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+void analogWrite(int pin, int value);
+int analogRead(int pin);
+void attachInterrupt(int interrupt, void (*function)(), int mode);
+void detachInterrupt(int interrupt);
+void shiftOut(int dataPin, int clockPin, int bitOrder, byte value);
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// ---------------------------------------------------------------------------------
+//                          Interrupts and Registers
+// ---------------------------------------------------------------------------------
+
+#define ISR(vector) extern "C" void vector(void)
+#define SREG hostSREG
+
+inline void cli() {}
+inline void sei() {}
+
+#define HOST_REGISTER(name) extern volatile uint8_t name;
+#define HOST_REGISTER16(name) extern volatile uint16_t name;
+#include "HostRegisters.h"
+#undef HOST_REGISTER
+#undef HOST_REGISTER16
+
+enum {
+  CS30 = 0, CS31 = 1, CS32 = 2, WGM30 = 0, WGM31 = 1, WGM32 = 3, WGM33 = 4,
+  TOIE3 = 0, OCIE3A = 1, OCIE3B = 2, ICIE3 = 5, ICES3 = 6, ICNC3 = 7, OCF3A = 1,
+  COM3B0 = 4, COM3B1 = 5, COM3A0 = 6, COM3A1 = 7,
+  CS40 = 0, CS41 = 1, CS42 = 2, WGM40 = 0, WGM41 = 1, WGM42 = 3, WGM43 = 4,
+  OCIE4A = 1, OCIE4B = 2, ICIE4 = 5, ICF4 = 5, ICES4 = 6, ICNC4 = 7, OCF4A = 1,
+  COM4B0 = 4, COM4B1 = 5, COM4A0 = 6, COM4A1 = 7, FOC4A = 7,
+  CS50 = 0, CS51 = 1, CS52 = 2, WGM50 = 0, WGM51 = 1, WGM52 = 3, WGM53 = 4,
+  TOIE5 = 0, TOV5 = 0, OCIE5A = 1, OCF5A = 1, ICIE5 = 5, ICF5 = 5, ICES5 = 6, ICNC5 = 7,
+  PCIE0 = 0, PCIE1 = 1, PCIE2 = 2,
+  U2X0 = 1, UCSZ00 = 1, UCSZ01 = 2, TXEN0 = 3, RXEN0 = 4, UDRE0 = 5, UDRIE0 = 5, TXCIE0 = 6, RXCIE0 = 7
+};
+
+// ---------------------------------------------------------------------------------
+//                                  Serial Port
+// ---------------------------------------------------------------------------------
+
+class HardwareSerial
+{
+  public:
+    void begin(long baud) {}
+    void flush() {}
+    int available();
+    int availableForWrite();
+    int read();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t length);
+
+    size_t print(const char *s);
+    size_t print(const __FlashStringHelper *s) {return print((const char *) s);}
+    size_t print(char c) {return write((uint8_t) c);}
+    size_t print(unsigned char value, int base = DEC) {return print((unsigned long) value, base);}
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println() {return print("\r\n");}
+    template <class T> size_t println(T value) {size_t n = print(value); return n + println();}
+    template <class T> size_t println(T value, int format) {size_t n = print(value, format); return n + println();}
+};
+
+extern HardwareSerial Serial;
+
+// ---------------------------------------------------------------------------------
+//                              Host Test Controls
+// ---------------------------------------------------------------------------------
+
+extern unsigned long hostMillis;                // the time millis() returns
+extern int hostPinValue[];                      // what digitalRead() returns for each pin, HIGH to start
+extern FILE *hostSerialOutput;                  // where Serial writes go, null to throw them away
+extern int hostSerialTxRoom;                    // what Serial.availableForWrite() returns
+
+void hostSerialInput(const char *text, size_t length);
@@ -0,0 +1,47 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                   EEPROM Host Stand-in (Linux)                 *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Stands in for the EEPROM library with 4K bytes of RAM, erased (0xff) to start.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+class EEPROMClass
+{
+  public:
+    uint8_t memory[4096];
+
+    EEPROMClass() {memset(memory, 0xff, sizeof(memory));}
+
+    uint8_t read(int address) {return(memory[address & 4095]);}
+    void write(int address, uint8_t value) {memory[address & 4095] = value;}
+    void update(int address, uint8_t value) {write(address, value);}
+
+    template <class T> T &get(int address, T &value)
+    {
+      for (size_t i = 0; i < sizeof(T); i++)
+        ((uint8_t *) &value)[i] = read(address + i);
+      return(value);
+    }
+
+    template <class T> const T &put(int address, const T &value)
+    {
+      for (size_t i = 0; i < sizeof(T); i++)
+        update(address + i, ((const uint8_t *) &value)[i]);
+      return(value);
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+//
+// the writes take no time, so the EEPROM is always ready for the next
+//
+inline bool eeprom_is_ready() {return(true);}
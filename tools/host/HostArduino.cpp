@@ -0,0 +1,164 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                  Arduino Host Stand-ins (Linux)                *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// The definitions behind Arduino.h, Wire.h and EEPROM.h, linked with each host test.
+//
+
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "Wire.h"
+
+#define HOST_REGISTER(name) volatile uint8_t name;
+#define HOST_REGISTER16(name) volatile uint16_t name;
+#include "HostRegisters.h"
+
+HardwareSerial Serial;
+TwoWire Wire;
+EEPROMClass EEPROM;
+
+unsigned long hostMillis = 0;
+int hostPinValue[100];
+FILE *hostSerialOutput = stdout;
+int hostSerialTxRoom = 63;
+
+//
+// characters waiting to be read from Serial
+//
+static char hostSerialInputBuffer[4096];
+static size_t hostSerialInputHead = 0;
+static size_t hostSerialInputTail = 0;
+
+//
+// the pins read HIGH to start, as they do with their pull ups, so the push buttons on port F
+// read released
+//
+static struct HostPinSetup
+{
+  HostPinSetup()
+  {
+    for (int i = 0; i < 100; i++)
+      hostPinValue[i] = HIGH;
+    PINF = 0xff;
+  }
+} hostPinSetup;
+
+
+// ---------------------------------------------------------------------------------
+//                                Core Functions
+// ---------------------------------------------------------------------------------
+
+unsigned long millis() {return(hostMillis);}
+unsigned long micros() {return(hostMillis * 1000UL);}
+void delay(unsigned long ms) {hostMillis += ms;}
+void delayMicroseconds(unsigned int us) {}
+void pinMode(int pin, int mode) {}
+void digitalWrite(int pin, int value) {}
+int digitalRead(int pin) {return(hostPinValue[pin]);}
+void analogWrite(int pin, int value) {}
+int analogRead(int pin) {return(0);}
+void attachInterrupt(int interrupt, void (*function)(), int mode) {}
+void detachInterrupt(int interrupt) {}
+void shiftOut(int dataPin, int clockPin, int bitOrder, byte value) {}
+long random(long howBig) {return(howBig > 0 ? rand() % howBig : 0);}
+long random(long howSmall, long howBig) {return(howSmall + random(howBig - howSmall));}
+void randomSeed(unsigned long seed) {srand(seed);}
+
+
+// ---------------------------------------------------------------------------------
+//                                  Serial Port
+// ---------------------------------------------------------------------------------
+
+//
+// add characters for the sketch to read from Serial, any that don't fit are dropped as the
+// serial port's receive buffer would
+//
+void hostSerialInput(const char *text, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    if (hostSerialInputHead - hostSerialInputTail >= sizeof(hostSerialInputBuffer))
+      return;
+    hostSerialInputBuffer[hostSerialInputHead++ % sizeof(hostSerialInputBuffer)] = text[i];
+  }
+}
+
+
+int HardwareSerial::available()
+{
+  return(hostSerialInputHead - hostSerialInputTail);
+}
+
+
+int HardwareSerial::availableForWrite()
+{
+  return(hostSerialTxRoom);
+}
+
+
+int HardwareSerial::read()
+{
+  if (hostSerialInputTail == hostSerialInputHead)
+    return(-1);
+  return((byte) hostSerialInputBuffer[hostSerialInputTail++ % sizeof(hostSerialInputBuffer)]);
+}
+
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  if (hostSerialOutput)
+    fputc(c, hostSerialOutput);
+  return(1);
+}
+
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    write(buffer[i]);
+  return(length);
+}
+
+
+size_t HardwareSerial::print(const char *s)
+{
+  return(write((const uint8_t *) s, strlen(s)));
+}
+
+
+size_t HardwareSerial::print(long value, int base)
+{
+  if ((base != DEC) || (value >= 0))
+    return(print((unsigned long) value, base));
+
+  return(print('-') + print((unsigned long) 0 - (unsigned long) value, base));
+}
+
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+  char buffer[40];
+  char *s = &buffer[sizeof(buffer) - 1];
+
+  if ((base < 2) || (base > 16))
+    base = DEC;
+
+  *s = 0;
+  do
+  {
+    *--s = "0123456789ABCDEF"[value % base];
+    value /= base;
+  } while (value != 0);
+  return(print(s));
+}
+
+
+size_t HardwareSerial::print(double value, int digits)
+{
+  char buffer[40];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return(print(buffer));
+}
@@ -0,0 +1,29 @@
+//
+// the AVR registers the sketch uses, included by Arduino.h to declare them and by
+// HostArduino.cpp to define them
+//
+HOST_REGISTER(hostSREG)
+
+HOST_REGISTER(TCCR1A) HOST_REGISTER(TCCR1B) HOST_REGISTER16(TCNT1)
+HOST_REGISTER(TCCR2A) HOST_REGISTER(TCCR2B)
+HOST_REGISTER(TCCR3A) HOST_REGISTER(TCCR3B) HOST_REGISTER(TCCR3C) HOST_REGISTER(TIMSK3) HOST_REGISTER(TIFR3)
+HOST_REGISTER16(TCNT3) HOST_REGISTER16(OCR3A) HOST_REGISTER16(OCR3B) HOST_REGISTER16(ICR3)
+HOST_REGISTER(TCCR4A) HOST_REGISTER(TCCR4B) HOST_REGISTER(TCCR4C) HOST_REGISTER(TIMSK4) HOST_REGISTER(TIFR4)
+HOST_REGISTER16(TCNT4) HOST_REGISTER16(OCR4A) HOST_REGISTER16(OCR4B) HOST_REGISTER16(ICR4)
+HOST_REGISTER(TCCR5A) HOST_REGISTER(TCCR5B) HOST_REGISTER(TIMSK5) HOST_REGISTER(TIFR5)
+HOST_REGISTER16(TCNT5) HOST_REGISTER16(OCR5A) HOST_REGISTER16(ICR5)
+
+HOST_REGISTER(PORTA) HOST_REGISTER(PINA) HOST_REGISTER(DDRA)
+HOST_REGISTER(PORTB) HOST_REGISTER(PINB) HOST_REGISTER(DDRB)
+HOST_REGISTER(PORTD) HOST_REGISTER(PIND) HOST_REGISTER(DDRD)
+HOST_REGISTER(PORTE) HOST_REGISTER(PINE) HOST_REGISTER(DDRE)
+HOST_REGISTER(PORTF) HOST_REGISTER(PINF) HOST_REGISTER(DDRF)
+HOST_REGISTER(PORTG) HOST_REGISTER(PING)
+HOST_REGISTER(PORTH) HOST_REGISTER(PINH) HOST_REGISTER(DDRH)
+HOST_REGISTER(PORTK) HOST_REGISTER(PINK) HOST_REGISTER(DDRK)
+HOST_REGISTER(PORTL) HOST_REGISTER(PINL) HOST_REGISTER(DDRL)
+
+HOST_REGISTER(PCICR) HOST_REGISTER(PCIFR) HOST_REGISTER(PCMSK0) HOST_REGISTER(PCMSK1) HOST_REGISTER(PCMSK2)
+HOST_REGISTER(EIMSK) HOST_REGISTER(EICRA) HOST_REGISTER(EICRB)
+
+HOST_REGISTER(UCSR0A) HOST_REGISTER(UCSR0B) HOST_REGISTER(UCSR0C) HOST_REGISTER(UDR0) HOST_REGISTER16(UBRR0)
@@ -0,0 +1,47 @@
+//      ******************************************************************
+//      *                                                                *
+//      *                    I2C Host Stand-in (Linux)                   *
+//      *                                                                *
+//      ******************************************************************
+
+//
+// Stands in for the Wire library with a single device of 256 registers, which is enough for
+// the DS1307 clock and its RAM.  The first byte written after beginTransmission() sets the
+// register pointer, the rest are stored from there on, and reads carry on from the pointer.
+// Clear present to make the clock go missing.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class TwoWire
+{
+  public:
+    uint8_t registers[256];
+    uint8_t pointer = 0;
+    bool present = true;
+
+    void begin() {}
+    void beginTransmission(int address) {pointerNextFlg = true;}
+    int endTransmission(bool stop = true) {return(present ? 0 : 2);}
+    int requestFrom(int address, int count) {return(present ? count : 0);}
+    int available() {return(0);}
+    int read() {return(registers[pointer++]);}
+
+    size_t write(uint8_t value)
+    {
+      if (pointerNextFlg)
+        pointer = value;
+      else
+        registers[pointer++] = value;
+      pointerNextFlg = false;
+      return(1);
+    }
+
+  private:
+    bool pointerNextFlg = false;
+};
+
+extern TwoWire Wire;